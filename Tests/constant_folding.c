@@ -0,0 +1,12 @@
+int printf(const char *s, ...);
+
+int main(int argc, char **argv) {
+  printf("%d %d %d %d\n", 2 + 3 * 5 - 7, 100 / 7 - 100 % 7, -(1 << 4),
+         (0 - 9) >> 1);
+  printf("%d %u %u %ld\n", 2147483647 + 1, 0u - 1, 0xffffffff + 1,
+         4294967295 + 1);
+  printf("%d %d %d %d %d\n", -1 < 0u, -1 < 0, !5, ~0, 6 & 3 | 8 ^ 1);
+  printf("%d %d %d %d\n", 1 ? 10 : 20, 0 && argc, 1 || argc, 'a' + 1);
+  printf("%d %d %d\n", argc * 1 + 0, 1 * argc - 0, 0 + argc * 3);
+  return 3 * 4 - argc;
+}
@@ -0,0 +1,54 @@
+int printf(const char *s, ...);
+
+int sign(int x) {
+  if (x < 0) return 0 - 1;
+  if (x > 0) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+int sum_to(int n) {
+  int i;
+  int sum;
+  sum = 0;
+  for (i = 1; i <= n; i = i + 1) sum = sum + i;
+  return sum;
+}
+
+int count_down(int n) {
+  int steps;
+  steps = 0;
+  while (n != 0) {
+    n = n - 1;
+    steps = steps + 1;
+    if (steps == 100) return 0 - 1;
+  }
+  return steps;
+}
+
+int above_five(unsigned x) {
+  if (x - 1 == 4294967295u) printf("wrapped ");
+  return x - 1 > 5;
+}
+
+int less(int a, unsigned b) {
+  return a < b;
+}
+
+int main(int argc, char **argv) {
+  int i;
+  printf("%d %d %d\n", sign(0 - 5), sign(0), sign(7));
+  printf("%d %d\n", sum_to(10), count_down(42));
+  printf("%d %d %d\n", above_five(0), above_five(3), above_five(7));
+  printf("%d %d\n", less(0 - 1, 1), less(1, 2));
+  for (i = 0; i < 3; i = i + 1) {
+    if (i == argc) {
+      printf("i == argc at %d\n", i);
+    } else if (i >= 2) {
+      printf("i >= 2 at %d\n", i);
+    }
+  }
+  for (;;) return sum_to(argc + 3);
+}
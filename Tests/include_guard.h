@@ -0,0 +1,12 @@
+#ifndef INCLUDE_GUARD_H
+#define INCLUDE_GUARD_H
+
+int puts(const char *s);
+
+int PrintGuarded(int n)
+{
+  puts("guarded");
+  return 0;
+}
+
+#endif
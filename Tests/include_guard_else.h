@@ -0,0 +1,18 @@
+#ifndef INCLUDE_GUARD_ELSE_H
+#define INCLUDE_GUARD_ELSE_H
+
+int PrintFirst(int n)
+{
+  puts("first inclusion");
+  return 0;
+}
+
+#else
+
+int PrintSecond(int n)
+{
+  puts("second inclusion");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#include "include_guard.h"
+#include "pragma_once.h"
+#include "include_guard_else.h"
+#include "include_guard.h"
+#include "pragma_once.h"
+#include "include_guard_else.h"
+
+int main()
+{
+  PrintGuarded(1);
+  PrintOnce(2);
+  PrintFirst(3);
+  PrintSecond(4);
+  return 0;
+}
@@ -0,0 +1,25 @@
+int puts(const char *s);
+
+int main(int argc, char **argv) {
+  char c;
+  char minus_one;
+  unsigned char uc;
+  short s;
+  long l;
+  unsigned int u;
+  int a[4];
+  c = 300;
+  minus_one = 0 - 1;
+  uc = 200 + 100;
+  s = 70000;
+  u = 3;
+  l = c + uc + s;
+  puts("integer types");
+  u = 4294967295;
+  if (u + 1) puts("u + 1 is not 0");
+  u = 1;
+  l = u - 2;
+  if (l == 4294967295) puts("u - 2 wraps around in unsigned int");
+  l = 3;
+  return l - 4464 + u + minus_one + argc;
+}
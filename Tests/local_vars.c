@@ -0,0 +1,16 @@
+int puts(const char *s);
+
+int add(int a, int b) {
+  int sum;
+  sum = a + b;
+  return sum;
+}
+
+int main(int argc, char **argv) {
+  int x;
+  int y;
+  x = add(argc, 4);
+  y = x * 3;
+  puts("locals");
+  return y - argc;
+}
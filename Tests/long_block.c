@@ -0,0 +1,75 @@
+int puts(const char *s);
+
+int main() {
+  puts("1");
+  puts("2");
+  puts("3");
+  puts("4");
+  puts("5");
+  puts("6");
+  puts("7");
+  puts("8");
+  puts("9");
+  puts("10");
+  puts("11");
+  puts("12");
+  puts("13");
+  puts("14");
+  puts("15");
+  puts("16");
+  puts("17");
+  puts("18");
+  puts("19");
+  puts("20");
+  puts("21");
+  puts("22");
+  puts("23");
+  puts("24");
+  puts("25");
+  puts("26");
+  puts("27");
+  puts("28");
+  puts("29");
+  puts("30");
+  puts("31");
+  puts("32");
+  puts("33");
+  puts("34");
+  puts("35");
+  puts("36");
+  puts("37");
+  puts("38");
+  puts("39");
+  puts("40");
+  puts("41");
+  puts("42");
+  puts("43");
+  puts("44");
+  puts("45");
+  puts("46");
+  puts("47");
+  puts("48");
+  puts("49");
+  puts("50");
+  puts("51");
+  puts("52");
+  puts("53");
+  puts("54");
+  puts("55");
+  puts("56");
+  puts("57");
+  puts("58");
+  puts("59");
+  puts("60");
+  puts("61");
+  puts("62");
+  puts("63");
+  puts("64");
+  puts("65");
+  puts("66");
+  puts("67");
+  puts("68");
+  puts("69");
+  puts("70");
+  return 0;
+}
@@ -0,0 +1,59 @@
+int printf(const char *s, ...);
+
+#define ONE 1
+#define TWO ONE + ONE
+#define ADD(a, b) a + b
+#define MUL(a, b) a * b
+#define SQUARE(x) MUL(x, x)
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define CAT(a, b) a##b
+#define LOG(fmt, ...) printf(fmt, __VA_ARGS__)
+#define printf printf
+#define EMPTY
+
+#if ADD(TWO, 3) == 5 && defined(ONE) && !defined UNDEFINED
+#define RESULT 3
+#elif 1
+#define RESULT 4
+#else
+#error RESULT
+#endif
+
+#ifdef UNDEFINED
+#error "UNDEFINED is defined"
+#endif
+
+#undef ONE
+#ifndef ONE
+#define ONE 2
+#endif
+
+#if ONE == 1
+#error ONE is not undefined
+#elif ONE * 2 == 4 ? 0 : 1
+#error ?: is wrong
+#else
+#define SUM ADD(SQUARE(ONE), RESULT)
+#endif
+
+#if 0 && 1 / 0 || 1 || 1 % 0
+#if 1 ? 2 : 1 << 64
+#define SKIPPED 5
+#endif
+#endif
+
+#if -1 > 0u && (0 - 1) >> 1 < 0 && (1 ? 0u : 0 - 1) - 1 > 0
+#define UNSIGNED 6
+#endif
+
+int main()
+{
+  printf("%d %d\n", TWO, ADD(ONE, 2));
+  printf("%d\n", SQUARE(3));
+  printf("%s %s %s\n", STR(a + b), XSTR(TWO), STR("x\n"));
+  LOG("%d %d %d\n", CAT(1, 2), CAT(ON, E), CAT(, ONE));
+  LOG("%d\n" EMPTY, SUM);
+  printf("%d %d\n", SKIPPED, UNSIGNED);
+  return RESULT;
+}
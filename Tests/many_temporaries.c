@@ -0,0 +1,68 @@
+int printf(const char *s, ...);
+
+int many(int argc) {
+  int a;
+  int b;
+  a = argc * 3;
+  b = argc + 7;
+  printf("%d %d\n", a, b);
+  return (argc + 0) * 1 + (argc + 1) * 2 + (argc + 2) * 3 +
+         (argc + 3) * 4 + (argc + 4) * 5 + (argc + 5) * 6 +
+         (argc + 6) * 7 + (argc + 7) * 1 + (argc + 8) * 2 +
+         (argc + 9) * 3 + (argc + 10) * 4 + (argc + 11) * 5 +
+         (argc + 12) * 6 + (argc + 13) * 7 + (argc + 14) * 1 +
+         (argc + 15) * 2 + (argc + 16) * 3 + (argc + 17) * 4 +
+         (argc + 18) * 5 + (argc + 19) * 6 + (argc + 20) * 7 +
+         (argc + 21) * 1 + (argc + 22) * 2 + (argc + 23) * 3 +
+         (argc + 24) * 4 + (argc + 25) * 5 + (argc + 26) * 6 +
+         (argc + 27) * 7 + (argc + 28) * 1 + (argc + 29) * 2 +
+         (argc + 30) * 3 + (argc + 31) * 4 + (argc + 32) * 5 +
+         (argc + 33) * 6 + (argc + 34) * 7 + (argc + 35) * 1 +
+         (argc + 36) * 2 + (argc + 37) * 3 + (argc + 38) * 4 +
+         (argc + 39) * 5 + (argc + 40) * 6 + (argc + 41) * 7 +
+         (argc + 42) * 1 + (argc + 43) * 2 + (argc + 44) * 3 +
+         (argc + 45) * 4 + (argc + 46) * 5 + (argc + 47) * 6 +
+         (argc + 48) * 7 + (argc + 49) * 1 + (argc + 50) * 2 +
+         (argc + 51) * 3 + (argc + 52) * 4 + (argc + 53) * 5 +
+         (argc + 54) * 6 + (argc + 55) * 7 + (argc + 56) * 1 +
+         (argc + 57) * 2 + (argc + 58) * 3 + (argc + 59) * 4 +
+         (argc + 60) * 5 + (argc + 61) * 6 + (argc + 62) * 7 +
+         (argc + 63) * 1 + (argc + 64) * 2 + (argc + 65) * 3 +
+         (argc + 66) * 4 + (argc + 67) * 5 + (argc + 68) * 6 +
+         (argc + 69) * 7 + (argc + 70) * 1 + (argc + 71) * 2 +
+         (argc + 72) * 3 + (argc + 73) * 4 + (argc + 74) * 5 +
+         (argc + 75) * 6 + (argc + 76) * 7 + (argc + 77) * 1 +
+         (argc + 78) * 2 + (argc + 79) * 3 + (argc + 80) * 4 +
+         (argc + 81) * 5 + (argc + 82) * 6 + (argc + 83) * 7 +
+         (argc + 84) * 1 + (argc + 85) * 2 + (argc + 86) * 3 +
+         (argc + 87) * 4 + (argc + 88) * 5 + (argc + 89) * 6 +
+         (argc + 90) * 7 + (argc + 91) * 1 + (argc + 92) * 2 +
+         (argc + 93) * 3 + (argc + 94) * 4 + (argc + 95) * 5 +
+         (argc + 96) * 6 + (argc + 97) * 7 + (argc + 98) * 1 +
+         (argc + 99) * 2 + (argc + 100) * 3 + (argc + 101) * 4 +
+         (argc + 102) * 5 + (argc + 103) * 6 + (argc + 104) * 7 +
+         (argc + 105) * 1 + (argc + 106) * 2 + (argc + 107) * 3 +
+         (argc + 108) * 4 + (argc + 109) * 5 + (argc + 110) * 6 +
+         (argc + 111) * 7 + (argc + 112) * 1 + (argc + 113) * 2 +
+         (argc + 114) * 3 + (argc + 115) * 4 + (argc + 116) * 5 +
+         (argc + 117) * 6 + (argc + 118) * 7 + (argc + 119) * 1 +
+         (argc + 120) * 2 + (argc + 121) * 3 + (argc + 122) * 4 +
+         (argc + 123) * 5 + (argc + 124) * 6 + (argc + 125) * 7 +
+         (argc + 126) * 1 + (argc + 127) * 2 + (argc + 128) * 3 +
+         (argc + 129) * 4 + (argc + 130) * 5 + (argc + 131) * 6 +
+         (argc + 132) * 7 + (argc + 133) * 1 + (argc + 134) * 2 +
+         (argc + 135) * 3 + (argc + 136) * 4 + (argc + 137) * 5 +
+         (argc + 138) * 6 + (argc + 139) * 7 + (argc + 140) * 1 +
+         (argc + 141) * 2 + (argc + 142) * 3 + (argc + 143) * 4 +
+         (argc + 144) * 5 + (argc + 145) * 6 + (argc + 146) * 7 +
+         (argc + 147) * 1 + (argc + 148) * 2 + (argc + 149) * 3;
+}
+
+int main(int argc, char **argv) {
+  int i;
+  int sum;
+  sum = 0;
+  for (i = 0; i < 4; i = i + 1) sum = sum + many(i + argc);
+  printf("%d\n", sum);
+  return many(argc) - sum;
+}
@@ -0,0 +1,23 @@
+int puts(const char *s);
+
+int first() {
+  puts("first");
+  return 1;
+}
+
+int second() {
+  puts("second");
+  return 2;
+}
+
+int third() {
+  puts("third");
+  return 3;
+}
+
+int main() {
+  first();
+  second();
+  third();
+  return 4;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include "include_guard.h"
+
+int PrintOnce(int n)
+{
+  puts("once");
+  return 0;
+}
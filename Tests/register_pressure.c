@@ -0,0 +1,40 @@
+int printf(const char *s, ...);
+
+int sub(int a, int b) { return a - b; }
+
+int mix(int a, int b, int c, int d, int e, int f) {
+  return a * 100000 + b * 10000 + c * 1000 + d * 100 + e * 10 + f;
+}
+
+int shuffle(int a, int b, int c, int d, int e, int f) {
+  return mix(b, a, d, c, f, e) - mix(f, e, d, c, b, a) + sub(b, a);
+}
+
+int deep(int n) {
+  int v1;
+  int v2;
+  int v3;
+  int v4;
+  int v5;
+  int v6;
+  int v7;
+  int v8;
+  if (n == 0) return 1;
+  v1 = n * 2;
+  v2 = n * 3;
+  v3 = n + 4;
+  v4 = n + 5;
+  v5 = n * n;
+  v6 = n - 7;
+  v7 = n * 11;
+  v8 = n + 13;
+  return deep(n - 1) + v1 + v2 * 2 + v3 * 3 + v4 * 4 + v5 * 5 + v6 * 6 +
+         v7 * 7 + v8 * 8 + deep(n - 1) * 0;
+}
+
+int main(int argc, char **argv) {
+  printf("%d %d\n", sub(argc, 7), sub(7, argc));
+  printf("%d\n", shuffle(1, 2, 3, 4, 5, 6));
+  printf("%d %d\n", deep(3), deep(6));
+  return deep(argc) - 40;
+}
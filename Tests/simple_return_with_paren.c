@@ -0,0 +1,3 @@
+int main() {
+  return (2 + 3) * (7 - 4) - (1, 2);
+}
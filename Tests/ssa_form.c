@@ -0,0 +1,82 @@
+int printf(const char *s, ...);
+
+int fib(int n) {
+  int a;
+  int b;
+  int t;
+  a = 0;
+  b = 1;
+  while (n > 0) {
+    t = a + b;
+    a = b;
+    b = t;
+    n = n - 1;
+  }
+  return a;
+}
+
+int wrap(int n) {
+  unsigned char c;
+  int i;
+  c = 250;
+  for (i = 0; i < n; i = i + 1) c = c + 1;
+  return c;
+}
+
+int pick(int x) {
+  int y;
+  y = x * 3;
+  if (x < 10) {
+    y = y + 1;
+  } else if (x == 10) {
+    y = 0;
+  }
+  return y;
+}
+
+int skip_one(int n) {
+  int i;
+  int r;
+  i = 0;
+  r = 0;
+  while (i < n) {
+    i = i + 1;
+    if (i == 2) {
+      r = r + 10;
+      continue;
+    }
+    r = r + 1;
+  }
+  return r;
+}
+
+int skip_two(int n) {
+  int i;
+  int r;
+  i = 0;
+  r = 0;
+  for (;;) {
+    i = i + 1;
+    if (i == 2) {
+      r = r + 10;
+      continue;
+    }
+    if (i == 3) {
+      r = r + 100;
+      continue;
+    }
+    if (i > n) break;
+    r = r + 1;
+  }
+  return r;
+}
+
+int main(int argc, char **argv) {
+  int unused;
+  unused = argc * 7, argc + 1;
+  printf("%d %d %d\n", fib(1), fib(10), fib(20));
+  printf("%d %d\n", wrap(3), wrap(10));
+  printf("%d %d %d\n", pick(2), pick(10), pick(11));
+  printf("%d %d %d\n", skip_one(4), skip_two(4), skip_two(1));
+  return fib(argc + 5);
+}
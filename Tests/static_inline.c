@@ -0,0 +1,29 @@
+int puts(const char *s);
+
+static inline int unused() {
+  int i;
+  for (i = 0; i < 3; i = i + 1) {
+    puts("unused");
+  }
+  return i;
+}
+
+static int helper() {
+  puts("helper");
+  return 2;
+}
+
+static inline int call_helper() {
+  helper();
+  return 3;
+}
+
+static int unused_caller() {
+  unused();
+  return 4;
+}
+
+int main() {
+  call_helper();
+  return 5;
+}
@@ -0,0 +1 @@
+#include "static_inline.c"
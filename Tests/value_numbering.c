@@ -0,0 +1,33 @@
+int printf(const char *s, ...);
+
+int square_sum(int a, int b) {
+  return a * b + a * b + b * a;
+}
+
+int reuse_in_branches(int x, int y) {
+  int s;
+  s = x + y;
+  if (x < y) {
+    s = s + (x + y) * (y + x);
+  } else {
+    s = s - (x + y);
+  }
+  return s + (x + y);
+}
+
+int loop(int n) {
+  int i;
+  int sum;
+  sum = 0;
+  for (i = 0; i < n; i = i + 1) {
+    sum = sum + (n - 1) * 2 + (n - 1);
+  }
+  return sum;
+}
+
+int main(int argc, char **argv) {
+  printf("%d %d\n", square_sum(3, 4), square_sum(argc, argc + 1));
+  printf("%d %d\n", reuse_in_branches(1, 2), reuse_in_branches(5, 2));
+  printf("%d %d\n", loop(0), loop(5));
+  return square_sum(argc, 2) + loop(argc);
+}
@@ -0,0 +1,72 @@
+#include "compilium.h"
+
+// Bump-pointer arenas.
+// Objects are carved out of large chunks and never freed one by one; an
+// arena releases everything at once with ResetArena(). Released chunks are
+// kept for reuse, so a reset costs no calls to the allocator.
+
+#define ARENA_CHUNK_SIZE (256 * 1024)
+#define ARENA_ALIGNMENT 16
+
+struct ARENA_CHUNK {
+  ArenaChunk *prev;
+  size_t size;  // of data
+  _Alignas(ARENA_ALIGNMENT) char data[];
+};
+
+// Tokens live as long as the header cache, which is shared by every
+// translation unit.
+Arena token_arena;
+// The IL of the function being compiled, reset by FreeILFunc().
+Arena il_arena;
+
+static ArenaChunk *AllocArenaChunk(Arena *arena, size_t size) {
+  ArenaChunk *chunk;
+  if (size <= ARENA_CHUNK_SIZE && arena->free_chunks) {
+    chunk = arena->free_chunks;
+    arena->free_chunks = chunk->prev;
+  } else {
+    if (size < ARENA_CHUNK_SIZE) size = ARENA_CHUNK_SIZE;
+    chunk = malloc(sizeof(ArenaChunk) + size);
+    if (!chunk) Error("Failed to allocate an arena chunk");
+    chunk->size = size;
+  }
+  chunk->prev = arena->chunk;
+  arena->chunk = chunk;
+  arena->used = 0;
+  return chunk;
+}
+
+void *AllocFromArena(Arena *arena, size_t size) {
+  size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+  if (!arena->chunk || arena->chunk->size - arena->used < size) {
+    // A large object gets a chunk of its own; the rest of the current chunk
+    // is left unused.
+    AllocArenaChunk(arena, size);
+  }
+  void *p = arena->chunk->data + arena->used;
+  arena->used += size;
+  return p;
+}
+
+void *ReallocFromArena(Arena *arena, void *p, size_t old_size,
+                       size_t size) {
+  // Grows an array allocated from arena; the old one is left unused.
+  void *new_p = AllocFromArena(arena, size);
+  if (p) memcpy(new_p, p, old_size < size ? old_size : size);
+  return new_p;
+}
+
+void ResetArena(Arena *arena) {
+  while (arena->chunk) {
+    ArenaChunk *chunk = arena->chunk;
+    arena->chunk = chunk->prev;
+    if (chunk->size == ARENA_CHUNK_SIZE) {
+      chunk->prev = arena->free_chunks;
+      arena->free_chunks = chunk;
+    } else {
+      free(chunk);
+    }
+  }
+  arena->used = 0;
+}
@@ -1,26 +1,150 @@
+#define _DEFAULT_SOURCE
+#include <limits.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <sys/mman.h>
 
 #include "compilium.h"
 
+// Node store.
+// Every node takes one fixed-size slot of a single array, and its handle is
+// the index of the slot. The array is reserved in virtual memory up front,
+// so it never moves and ASTNode pointers stay valid while it fills up.
+// Variable-length data (the elements of long ASTLists) lives in a side array
+// of handles, reserved the same way.
+// Each thread allocates from a block of slots of its own, so function bodies
+// can be parsed concurrently and handles are valid in every thread; within a
+// thread, nodes are laid out in allocation order. Only claiming a new block
+// takes a lock.
+#define AST_NODE_SLOT_SIZE 24
+#define MAX_AST_NODES (1 << 26)
+#define MAX_AST_EXTRA (1 << 26)
+#define AST_BLOCK_SIZE 4096
+
+typedef struct {
+  _Alignas(8) unsigned char data[AST_NODE_SLOT_SIZE];
+} ASTNodeSlot;
+
+static ASTNodeSlot* ast_nodes;  // ast_nodes[0] is not used
+static ASTHandle* ast_extra;
+static unsigned int num_of_claimed_ast_nodes = 1;
+static unsigned int num_of_claimed_ast_extra;
+static pthread_mutex_t ast_store_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local ASTCheckpoint ast_cursor;
+
+static void* ReserveASTArray(size_t size) {
+  void* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) Error("Failed to reserve the AST store");
+  return p;
+}
+
+static ASTRange ClaimASTRange(unsigned int* num_of_claimed, unsigned int size,
+                              unsigned int limit) {
+  if (size < AST_BLOCK_SIZE) size = AST_BLOCK_SIZE;
+  pthread_mutex_lock(&ast_store_lock);
+  if (!ast_nodes) {
+    ast_nodes = ReserveASTArray(sizeof(ASTNodeSlot) * MAX_AST_NODES);
+    ast_extra = ReserveASTArray(sizeof(ASTHandle) * MAX_AST_EXTRA);
+  }
+  if (limit - *num_of_claimed < size) Error("Too many AST nodes");
+  ASTRange range = {*num_of_claimed, *num_of_claimed + size};
+  *num_of_claimed += size;
+  pthread_mutex_unlock(&ast_store_lock);
+  return range;
+}
+
+static ASTNode* AllocASTNodeSlot(ASTType type) {
+  ASTRange* nodes = &ast_cursor.nodes;
+  if (nodes->next == nodes->end) {
+    *nodes = ClaimASTRange(&num_of_claimed_ast_nodes, 1, MAX_AST_NODES);
+  }
+  ASTNode* node = (ASTNode*)&ast_nodes[nodes->next++];
+  memset(node, 0, sizeof(ASTNodeSlot));  // the slot may have been rolled back
+  node->type = type;
+  return node;
+}
+
+static unsigned int AllocASTExtra(unsigned int size) {
+  // Returns the index of size new handles in the side array.
+  ASTRange* extra = &ast_cursor.extra;
+  if (extra->end - extra->next < size) {
+    // The rest of the current block is left unused.
+    *extra = ClaimASTRange(&num_of_claimed_ast_extra, size, MAX_AST_EXTRA);
+  }
+  unsigned int index = extra->next;
+  extra->next += size;
+  return index;
+}
+
+ASTNode* GetASTNode(ASTHandle handle) {
+  if (!handle) return NULL;
+  return (ASTNode*)&ast_nodes[handle];
+}
+
+ASTHandle GetASTHandle(const void* node) {
+  if (!node) return 0;
+  return (const ASTNodeSlot*)node - ast_nodes;
+}
+
+ASTCheckpoint GetASTCheckpoint() { return ast_cursor; }
+
+void RollbackAST(ASTCheckpoint checkpoint) {
+  // Releases every node the calling thread allocated after checkpoint was
+  // taken. Blocks claimed since then are not reused.
+  ast_cursor = checkpoint;
+}
+
+void ResetAST() {
+  // Releases every node. No other thread may be using the store.
+  ASTCheckpoint empty = {{0, 0}, {0, 0}};
+  pthread_mutex_lock(&ast_store_lock);
+  num_of_claimed_ast_nodes = 1;
+  num_of_claimed_ast_extra = 0;
+  pthread_mutex_unlock(&ast_store_lock);
+  ast_cursor = empty;
+}
+
+// ASTList is a small vector: short lists, the common case, keep their
+// elements inline, and longer ones grow geometrically in the side array.
+// Storage left behind by growth is not reused; with doubling it is less than
+// the final capacity.
+#define AST_LIST_INLINE_CAPACITY 3
+
 struct AST_LIST {
   ASTType type;
   int capacity;
   int size;
-  ASTNode* nodes[];
+  union {
+    ASTHandle inline_nodes[AST_LIST_INLINE_CAPACITY];
+    unsigned int extra;  // if capacity > AST_LIST_INLINE_CAPACITY
+  };
 };
 
+_Static_assert(sizeof(ASTList) <= AST_NODE_SLOT_SIZE,
+               "ASTList does not fit in a node slot");
+
+static ASTHandle* GetASTListElements(const ASTList* list) {
+  if (list->capacity <= AST_LIST_INLINE_CAPACITY)
+    return (ASTHandle*)list->inline_nodes;
+  return &ast_extra[list->extra];
+}
+
 const char* ASTTypeName[kNumOfASTType];
 
 void InitASTTypeName() {
   ASTTypeName[kASTFuncDecl] = "FuncDecl";
   ASTTypeName[kASTFuncDef] = "FuncDef";
   ASTTypeName[kASTCompStmt] = "CompStmt";
+  ASTTypeName[kASTExprUnaryPreOp] = "ExprUnaryPreOp";
+  ASTTypeName[kASTExprUnaryPostOp] = "ExprUnaryPostOp";
   ASTTypeName[kASTExprBinOp] = "ExprBinOp";
+  ASTTypeName[kASTCondExpr] = "CondExpr";
   ASTTypeName[kASTConstant] = "Constant";
   ASTTypeName[kASTExprStmt] = "ExprStmt";
   ASTTypeName[kASTJumpStmt] = "JumpStmt";
   ASTTypeName[kASTForStmt] = "ForStmt";
-  ASTTypeName[kASTILOp] = "ILOp";
+  ASTTypeName[kASTIfStmt] = "IfStmt";
   ASTTypeName[kASTList] = "List";
   ASTTypeName[kASTKeyword] = "Keyword";
   ASTTypeName[kASTDecltor] = "Decltor";
@@ -46,12 +170,15 @@ ASTNode* ToASTNode(void* node) { return (ASTNode*)node; }
 GenToAST(FuncDecl);
 GenToAST(FuncDef);
 GenToAST(CompStmt);
+GenToAST(ExprUnaryPreOp);
+GenToAST(ExprUnaryPostOp);
 GenToAST(ExprBinOp);
+GenToAST(CondExpr);
 GenToAST(Constant);
 GenToAST(ExprStmt);
 GenToAST(JumpStmt);
 GenToAST(ForStmt);
-GenToAST(ILOp);
+GenToAST(IfStmt);
 GenToAST(List);
 GenToAST(Keyword);
 GenToAST(Decltor);
@@ -63,20 +190,22 @@ GenToAST(Pointer);
 
 #define GenAllocAST(Type) \
   AST##Type* AllocAST##Type() { \
-    AST##Type* node = (AST##Type*)malloc(sizeof(AST##Type)); \
-    node->type = kAST##Type; \
-    return node; \
+    _Static_assert(sizeof(AST##Type) <= AST_NODE_SLOT_SIZE, \
+                   "AST" #Type " does not fit in a node slot"); \
+    return (AST##Type*)AllocASTNodeSlot(kAST##Type); \
   }
 
 GenAllocAST(FuncDecl);
 GenAllocAST(FuncDef);
 GenAllocAST(CompStmt);
+GenAllocAST(ExprUnaryPreOp);
+GenAllocAST(ExprUnaryPostOp);
 GenAllocAST(ExprBinOp);
+GenAllocAST(CondExpr);
 GenAllocAST(Constant);
 GenAllocAST(ExprStmt);
 GenAllocAST(JumpStmt);
 GenAllocAST(ForStmt);
-GenAllocAST(ILOp);
 GenAllocAST(Keyword);
 GenAllocAST(Decltor);
 GenAllocAST(DirectDecltor);
@@ -84,18 +213,57 @@ GenAllocAST(Ident);
 GenAllocAST(Decl);
 GenAllocAST(ParamDecl);
 GenAllocAST(Pointer);
+GenAllocAST(IfStmt);
 
-ASTList* AllocASTList(int capacity) {
-  ASTList* list = malloc(sizeof(ASTList) + sizeof(ASTNode*) * capacity);
-  list->type = kASTList;
-  list->capacity = capacity;
-  list->size = 0;
+ASTList* AllocASTList() {
+  ASTList* list = (ASTList*)AllocASTNodeSlot(kASTList);
+  list->capacity = AST_LIST_INLINE_CAPACITY;
   return list;
 }
 
+static void InitIntegerConstant(ASTConstant* node) {
+  // The type is the first of int, unsigned int (if octal, hex or suffixed
+  // with u), long and unsigned long that can represent the value (6.4.4.1).
+  const Token* token = node->token;
+  char* p;
+  unsigned long long value = strtoull(token->begin, &p, 0);
+  int is_unsigned = 0;
+  int is_long = 0;
+  for (; p < token->begin + token->length; p++) {
+    if (*p == 'u' || *p == 'U') {
+      is_unsigned = 1;
+    } else if (*p == 'l' || *p == 'L') {
+      is_long = 1;  // long and long long are both 8 bytes
+    } else {
+      break;
+    }
+  }
+  if (p != token->begin + token->length) {
+    Error("%.*s is not valid as integer.", token->length, token->begin);
+  }
+  int is_decimal = token->begin[0] != '0';
+  int size = 8;
+  if (!is_long && value <= (is_unsigned ? UINT_MAX : INT_MAX)) {
+    size = 4;
+  } else if (!is_long && !is_decimal && value <= UINT_MAX) {
+    size = 4;
+    is_unsigned = 1;
+  }
+  if (size == 8 && value > LLONG_MAX) is_unsigned = 1;
+  node->size = size;
+  node->is_unsigned = is_unsigned;
+  node->value = is_unsigned || size == 8 ? (long long)value : (int)value;
+}
+
 ASTNode* AllocAndInitASTConstant(const Token* token) {
   ASTConstant* node = AllocASTConstant();
   node->token = token;
+  if (token->type == kInteger) {
+    InitIntegerConstant(node);
+  } else if (token->type == kCharacterLiteral) {
+    node->size = 4;
+    node->value = GetCharacterLiteralValue(token);
+  }
   return ToASTNode(node);
 }
 
@@ -111,43 +279,74 @@ ASTKeyword* AllocAndInitASTKeyword(const Token* token) {
   return node;
 }
 
+ASTNode* AllocAndInitASTExprUnaryPreOp(const Token* op, ASTNode* expr) {
+  ASTExprUnaryPreOp* node = AllocASTExprUnaryPreOp();
+  node->op = op;
+  node->expr = GetASTHandle(expr);
+  return ToASTNode(node);
+}
+
+ASTNode* AllocAndInitASTExprUnaryPostOp(const Token* op, ASTNode* expr) {
+  ASTExprUnaryPostOp* node = AllocASTExprUnaryPostOp();
+  node->op = op;
+  node->expr = GetASTHandle(expr);
+  return ToASTNode(node);
+}
+
 ASTNode* AllocAndInitASTExprBinOp(const Token* op, ASTNode* left,
                                   ASTNode* right) {
   ASTExprBinOp* node = AllocASTExprBinOp();
   node->op = op;
-  node->left = left;
-  node->right = right;
+  node->left = GetASTHandle(left);
+  node->right = GetASTHandle(right);
   return ToASTNode(node);
 }
 
-ASTILOp* AllocAndInitASTILOp(ILOpType op, int dst_reg, int left_reg,
-                             int right_reg, ASTNode* ast_node) {
-  ASTILOp* node = AllocASTILOp();
-  node->op = op;
-  node->dst_reg = dst_reg;
-  node->left_reg = left_reg;
-  node->right_reg = right_reg;
-  node->ast_node = ast_node;
-  return node;
+ASTNode* AllocAndInitASTCondExpr(ASTNode* cond_expr, ASTNode* true_expr,
+                                 ASTNode* false_expr) {
+  ASTCondExpr* node = AllocASTCondExpr();
+  node->cond_expr = GetASTHandle(cond_expr);
+  node->true_expr = GetASTHandle(true_expr);
+  node->false_expr = GetASTHandle(false_expr);
+  return ToASTNode(node);
 }
 
-const char* GetIdentStrFromDirectDecltor(ASTDirectDecltor* direct_decltor) {
+static const Token* GetIdentTokenFromDirectDecltor(
+    ASTDirectDecltor* direct_decltor) {
   if (!direct_decltor) return NULL;
   if (direct_decltor->direct_decltor)
-    return GetIdentStrFromDirectDecltor(direct_decltor->direct_decltor);
-  ASTIdent* ident = ToASTIdent(direct_decltor->data);
+    return GetIdentTokenFromDirectDecltor(
+        ToASTDirectDecltor(GetASTNode(direct_decltor->direct_decltor)));
+  ASTIdent* ident = ToASTIdent(GetASTNode(direct_decltor->data));
   if (!ident) return NULL;
-  return ident->token->str;
+  return ident->token;
+}
+
+const char* GetIdentStrFromDirectDecltor(ASTDirectDecltor* direct_decltor) {
+  const Token* token = GetIdentTokenFromDirectDecltor(direct_decltor);
+  return token ? GetTokenStr(token) : NULL;
 }
 
 const char* GetIdentStrFromDecltor(ASTDecltor* decltor) {
   if (!decltor) return NULL;
-  return GetIdentStrFromDirectDecltor(decltor->direct_decltor);
+  return GetIdentStrFromDirectDecltor(
+      ToASTDirectDecltor(GetASTNode(decltor->direct_decltor)));
+}
+
+const Token* GetIdentTokenFromDecltor(ASTDecltor* decltor) {
+  if (!decltor) return NULL;
+  return GetIdentTokenFromDirectDecltor(
+      ToASTDirectDecltor(GetASTNode(decltor->direct_decltor)));
+}
+
+const Token* GetFuncNameTokenFromFuncDef(ASTFuncDef* func_def) {
+  if (!func_def) return NULL;
+  return GetIdentTokenFromDecltor(ToASTDecltor(GetASTNode(func_def->decltor)));
 }
 
 const char* GetFuncNameStrFromFuncDef(ASTFuncDef* func_def) {
   if (!func_def) return NULL;
-  return GetIdentStrFromDecltor(func_def->decltor);
+  return GetIdentStrFromDecltor(ToASTDecltor(GetASTNode(func_def->decltor)));
 }
 
 void PrintASTNodePadding(int depth) {
@@ -185,7 +384,7 @@ void PrintASTNode(ASTNode* node, int depth) {
     putchar('[');
     for (int i = 0; i < list->size; i++) {
       PrintASTNodePadding(depth + 1);
-      PrintASTNode(list->nodes[i], depth + 1);
+      PrintASTNode(GetASTNodeAt(list, i), depth + 1);
     }
     PrintASTNodePadding(depth);
     putchar(']');
@@ -198,73 +397,96 @@ void PrintASTNode(ASTNode* node, int depth) {
   }
   if (node->type == kASTFuncDecl) {
     ASTFuncDecl* func_decl = ToASTFuncDecl(node);
-    PrintASTNodeWithName(depth + 1, "type_and_name=", func_decl->type_and_name);
-    PrintASTNodeWithName(depth + 1,
-                         "arg_list=", ToASTNode(func_decl->arg_list));
+    PrintASTNodeWithName(depth + 1, "type_and_name=",
+                         GetASTNode(func_decl->type_and_name));
+    PrintASTNodeWithName(depth + 1, "arg_list=",
+                         GetASTNode(func_decl->arg_list));
   } else if (node->type == kASTFuncDef) {
     ASTFuncDef* func_def = ToASTFuncDef(node);
-    PrintASTNodeWithName(depth + 1,
-                         "decl_specs=", ToASTNode(func_def->decl_specs));
-    PrintASTNodeWithName(depth + 1, "decltor=", ToASTNode(func_def->decltor));
-    PrintASTNodeWithName(depth + 1,
-                         "comp_stmt=", ToASTNode(func_def->comp_stmt));
+    PrintASTNodeWithName(depth + 1, "decl_specs=",
+                         GetASTNode(func_def->decl_specs));
+    PrintASTNodeWithName(depth + 1, "decltor=", GetASTNode(func_def->decltor));
+    PrintASTNodeWithName(depth + 1, "comp_stmt=",
+                         GetASTNode(func_def->comp_stmt));
   } else if (node->type == kASTCompStmt) {
     ASTCompStmt* comp_stmt = ToASTCompStmt(node);
-    PrintASTNodeWithName(depth + 1, "body=", ToASTNode(comp_stmt->stmt_list));
+    PrintASTNodeWithName(depth + 1, "body=", GetASTNode(comp_stmt->stmt_list));
+  } else if (node->type == kASTExprUnaryPreOp) {
+    ASTExprUnaryPreOp* expr_unary_op = ToASTExprUnaryPreOp(node);
+    PrintTokenWithName(depth + 1, "op=", expr_unary_op->op);
+    PrintASTNodeWithName(depth + 1, "expr=", GetASTNode(expr_unary_op->expr));
+  } else if (node->type == kASTExprUnaryPostOp) {
+    ASTExprUnaryPostOp* expr_unary_op = ToASTExprUnaryPostOp(node);
+    PrintTokenWithName(depth + 1, "op=", expr_unary_op->op);
+    PrintASTNodeWithName(depth + 1, "expr=", GetASTNode(expr_unary_op->expr));
   } else if (node->type == kASTExprBinOp) {
     ASTExprBinOp* expr_bin_op = ToASTExprBinOp(node);
     PrintTokenWithName(depth + 1, "op=", expr_bin_op->op);
-    PrintASTNodeWithName(depth + 1, "left=", expr_bin_op->left);
-    PrintASTNodeWithName(depth + 1, "right=", expr_bin_op->right);
+    PrintASTNodeWithName(depth + 1, "left=", GetASTNode(expr_bin_op->left));
+    PrintASTNodeWithName(depth + 1, "right=", GetASTNode(expr_bin_op->right));
+  } else if (node->type == kASTCondExpr) {
+    ASTCondExpr* cond_expr = ToASTCondExpr(node);
+    PrintASTNodeWithName(depth + 1, "cond_expr=",
+                         GetASTNode(cond_expr->cond_expr));
+    PrintASTNodeWithName(depth + 1, "true_expr=",
+                         GetASTNode(cond_expr->true_expr));
+    PrintASTNodeWithName(depth + 1, "false_expr=",
+                         GetASTNode(cond_expr->false_expr));
   } else if (node->type == kASTConstant) {
     ASTConstant* constant = ToASTConstant(node);
     PrintTokenWithName(depth + 1, "token=", constant->token);
   } else if (node->type == kASTExprStmt) {
     ASTExprStmt* expr_stmt = ToASTExprStmt(node);
-    PrintASTNodeWithName(depth + 1, "expression=", expr_stmt->expr);
+    PrintASTNodeWithName(depth + 1, "expression=", GetASTNode(expr_stmt->expr));
   } else if (node->type == kASTJumpStmt) {
     ASTJumpStmt* jump_stmt = ToASTJumpStmt(node);
-    PrintASTNodeWithName(depth + 1, "kw=", ToASTNode(jump_stmt->kw));
-    PrintASTNodeWithName(depth + 1, "param=", jump_stmt->param);
+    PrintASTNodeWithName(depth + 1, "kw=", GetASTNode(jump_stmt->kw));
+    PrintASTNodeWithName(depth + 1, "param=", GetASTNode(jump_stmt->param));
   } else if (node->type == kASTForStmt) {
     ASTForStmt* for_stmt = ToASTForStmt(node);
-    PrintASTNodeWithName(depth + 1, "init_expr=", for_stmt->init_expr);
-    PrintASTNodeWithName(depth + 1, "cond_expr=", for_stmt->cond_expr);
-    PrintASTNodeWithName(depth + 1, "updt_expr=", for_stmt->updt_expr);
-    PrintASTNodeWithName(depth + 1,
-                         "body_comp_stmt=", for_stmt->body_comp_stmt);
-  } else if (node->type == kASTILOp) {
-    ASTILOp* il_op = ToASTILOp(node);
-    PrintfWithPadding(depth + 1, "op=%s", GetILOpTypeName(il_op->op));
-    PrintfWithPadding(depth + 1, "dst=%d", il_op->dst_reg);
-    PrintfWithPadding(depth + 1, "left=%d", il_op->left_reg);
-    PrintfWithPadding(depth + 1, "right=%d", il_op->right_reg);
-    // PrintASTNodeWithName(depth + 1, "ast_node=", il_op->ast_node);
+    PrintASTNodeWithName(depth + 1, "init_expr=",
+                         GetASTNode(for_stmt->init_expr));
+    PrintASTNodeWithName(depth + 1, "cond_expr=",
+                         GetASTNode(for_stmt->cond_expr));
+    PrintASTNodeWithName(depth + 1, "updt_expr=",
+                         GetASTNode(for_stmt->updt_expr));
+    PrintASTNodeWithName(depth + 1, "body_stmt=",
+                         GetASTNode(for_stmt->body_stmt));
+  } else if (node->type == kASTIfStmt) {
+    ASTIfStmt* if_stmt = ToASTIfStmt(node);
+    PrintASTNodeWithName(depth + 1, "cond_expr=",
+                         GetASTNode(if_stmt->cond_expr));
+    PrintASTNodeWithName(depth + 1, "true_stmt=",
+                         GetASTNode(if_stmt->true_stmt));
+    PrintASTNodeWithName(depth + 1, "false_stmt=",
+                         GetASTNode(if_stmt->false_stmt));
   } else if (node->type == kASTKeyword) {
     ASTKeyword* kw = ToASTKeyword(node);
     PrintTokenWithName(depth + 1, "token=", kw->token);
   } else if (node->type == kASTDecltor) {
     ASTDecltor* decltor = ToASTDecltor(node);
-    PrintASTNodeWithName(depth + 1,
-                         "direct_decltor=", ToASTNode(decltor->direct_decltor));
+    PrintASTNodeWithName(depth + 1, "direct_decltor=",
+                         GetASTNode(decltor->direct_decltor));
   } else if (node->type == kASTDirectDecltor) {
     ASTDirectDecltor* direct_decltor = ToASTDirectDecltor(node);
     PrintASTNodeWithName(depth + 1, "direct_decltor=",
-                         ToASTNode(direct_decltor->direct_decltor));
-    PrintASTNodeWithName(depth + 1, "data=", direct_decltor->data);
+                         GetASTNode(direct_decltor->direct_decltor));
+    PrintASTNodeWithName(depth + 1, "data=", GetASTNode(direct_decltor->data));
   } else if (node->type == kASTIdent) {
     ASTIdent* ident = ToASTIdent(node);
     PrintTokenWithName(depth + 1, "token=", ident->token);
   } else if (node->type == kASTDecl) {
     ASTDecl* decl = ToASTDecl(node);
-    PrintASTNodeWithName(depth + 1, "decl_specs=", ToASTNode(decl->decl_specs));
-    PrintASTNodeWithName(depth + 1,
-                         "init_decltors=", ToASTNode(decl->init_decltors));
+    PrintASTNodeWithName(depth + 1, "decl_specs=",
+                         GetASTNode(decl->decl_specs));
+    PrintASTNodeWithName(depth + 1, "init_decltors=",
+                         GetASTNode(decl->init_decltors));
   } else if (node->type == kASTParamDecl) {
     ASTParamDecl* param_decl = ToASTParamDecl(node);
-    PrintASTNodeWithName(depth + 1,
-                         "decl_specs=", ToASTNode(param_decl->decl_specs));
-    PrintASTNodeWithName(depth + 1, "decltor=", ToASTNode(param_decl->decltor));
+    PrintASTNodeWithName(depth + 1, "decl_specs=",
+                         GetASTNode(param_decl->decl_specs));
+    PrintASTNodeWithName(depth + 1, "decltor=",
+                         GetASTNode(param_decl->decltor));
   } else {
     Error("PrintASTNode not implemented for type %d (%s)", node->type,
           GetASTTypeName(node));
@@ -274,23 +496,34 @@ void PrintASTNode(ASTNode* node, int depth) {
 
 void PushASTNodeToList(ASTList* list, ASTNode* node) {
   if (list->size >= list->capacity) {
-    Error("No more space in ASTList");
+    unsigned int extra = AllocASTExtra(list->capacity * 2);
+    memcpy(&ast_extra[extra], GetASTListElements(list),
+           sizeof(ASTHandle) * list->size);
+    list->extra = extra;
+    list->capacity *= 2;
   }
-  list->nodes[list->size++] = node;
+  GetASTListElements(list)[list->size++] = GetASTHandle(node);
 }
 
 ASTNode* PopASTNodeFromList(ASTList* list) {
   if (list->size <= 0) {
     Error("Trying to pop empty ASTList");
   }
-  return list->nodes[--list->size];
+  return GetASTNode(GetASTListElements(list)[--list->size]);
 }
 
 ASTNode* GetASTNodeAt(const ASTList* list, int index) {
   if (index < 0 || list->size <= index) {
     Error("ASTList: Trying to read index out of bound");
   }
-  return list->nodes[index];
+  return GetASTNode(GetASTListElements(list)[index]);
+}
+
+void SetASTNodeAt(ASTList* list, int index, ASTNode* node) {
+  if (index < 0 || list->size <= index) {
+    Error("ASTList: Trying to write index out of bound");
+  }
+  GetASTListElements(list)[index] = GetASTHandle(node);
 }
 
 int GetSizeOfASTList(const ASTList* list) { return list->size; }
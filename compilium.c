@@ -2,46 +2,89 @@
 
 KernelType kernel_type = kKernelDarwin;
 
-#define MAX_TOKENS 2048
+#define USAGE "Usage: %s [options] <src_c_file> <dst_S_file> (<kernel_type>)"
+#define MAX_POSITIONAL_ARGS 3
 int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    Error("Usage: %s <src_c_file> <dst_S_file> (<kernel_type>)", argv[0]);
+  const char *args[MAX_POSITIONAL_ARGS] = {NULL};
+  int num_of_args = 0;
+  int stream_tokens = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stream-tokens") == 0) {
+      stream_tokens = 1;
+    } else if (strncmp(argv[i], "--parse-jobs=", 13) == 0) {
+      SetNumOfParseJobs(atoi(&argv[i][13]));
+    } else if (strncmp(argv[i], "--token-cache=", 14) == 0) {
+      SetTokenCacheDir(&argv[i][14]);
+    } else if (strncmp(argv[i], "-I", 2) == 0) {
+      // -I<dir> or -I <dir>
+      if (argv[i][2]) {
+        AddIncludePath(&argv[i][2]);
+      } else if (i + 1 < argc) {
+        AddIncludePath(argv[++i]);
+      } else {
+        Error("-I expects a directory");
+      }
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      Error("Unknown option %s", argv[i]);
+    } else if (num_of_args < MAX_POSITIONAL_ARGS) {
+      args[num_of_args++] = argv[i];
+    } else {
+      Error(USAGE, argv[0]);
+    }
   }
-  if (argc >= 4) {
-    if (strcmp(argv[3], "Darwin") == 0)
+  if (num_of_args < 2) {
+    Error(USAGE, argv[0]);
+  }
+  if (num_of_args >= 3) {
+    if (strcmp(args[2], "Darwin") == 0)
       kernel_type = kKernelDarwin;
-    else if (strcmp(argv[3], "Linux") == 0)
+    else if (strcmp(args[2], "Linux") == 0)
       kernel_type = kKernelLinux;
     else
-      Error("Unknown kernel type %s", argv[3]);
+      Error("Unknown kernel type %s", args[2]);
   }
 
+  InitScanner();
+  InitSymbols();
   InitASTTypeName();
   InitILOpTypeName();
 
-  const char *filename = argv[1];
-  char *input = ReadFile(filename);
-  TokenList *tokens = AllocateTokenList(MAX_TOKENS);
-  Tokenize(tokens, input, argv[1]);
-  free(input);
+  const char *filename = args[0];
+  int input_size;
+  const char *input = ReadFile(filename, &input_size);
+  const SourceBuffer *buffer = AddSourceBuffer(filename, input, input_size);
+  TokenList *tokens;
+  if (stream_tokens) {
+    // Tokens are lexed and preprocessed while parsing.
+    tokens = AllocateTokenStream(buffer);
+  } else {
+    tokens = AllocateTokenList();
+    Preprocess(tokens, buffer);
 
-  puts("\nTokens:");
-  PrintTokenList(tokens);
-  putchar('\n');
+    puts("\nTokens:");
+    PrintTokenList(tokens);
+    putchar('\n');
+  }
 
   ASTNode *ast = Parse(tokens);
+  if (stream_tokens) {
+    printf("\nToken window capacity: %d\n", GetTokenWindowCapacity(tokens));
+  }
 
   puts("\nAST:");
   PrintASTNode(ast, 0);
   putchar('\n');
 
   puts("\nCode generation:");
-  FILE *dst_fp = fopen(argv[2], "wb");
+  FILE *dst_fp = fopen(args[1], "wb");
   if (!dst_fp) {
-    Error("Failed to open %s", argv[2]);
+    Error("Failed to open %s", args[1]);
   }
   Generate(dst_fp, ast);
   fclose(dst_fp);
 
+  // The AST and IL are per translation unit.
+  ResetAST();
+
   return 0;
 }
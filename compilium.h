@@ -3,27 +3,140 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_TOKEN_LEN 64
-#define MAX_INPUT_SIZE 8192
-
 typedef enum {
   kIdentifier,
   kStringLiteral,
   kCharacterLiteral,
   kInteger,
   kPunctuator,
+  kHeaderName,  // <...> in #include
 } TokenType;
 
+// Symbols of keywords and punctuators are fixed.
+// The tokenizer assigns them directly, so they also serve as token kinds.
+typedef enum {
+  kSymNone,
+  // keywords
+  kSymAuto,
+  kSymBreak,
+  kSymCase,
+  kSymChar,
+  kSymConst,
+  kSymContinue,
+  kSymDefault,
+  kSymDo,
+  kSymDouble,
+  kSymElse,
+  kSymEnum,
+  kSymExtern,
+  kSymFloat,
+  kSymFor,
+  kSymGoto,
+  kSymIf,
+  kSymInline,
+  kSymInt,
+  kSymLong,
+  kSymRegister,
+  kSymRestrict,
+  kSymReturn,
+  kSymShort,
+  kSymSigned,
+  kSymSizeof,
+  kSymStatic,
+  kSymStruct,
+  kSymSwitch,
+  kSymTypedef,
+  kSymUnion,
+  kSymUnsigned,
+  kSymVoid,
+  kSymVolatile,
+  kSymWhile,
+  kSymBool,
+  kSymComplex,
+  kSymImaginary,
+  // punctuators
+  kSymLBracket,
+  kSymRBracket,
+  kSymLParen,
+  kSymRParen,
+  kSymLBrace,
+  kSymRBrace,
+  kSymTilde,
+  kSymQuestion,
+  kSymColon,
+  kSymSemicolon,
+  kSymComma,
+  kSymPercent,
+  kSymModAssign,
+  kSymBackslash,
+  kSymOr,
+  kSymLogicalOr,
+  kSymOrAssign,
+  kSymAnd,
+  kSymLogicalAnd,
+  kSymAndAssign,
+  kSymPlus,
+  kSymInc,
+  kSymAddAssign,
+  kSymSlash,
+  kSymDoubleSlash,
+  kSymDivAssign,
+  kSymMinus,
+  kSymDec,
+  kSymSubAssign,
+  kSymArrow,
+  kSymAssign,
+  kSymEq,
+  kSymNot,
+  kSymNotEq,
+  kSymStar,
+  kSymMulAssign,
+  kSymLt,
+  kSymShl,
+  kSymLtEq,
+  kSymShlAssign,
+  kSymGt,
+  kSymShr,
+  kSymGtEq,
+  kSymShrAssign,
+  kSymXor,
+  kSymXorAssign,
+  kSymDot,
+  kSymEllipsis,
+  kSymHash,
+  kSymHashHash,
+  kSymEndOfDirective,  // empty token at the end of a directive line
+  // preprocessor directives
+  kSymInclude,
+  kSymDefine,
+  kSymUndef,
+  kSymIfdef,
+  kSymIfndef,
+  kSymElif,
+  kSymEndif,
+  kSymError,
+  kSymLine,
+  kSymPragma,
+  kSymOnce,
+  kSymDefined,
+  kSymVaArgs,
+  //
+  kNumOfPredefinedSymbols
+} PredefinedSymbol;
+
 typedef enum {
   kASTFuncDecl,
   kASTFuncDef,
   kASTCompStmt,
+  kASTExprUnaryPreOp,
+  kASTExprUnaryPostOp,
   kASTExprBinOp,
+  kASTCondExpr,
   kASTConstant,
   kASTExprStmt,
   kASTJumpStmt,
   kASTForStmt,
-  kASTILOp,
+  kASTIfStmt,
   kASTList,
   kASTKeyword,
   kASTDecltor,
@@ -41,12 +154,22 @@ typedef enum {
   kILOpAdd,
   kILOpSub,
   kILOpMul,
+  kILOpEq,
+  kILOpNotEq,
+  kILOpLt,
+  kILOpLtEq,
   kILOpLoadImm,
-  kILOpLoadIdent,
-  kILOpFuncBegin,
-  kILOpFuncEnd,
-  kILOpReturn,
+  kILOpLoadAddr,
+  kILOpLoadVar,
+  kILOpStoreVar,
   kILOpCall,
+  kILOpPhi,
+  kILOpCopy,
+  kILOpCast,
+  // terminators
+  kILOpJump,
+  kILOpBranch,
+  kILOpReturn,
   //
   kNumOfILOpFunc
 } ILOpType;
@@ -58,14 +181,93 @@ typedef enum {
 
 typedef struct TOKEN_LIST TokenList;
 typedef struct AST_LIST ASTList;
+typedef struct SCOPE_TABLE ScopeTable;
+
+typedef enum {
+  kTypeVoid,
+  kTypeChar,
+  kTypeShort,
+  kTypeInt,
+  kTypeLong,
+  kTypeLongLong,
+  kTypePointer,
+  kTypeArray,
+  kTypeFunc,
+} TypeKind;
+
+// Types are canonical: they are only made by the Get*Type() functions of
+// type.c, which build each distinct type once, so two types are the same
+// exactly when they are the same pointer.
+typedef struct TYPE Type;
+struct TYPE {
+  TypeKind kind;
+  int is_unsigned;
+  int is_const;
+  int size;   // in bytes; 0 if incomplete
+  int align;  // in bytes
+  const Type *base;  // pointer: pointee, array: element, func: return type
+  int length;        // array: number of elements, -1 if unknown
+  const Type **params;  // func
+  int num_of_params;
+  int is_variadic;
+  unsigned int hash;
+};
+
+typedef enum {
+  kVarGlobal,
+  kVarParam,
+  kVarLocal,
+} VarKind;
+
+typedef struct {
+  VarKind kind;
+  int offset;       // param and local: from rbp downwards
+  int declared_at;  // token index of the declaration
+  const Type *type;
+} Var;
+
+typedef struct ARENA_CHUNK ArenaChunk;
+typedef struct {
+  ArenaChunk *chunk;  // current chunk, linked to the previous ones
+  size_t used;        // bytes used in chunk
+  ArenaChunk *free_chunks;
+} Arena;
+
+typedef unsigned int SourceLocation;  // 0: unknown
 
 typedef struct {
-  char str[MAX_TOKEN_LEN + 1];
-  TokenType type;
   const char *filename;
-  int line;
+  const char *begin;  // NUL-terminated
+  int size;
+  SourceLocation loc;  // location of begin[0]
+  int *line_begins;    // offsets of lines, built on demand
+  int num_of_lines;
+} SourceBuffer;
+
+typedef struct {
+  const char *begin;  // points into the source buffer (not NUL-terminated)
+  int length;
+  int sym;  // interned symbol id (kSymNone for literals)
+  TokenType type;
+  SourceLocation loc;
 } Token;
 
+// AST nodes live in one contiguous array of fixed-size slots and refer to
+// their children by 32-bit handles (indices into the array). ASTNode
+// pointers stay valid, so nodes are still read through the typed structs
+// below: GetASTNode() turns a child handle into a node.
+typedef unsigned int ASTHandle;  // 0: no node
+
+typedef struct {
+  unsigned int next;
+  unsigned int end;
+} ASTRange;
+
+typedef struct {
+  ASTRange nodes;
+  ASTRange extra;
+} ASTCheckpoint;
+
 typedef struct {
   ASTType type;
 } ASTNode;
@@ -77,119 +279,266 @@ typedef struct {
 
 typedef struct {
   ASTType type;
-  ASTList *root_list;
-} ASTRoot;
+  ASTHandle type_and_name;
+  ASTHandle arg_list;
+} ASTFuncDecl;
 
 typedef struct {
   ASTType type;
-  ASTNode *type_and_name;
-  ASTList *arg_list;
-} ASTFuncDecl;
+  ASTHandle stmt_list;
+} ASTCompStmt;
 
 typedef struct {
   ASTType type;
-  ASTList *stmt_list;
-} ASTCompStmt;
+  const Token *op;
+  ASTHandle expr;
+} ASTExprUnaryPreOp;
 
 typedef struct {
   ASTType type;
   const Token *op;
-  ASTNode *left;
-  ASTNode *right;
+  ASTHandle expr;
+} ASTExprUnaryPostOp;
+
+typedef struct {
+  ASTType type;
+  const Token *op;
+  ASTHandle left;
+  ASTHandle right;
 } ASTExprBinOp;
 
 typedef struct {
   ASTType type;
-  const Token *token;
+  ASTHandle cond_expr;
+  ASTHandle true_expr;
+  ASTHandle false_expr;
+} ASTCondExpr;
+
+typedef struct {
+  ASTType type;
+  unsigned char size;  // of the type of an integer constant: 4 or 8
+  unsigned char is_unsigned;
+  const Token *token;  // the literal, or the operator of a folded expression
+  long long value;     // integer and character constants
 } ASTConstant;
 
 typedef struct {
   ASTType type;
-  ASTNode *expr;
+  ASTHandle expr;
 } ASTExprStmt;
 
 typedef struct {
   ASTType type;
-  ASTKeyword *kw;
-  ASTNode *param;
+  ASTHandle kw;
+  ASTHandle param;
 } ASTJumpStmt;
 
 typedef struct {
   ASTType type;
-  ASTNode *init_expr;
-  ASTNode *cond_expr;
-  ASTNode *updt_expr;
-  ASTNode *body_comp_stmt;
+  ASTHandle init_expr;
+  ASTHandle cond_expr;
+  ASTHandle updt_expr;
+  ASTHandle body_stmt;
 } ASTForStmt;
 
 typedef struct {
   ASTType type;
-  ILOpType op;
-  int dst_reg;  // 0: unused
-  int left_reg;  // 0: unused
-  int right_reg;  // 0: unused
-  ASTNode *ast_node;
-} ASTILOp;
+  ASTHandle cond_expr;
+  ASTHandle true_stmt;
+  ASTHandle false_stmt;
+} ASTIfStmt;
 
 typedef struct {
   ASTType type;
   const Token *token;
+  const Var *var;  // in an expression; NULL if it is not declared
 } ASTIdent;
 
-typedef struct AST_DIRECT_DECLTOR ASTDirectDecltor;
-struct AST_DIRECT_DECLTOR {
+typedef struct {
   ASTType type;
-  ASTDirectDecltor *direct_decltor;
-  ASTNode *data;
-};
+  ASTHandle direct_decltor;
+  ASTHandle data;
+} ASTDirectDecltor;
 
 typedef struct {
   ASTType type;
-  ASTList *decl_specs;
-  ASTList *init_decltors;
-  ;
+  ASTHandle decl_specs;
+  ASTHandle init_decltors;
 } ASTDecl;
 
 typedef struct {
   ASTType type;
-  ASTList *decl_specs;
-  ASTNode *decltor;
+  ASTHandle decl_specs;
+  ASTHandle decltor;
 } ASTParamDecl;
 
-typedef struct AST_POINTER ASTPointer;
-struct AST_POINTER {
+typedef struct {
   ASTType type;
-  ASTPointer *pointer;
-};
+  ASTHandle pointer;
+} ASTPointer;
 
 typedef struct {
   ASTType type;
-  ASTPointer *pointer;
-  ASTDirectDecltor *direct_decltor;
+  ASTHandle pointer;
+  ASTHandle direct_decltor;
 } ASTDecltor;
 
 typedef struct {
   ASTType type;
-  ASTList *decl_specs;
-  ASTDecltor *decltor;
-  ASTCompStmt *comp_stmt;
+  ASTHandle decl_specs;
+  ASTHandle decltor;
+  ASTHandle comp_stmt;
+  int num_of_params;
+  int frame_size;  // params first, then locals
 } ASTFuncDef;
 
+// IL: three-address code in basic blocks.
+// A function is an array of blocks, and a block is an array of instructions
+// that ends with exactly one terminator (Jump, Branch or Return). The edges
+// of the control-flow graph are kept at both ends: in succs of the block
+// that jumps and in preds of its target. Values live in virtual registers,
+// numbered from 1.
+typedef enum {
+  kILOperandNone,
+  kILOperandReg,   // virtual register
+  kILOperandImm,   // integer
+  kILOperandVar,   // param or local
+  kILOperandSym,   // global or function, by name
+  kILOperandStr,   // string literal
+  kILOperandList,  // operands[begin, begin + count) of the function
+  kILOperandType,  // the type a value is converted to
+} ILOperandKind;
+
+typedef struct {
+  ILOperandKind kind;
+  union {
+    int reg;
+    long long imm;
+    const Var *var;
+    const Token *token;  // sym and str
+    const Type *type;
+    struct {
+      int begin;
+      int count;
+    } list;
+  };
+} ILOperand;
+
+// Phi: left is the list of incoming values in the order of preds, and right
+// is the variable it merges. Cast: left is converted to the type of right,
+// as if it were stored to and loaded from a variable of the type.
+// Arithmetic and compares: type is the one the operands are converted to,
+// which sets the width and the signedness of the operation. Values are kept
+// widened to 64 bits as their types are, so a 32-bit result is extended.
+typedef struct {
+  ILOpType op;
+  int dst;  // virtual register, 0: none
+  ILOperand left;
+  ILOperand right;
+  const Type *type;  // int, unsigned int, long or unsigned long
+} ILInstr;
+
+typedef struct {
+  ILInstr *instrs;
+  int num_of_instrs;
+  int instrs_capacity;
+  int succs[2];  // Branch: taken if left is not 0, otherwise
+  int num_of_succs;
+  int *preds;
+  int num_of_preds;
+  int preds_capacity;
+  int idom;  // immediate dominator; -1 for the entry
+} ILBlock;
+
+typedef struct {
+  ASTFuncDef *func_def;
+  ILBlock *blocks;  // blocks[0] is the entry
+  int num_of_blocks;
+  int blocks_capacity;
+  ILOperand *operands;  // elements of list operands
+  int num_of_operands;
+  int operands_capacity;
+  int num_of_regs;  // including the unused register 0
+} ILFunc;
+
+// Instructions are numbered in the order of blocks and instructions, from 0.
+typedef struct {
+  int start;  // the first def or use, -1: the register is unused
+  int end;    // the last use, or the last def if it is never used
+} ILInterval;
+
+typedef struct {
+  int num_of_words;             // of a bitset
+  unsigned long long *live_in;  // a bitset of registers per block
+  unsigned long long *live_out;
+  int *block_begin;       // position of the first instruction, and the end
+  ILInterval *intervals;  // by register
+} ILLiveness;
+
+// x86_64 general purpose registers that hold values. The code generator
+// keeps rax to itself.
+typedef enum {
+  kRealRegNone,
+  kRealRegRax,
+  kRealRegRdi,
+  kRealRegRsi,
+  kRealRegRdx,
+  kRealRegRcx,
+  kRealRegR8,
+  kRealRegR9,
+  kRealRegR10,
+  kRealRegR11,
+  // callee-saved
+  kRealRegRbx,
+  kRealRegR12,
+  kRealRegR13,
+  kRealRegR14,
+  kRealRegR15,
+  kNumOfRealRegs,
+} RealReg;
+
+typedef struct {
+  RealReg real_reg;  // kRealRegNone: in the stack slot
+  int offset;        // of the stack slot, from rbp downwards
+} RegLocation;
+
+typedef struct {
+  RegLocation *locations;  // by virtual register
+  int frame_size;          // params, locals, spill slots and saved registers
+  int saved_offsets[kNumOfRealRegs];  // of callee-saved registers, 0: unused
+} RegAllocation;
+
+// @arena.c
+extern Arena token_arena;
+extern Arena il_arena;
+void *AllocFromArena(Arena *arena, size_t size);
+void *ReallocFromArena(Arena *arena, void *p, size_t old_size, size_t size);
+void ResetArena(Arena *arena);
+
 // @ast.c
 void InitASTTypeName();
 const char *GetASTTypeName(ASTNode *node);
 
+ASTNode *GetASTNode(ASTHandle handle);
+ASTHandle GetASTHandle(const void *node);
+ASTCheckpoint GetASTCheckpoint();
+void RollbackAST(ASTCheckpoint checkpoint);
+void ResetAST();
+
 ASTNode *ToASTNode(void *node);
 #define DefToAST(type) AST##type *ToAST##type(ASTNode *node)
 DefToAST(FuncDecl);
 DefToAST(FuncDef);
 DefToAST(CompStmt);
+DefToAST(ExprUnaryPreOp);
+DefToAST(ExprUnaryPostOp);
 DefToAST(ExprBinOp);
+DefToAST(CondExpr);
 DefToAST(Constant);
 DefToAST(ExprStmt);
 DefToAST(JumpStmt);
 DefToAST(ForStmt);
-DefToAST(ILOp);
+DefToAST(IfStmt);
 DefToAST(List);
 DefToAST(Keyword);
 DefToAST(Decltor);
@@ -203,13 +552,16 @@ DefToAST(Pointer);
 DefAllocAST(FuncDecl);
 DefAllocAST(FuncDef);
 DefAllocAST(CompStmt);
+DefAllocAST(ExprUnaryPreOp);
+DefAllocAST(ExprUnaryPostOp);
 DefAllocAST(ExprBinOp);
+DefAllocAST(CondExpr);
 DefAllocAST(Constant);
 DefAllocAST(ExprStmt);
 DefAllocAST(JumpStmt);
 DefAllocAST(ForStmt);
-DefAllocAST(ILOp);
-ASTList *AllocASTList(int capacity);
+DefAllocAST(IfStmt);
+ASTList *AllocASTList();
 DefAllocAST(Keyword);
 DefAllocAST(Decltor);
 DefAllocAST(DirectDecltor);
@@ -221,20 +573,24 @@ DefAllocAST(Pointer);
 ASTNode *AllocAndInitASTConstant(const Token *token);
 ASTIdent *AllocAndInitASTIdent(const Token *token);
 ASTKeyword *AllocAndInitASTKeyword(const Token *token);
+ASTNode *AllocAndInitASTExprUnaryPreOp(const Token *op, ASTNode *expr);
+ASTNode *AllocAndInitASTExprUnaryPostOp(const Token *op, ASTNode *expr);
 ASTNode *AllocAndInitASTExprBinOp(const Token *op, ASTNode *left,
                                   ASTNode *right);
-
-ASTILOp *AllocAndInitASTILOp(ILOpType op, int dst_reg, int left_reg,
-                             int right_reg, ASTNode *ast_node);
+ASTNode *AllocAndInitASTCondExpr(ASTNode *cond_expr, ASTNode *true_expr,
+                                 ASTNode *false_expr);
 
 const char *GetIdentStrFromDecltor(ASTDecltor *decltor);
 const char *GetIdentStrFromDecltor(ASTDecltor *decltor);
+const Token *GetIdentTokenFromDecltor(ASTDecltor *decltor);
+const Token *GetFuncNameTokenFromFuncDef(ASTFuncDef *func_def);
 const char *GetFuncNameStrFromFuncDef(ASTFuncDef *func_def);
 
 void PrintASTNode(ASTNode *node, int depth);
 void PushASTNodeToList(ASTList *list, ASTNode *node);
 ASTNode *PopASTNodeFromList(ASTList *list);
 ASTNode *GetASTNodeAt(const ASTList *list, int index);
+void SetASTNodeAt(ASTList *list, int index, ASTNode *node);
 int GetSizeOfASTList(const ASTList *list);
 ASTNode *GetLastASTNode(const ASTList *list);
 
@@ -244,34 +600,133 @@ extern KernelType kernel_type;
 // @error.c
 void Error(const char *fmt, ...);
 
+// @fold.c
+void FoldConstants(ASTNode *root);
+
 // @generate.c
-void InitILOpTypeName();
-const char *GetILOpTypeName(ILOpType type);
 void Generate(FILE *fp, ASTNode *root);
 
+// @gvn.c
+void NumberValues(ILFunc *func);
+
 // @il.c
-ASTILOp *GenerateIL(ASTList *il, ASTNode *node);
+void InitILOpTypeName();
+const char *GetILOpTypeName(ILOpType type);
+int AddILBlock(ILFunc *func);
+ILInstr *InsertILInstr(ILFunc *func, int block_index, int index, ILOpType op,
+                       int dst);
+ILOperand AddILOperandList(ILFunc *func, const ILOperand *elements,
+                           int count);
+int SplitILEdge(ILFunc *func, int from, int succ_index);
+ILFunc *GenerateIL(ASTFuncDef *func_def);
+void PrintILFunc(const ILFunc *func);
+void FreeILFunc(ILFunc *func);
+
+// @liveness.c
+void RenumberILRegs(ILFunc *func);
+ILLiveness *AnalyzeLiveness(const ILFunc *func);
+int IsLiveOut(const ILLiveness *liveness, int block_index, int reg);
+void FreeILLiveness(ILLiveness *liveness);
 
 // @parser.c
+void SetNumOfParseJobs(int num);
 ASTNode *Parse(TokenList *tokens);
 
+// @preprocess.c
+void AddIncludePath(const char *path);
+void BeginPreprocess(const SourceBuffer *buffer);
+int PreprocessNext(TokenList *tokens);
+void Preprocess(TokenList *tokens, const SourceBuffer *buffer);
+
+// @regalloc.c
+RegAllocation *AllocateRegisters(const ILFunc *func,
+                                 const ILLiveness *liveness);
+void FreeRegAllocation(RegAllocation *allocation);
+
+// @scan.c
+void InitScanner();
+const char *SkipIdentChars(const char *p);
+const char *SkipDigits(const char *p);
+const char *SkipQuotedChars(const char *p, char quote);
+const char *SkipSpaces(const char *p);
+const char *SkipToNewline(const char *p);
+
+// @scope.c
+ScopeTable *AllocScopeTable();
+void PushScope(ScopeTable *table);
+void PopScope(ScopeTable *table);
+int DeclareVar(ScopeTable *table, int name, const Var *var);
+const Var *LookupVar(const ScopeTable *table, int name);
+
+// @source.c
+const SourceBuffer *AddSourceBuffer(const char *filename, const char *src,
+                                    int size);
+int GetSourcePosition(SourceLocation loc, const char **filename, int *line,
+                      int *column);
+const char *GetSourceLocationStr(SourceLocation loc);
+
+// @ssa.c
+void ConvertToSSA(ILFunc *func);
+void PropagateCopies(ILFunc *func);
+void EliminateDeadCode(ILFunc *func);
+void ConvertFromSSA(ILFunc *func);
+
+// @symbol.c
+void InitSymbols();
+int InternSymbol(const char *s, int len);
+const char *GetSymbolStr(int sym);
+int GetSymbolLen(int sym);
+
 // @token.c
 Token *AllocateToken(const char *s, TokenType type);
-Token *AllocateTokenWithSubstring(const char *begin, const char *end,
-                                  TokenType type, const char *filename,
-                                  int line);
-int IsEqualToken(const Token *token, const char *s);
+int LookupKeyword(const char *s, int len);
+const char *GetTokenStr(const Token *token);
+int GetCharacterLiteralValue(const Token *token);
+int IsEqualToken(const Token *token, int sym);
 int IsKeyword(const Token *token);
 int IsTypeToken(const Token *token);
 void SetNumOfTokens(int num_of_tokens);
 TokenList *AllocateTokenList();
+TokenList *AllocateTokenStream(const SourceBuffer *buffer);
 void AppendTokenToList(TokenList *list, const Token *token);
+void AppendTokenWithSubstring(TokenList *list, const char *begin,
+                              const char *end, TokenType type, int sym,
+                              SourceLocation loc);
+void UseTokenRecords(TokenList *list, Token *records, int *syms,
+                     unsigned char *types, int size);
 const Token *GetTokenAt(TokenList *list, int index);
+int GetTokenSymAt(TokenList *list, int index);
+int GetTokenTypeAt(TokenList *list, int index);
+int IsEqualTokenAt(TokenList *list, int index, int sym);
+void CommitTokens(TokenList *list, int index);
+const Token *RetainToken(TokenList *list, const Token *token);
+int GetTokenWindowCapacity(const TokenList *list);
 int GetSizeOfTokenList(const TokenList *list);
 void SetSizeOfTokenList(TokenList *list, int size);
 void PrintToken(const Token *token);
-void PrintTokenList(const TokenList *list);
+void PrintTokenList(TokenList *list);
+
+// @tokencache.c
+void SetTokenCacheDir(const char *dir);
+void TokenizeWithCache(TokenList *tokens, const SourceBuffer *buffer);
 
 // @tokenizer.c
-char *ReadFile(const char *file_name);
-void Tokenize(TokenList *tokens, const char *p, const char *filename);
+const char *ReadFile(const char *file_name, int *size);
+const char *CommonTokenizer(TokenList *tokens, const char *p,
+                            const SourceBuffer *buffer);
+const char *TokenizeNext(TokenList *tokens, const char *p,
+                         const SourceBuffer *buffer);
+void Tokenize(TokenList *tokens, const SourceBuffer *buffer);
+
+// @type.c
+const Type *GetVoidType();
+const Type *GetIntegerType(TypeKind kind, int is_unsigned);
+const Type *GetPointerType(const Type *base);
+const Type *GetArrayType(const Type *base, int length);
+const Type *GetFuncType(const Type *return_type, const Type **params,
+                        int num_of_params, int is_variadic);
+const Type *GetConstType(const Type *type);
+const Type *GetTypeOfDeclSpecs(ASTList *decl_specs);
+const Type *GetTypeOfDecltor(const Type *base, ASTDecltor *decltor);
+const Type *GetTypeOfParamDecl(ASTParamDecl *param_decl);
+const char *GetTypeStr(const Type *type);
@@ -0,0 +1,326 @@
+#include <limits.h>
+
+#include "compilium.h"
+
+// Constant folding.
+// Integer expressions whose operands are constants are evaluated on the AST
+// before IL generation, so each of them becomes a single LoadImm. Values are
+// computed in the type the operands are converted to (6.3.1.8) and wrap
+// around in that type. Operations that have no value to fold (division by
+// zero, shifts out of range) are left to run time. Identities with a
+// constant operand (x + 0, x - 0, x * 1, 1 * x) are reduced to the other
+// operand.
+
+static ASTConstant *ToIntegerConstant(ASTNode *node) {
+  ASTConstant *constant = ToASTConstant(node);
+  if (!constant || constant->token->type == kStringLiteral) return NULL;
+  return constant;
+}
+
+static long long WrapToType(unsigned long long value, int size,
+                            int is_unsigned) {
+  if (size == 8) return (long long)value;
+  if (is_unsigned) return (unsigned int)value;
+  return (int)(unsigned int)value;
+}
+
+static ASTHandle AllocFoldedConstant(const Token *token,
+                                     unsigned long long value, int size,
+                                     int is_unsigned) {
+  ASTConstant *constant = AllocASTConstant();
+  constant->token = token;
+  constant->size = size;
+  constant->is_unsigned = is_unsigned;
+  constant->value = WrapToType(value, size, is_unsigned);
+  return GetASTHandle(constant);
+}
+
+static int IsIntConstantOf(const ASTConstant *constant, long long value) {
+  // Only a plain int leaves the type of the other operand as it is.
+  return constant && constant->size == 4 && !constant->is_unsigned &&
+         constant->value == value;
+}
+
+static void GetCommonType(const ASTConstant *left, const ASTConstant *right,
+                          int *size, int *is_unsigned) {
+  // The usual arithmetic conversions. Constants are int or wider, so they
+  // are already promoted, and long can represent every unsigned int.
+  if (left->size != right->size) {
+    const ASTConstant *wider = left->size > right->size ? left : right;
+    *size = wider->size;
+    *is_unsigned = wider->is_unsigned;
+    return;
+  }
+  *size = left->size;
+  *is_unsigned = left->is_unsigned || right->is_unsigned;
+}
+
+static ASTHandle FoldShift(const Token *op, const ASTConstant *left,
+                           const ASTConstant *right) {
+  // The type of a shift is the type of its left operand.
+  if (right->value < 0 || left->size * 8 <= right->value) return 0;
+  unsigned long long value;
+  if (op->sym == kSymShl) {
+    value = (unsigned long long)left->value << right->value;
+  } else if (left->is_unsigned) {
+    value = (unsigned long long)left->value >> right->value;
+  } else {
+    value = left->value >> right->value;
+  }
+  return AllocFoldedConstant(op, value, left->size, left->is_unsigned);
+}
+
+static ASTHandle FoldIntegerBinOp(const Token *op, const ASTConstant *left,
+                                  const ASTConstant *right) {
+  // Returns 0 if the operation is not folded.
+  if (op->sym == kSymShl || op->sym == kSymShr) {
+    return FoldShift(op, left, right);
+  }
+  if (op->sym == kSymComma) return GetASTHandle(right);
+  int size, is_unsigned;
+  GetCommonType(left, right, &size, &is_unsigned);
+  unsigned long long l = WrapToType(left->value, size, is_unsigned);
+  unsigned long long r = WrapToType(right->value, size, is_unsigned);
+  long long sl = (long long)l;
+  long long sr = (long long)r;
+  unsigned long long value;
+  switch (op->sym) {
+    case kSymPlus:
+      value = l + r;
+      break;
+    case kSymMinus:
+      value = l - r;
+      break;
+    case kSymStar:
+      value = l * r;
+      break;
+    case kSymSlash:
+    case kSymPercent:
+      if (!r || (!is_unsigned && sl == LLONG_MIN && sr == -1)) return 0;
+      if (is_unsigned) {
+        value = op->sym == kSymSlash ? l / r : l % r;
+      } else {
+        value = op->sym == kSymSlash ? sl / sr : sl % sr;
+      }
+      break;
+    case kSymAnd:
+      value = l & r;
+      break;
+    case kSymOr:
+      value = l | r;
+      break;
+    case kSymXor:
+      value = l ^ r;
+      break;
+    case kSymLogicalAnd:
+      return AllocFoldedConstant(op, l && r, 4, 0);
+    case kSymLogicalOr:
+      return AllocFoldedConstant(op, l || r, 4, 0);
+    case kSymEq:
+      return AllocFoldedConstant(op, l == r, 4, 0);
+    case kSymNotEq:
+      return AllocFoldedConstant(op, l != r, 4, 0);
+    case kSymLt:
+      return AllocFoldedConstant(op, is_unsigned ? l < r : sl < sr, 4, 0);
+    case kSymGt:
+      return AllocFoldedConstant(op, is_unsigned ? l > r : sl > sr, 4, 0);
+    case kSymLtEq:
+      return AllocFoldedConstant(op, is_unsigned ? l <= r : sl <= sr, 4, 0);
+    case kSymGtEq:
+      return AllocFoldedConstant(op, is_unsigned ? l >= r : sl >= sr, 4, 0);
+    default:
+      return 0;
+  }
+  return AllocFoldedConstant(op, value, size, is_unsigned);
+}
+
+static int IsFoldableBinaryOp(int sym) {
+  switch (sym) {
+    case kSymComma:
+    case kSymLogicalOr:
+    case kSymLogicalAnd:
+    case kSymOr:
+    case kSymXor:
+    case kSymAnd:
+    case kSymEq:
+    case kSymNotEq:
+    case kSymLt:
+    case kSymGt:
+    case kSymLtEq:
+    case kSymGtEq:
+    case kSymShl:
+    case kSymShr:
+    case kSymPlus:
+    case kSymMinus:
+    case kSymStar:
+    case kSymSlash:
+    case kSymPercent:
+      return 1;
+  }
+  return 0;
+}
+
+static ASTHandle FoldExpr(ASTHandle handle);
+
+static ASTHandle FoldExprBinOp(ASTHandle handle) {
+  ASTExprBinOp *bin_op = ToASTExprBinOp(GetASTNode(handle));
+  const Token *op = bin_op->op;
+  switch (op->sym) {
+    case kSymLParen:
+      // function call: the args are in a list.
+      FoldExpr(bin_op->right);
+      return handle;
+    case kSymDot:
+    case kSymArrow:
+      bin_op->left = FoldExpr(bin_op->left);
+      return handle;
+    case kSymLBracket:
+      bin_op->left = FoldExpr(bin_op->left);
+      bin_op->right = FoldExpr(bin_op->right);
+      return handle;
+  }
+  if (!IsFoldableBinaryOp(op->sym)) {
+    // assignments: the left side is an lvalue.
+    bin_op->right = FoldExpr(bin_op->right);
+    return handle;
+  }
+  bin_op->left = FoldExpr(bin_op->left);
+  ASTConstant *left = ToIntegerConstant(GetASTNode(bin_op->left));
+  // 0 && x and 1 || x do not evaluate x.
+  if (left && ((op->sym == kSymLogicalAnd && !left->value) ||
+               (op->sym == kSymLogicalOr && left->value))) {
+    return AllocFoldedConstant(op, op->sym == kSymLogicalOr, 4, 0);
+  }
+  bin_op->right = FoldExpr(bin_op->right);
+  ASTConstant *right = ToIntegerConstant(GetASTNode(bin_op->right));
+  if (left && right) {
+    ASTHandle folded = FoldIntegerBinOp(op, left, right);
+    return folded ? folded : handle;
+  }
+  if (left && op->sym == kSymComma) return bin_op->right;
+  if ((op->sym == kSymPlus || op->sym == kSymMinus) &&
+      IsIntConstantOf(right, 0)) {
+    return bin_op->left;
+  }
+  if (op->sym == kSymPlus && IsIntConstantOf(left, 0)) return bin_op->right;
+  if (op->sym == kSymStar && IsIntConstantOf(right, 1)) return bin_op->left;
+  if (op->sym == kSymStar && IsIntConstantOf(left, 1)) return bin_op->right;
+  return handle;
+}
+
+static ASTHandle FoldExprUnaryPreOp(ASTHandle handle) {
+  ASTExprUnaryPreOp *pre_op = ToASTExprUnaryPreOp(GetASTNode(handle));
+  const Token *op = pre_op->op;
+  // The operands of ++, -- and & are lvalues, and sizeof is not evaluated.
+  if (op->sym != kSymPlus && op->sym != kSymMinus && op->sym != kSymTilde &&
+      op->sym != kSymNot) {
+    if (op->sym == kSymStar) pre_op->expr = FoldExpr(pre_op->expr);
+    return handle;
+  }
+  pre_op->expr = FoldExpr(pre_op->expr);
+  ASTConstant *operand = ToIntegerConstant(GetASTNode(pre_op->expr));
+  if (!operand) return handle;
+  unsigned long long value = operand->value;
+  switch (op->sym) {
+    case kSymPlus:
+      return pre_op->expr;
+    case kSymMinus:
+      value = -value;
+      break;
+    case kSymTilde:
+      value = ~value;
+      break;
+    case kSymNot:
+      return AllocFoldedConstant(op, !value, 4, 0);
+  }
+  return AllocFoldedConstant(op, value, operand->size, operand->is_unsigned);
+}
+
+static ASTHandle FoldCondExpr(ASTHandle handle) {
+  ASTCondExpr *cond_expr = ToASTCondExpr(GetASTNode(handle));
+  cond_expr->cond_expr = FoldExpr(cond_expr->cond_expr);
+  cond_expr->true_expr = FoldExpr(cond_expr->true_expr);
+  cond_expr->false_expr = FoldExpr(cond_expr->false_expr);
+  ASTConstant *cond = ToIntegerConstant(GetASTNode(cond_expr->cond_expr));
+  if (!cond) return handle;
+  ASTHandle chosen =
+      cond->value ? cond_expr->true_expr : cond_expr->false_expr;
+  ASTConstant *true_expr =
+      ToIntegerConstant(GetASTNode(cond_expr->true_expr));
+  ASTConstant *false_expr =
+      ToIntegerConstant(GetASTNode(cond_expr->false_expr));
+  if (!true_expr || !false_expr) return chosen;
+  // The result has the type both operands are converted to.
+  int size, is_unsigned;
+  GetCommonType(true_expr, false_expr, &size, &is_unsigned);
+  ASTConstant *value = cond->value ? true_expr : false_expr;
+  return AllocFoldedConstant(value->token, value->value, size, is_unsigned);
+}
+
+static ASTHandle FoldExpr(ASTHandle handle) {
+  // Returns the handle of the folded expression.
+  ASTNode *node = GetASTNode(handle);
+  if (!node) return handle;
+  switch (node->type) {
+    case kASTExprBinOp:
+      return FoldExprBinOp(handle);
+    case kASTExprUnaryPreOp:
+      return FoldExprUnaryPreOp(handle);
+    case kASTCondExpr:
+      return FoldCondExpr(handle);
+    case kASTList: {
+      ASTList *list = ToASTList(node);
+      for (int i = 0; i < GetSizeOfASTList(list); i++) {
+        ASTHandle element = GetASTHandle(GetASTNodeAt(list, i));
+        SetASTNodeAt(list, i, GetASTNode(FoldExpr(element)));
+      }
+    } break;
+    default:
+      break;
+  }
+  return handle;
+}
+
+static void FoldStmt(ASTNode *node) {
+  if (!node) return;
+  switch (node->type) {
+    case kASTCompStmt: {
+      ASTList *stmt_list =
+          ToASTList(GetASTNode(ToASTCompStmt(node)->stmt_list));
+      for (int i = 0; i < GetSizeOfASTList(stmt_list); i++) {
+        FoldStmt(GetASTNodeAt(stmt_list, i));
+      }
+    } break;
+    case kASTExprStmt: {
+      ASTExprStmt *expr_stmt = ToASTExprStmt(node);
+      expr_stmt->expr = FoldExpr(expr_stmt->expr);
+    } break;
+    case kASTJumpStmt:
+      FoldStmt(GetASTNode(ToASTJumpStmt(node)->param));
+      break;
+    case kASTForStmt: {
+      ASTForStmt *for_stmt = ToASTForStmt(node);
+      for_stmt->init_expr = FoldExpr(for_stmt->init_expr);
+      for_stmt->cond_expr = FoldExpr(for_stmt->cond_expr);
+      for_stmt->updt_expr = FoldExpr(for_stmt->updt_expr);
+      FoldStmt(GetASTNode(for_stmt->body_stmt));
+    } break;
+    case kASTIfStmt: {
+      ASTIfStmt *if_stmt = ToASTIfStmt(node);
+      if_stmt->cond_expr = FoldExpr(if_stmt->cond_expr);
+      FoldStmt(GetASTNode(if_stmt->true_stmt));
+      FoldStmt(GetASTNode(if_stmt->false_stmt));
+    } break;
+    default:
+      break;
+  }
+}
+
+void FoldConstants(ASTNode *root) {
+  // root is a translation-unit.
+  ASTList *list = ToASTList(root);
+  for (int i = 0; i < GetSizeOfASTList(list); i++) {
+    ASTFuncDef *func_def = ToASTFuncDef(GetASTNodeAt(list, i));
+    if (func_def) FoldStmt(GetASTNode(func_def->comp_stmt));
+  }
+}
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+# Regenerates the perfect hash of keywords in token.c from the keywords
+# registered by InitSymbols() in symbol.c.
+# The multiplier in token.c is kept if it still gives every keyword a slot
+# of its own. Otherwise odd multipliers are tried, and the table is doubled
+# when none of them works.
+# Usage: ./gen_keyword_hash.py && make format
+
+import random
+import re
+
+KEYWORD_SECTION = re.compile(r"// keywords\n(.*?)// punctuators", re.S)
+KEYWORD = re.compile(r'RegisterPredefinedSymbol\((kSym\w+), "(\w+)"\)')
+TABLE = re.compile(
+    r"#define KEYWORD_HASH_MULTIPLIER .*?\n};\n", re.S)
+MULTIPLIER = re.compile(r"#define KEYWORD_HASH_MULTIPLIER (0x[0-9a-f]+)u")
+
+
+def key_of(word):
+    b = word.encode()
+    return b[0] << 24 | b[1] << 16 | b[-1] << 8 | len(b)
+
+
+def make_table(keywords, multiplier, shift):
+    table = [None] * (1 << (32 - shift))
+    for sym, word in keywords:
+        slot = (key_of(word) * multiplier & 0xFFFFFFFF) >> shift
+        if table[slot]:
+            return None
+        table[slot] = sym
+    return table
+
+
+def find_table(keywords, multiplier):
+    shift = 32 - max(len(keywords) - 1, 1).bit_length()
+    if multiplier:
+        table = make_table(keywords, multiplier, shift)
+        if table:
+            return multiplier, shift, table
+    rng = random.Random(0)
+    while True:
+        for _ in range(1 << 20):
+            multiplier = rng.getrandbits(32) | 1
+            table = make_table(keywords, multiplier, shift)
+            if table:
+                return multiplier, shift, table
+        shift -= 1
+
+
+def format_table(keywords, multiplier, shift, table):
+    lens = [len(word) for _, word in keywords]
+    names = [sym or "kSymNone" for sym in table]
+    width = max(len(name) for name in names) + 1
+    rows = []
+    for i in range(0, len(names), 4):
+        row = [(name + ",").ljust(width) for name in names[i:i + 4]]
+        rows.append("    " + " ".join(row).rstrip() + "\n")
+    return ("#define KEYWORD_HASH_MULTIPLIER 0x%08xu\n" % multiplier +
+            "#define KEYWORD_HASH_SHIFT %d\n" % shift +
+            "#define KEYWORD_MIN_LEN %d\n" % min(lens) +
+            "#define KEYWORD_MAX_LEN %d\n" % max(lens) +
+            "static const int keyword_hash_table[1 << (32 - "
+            "KEYWORD_HASH_SHIFT)] = {\n" + "".join(rows) + "};\n")
+
+
+def main():
+    with open("symbol.c") as f:
+        keywords = KEYWORD.findall(KEYWORD_SECTION.search(f.read()).group(1))
+    with open("token.c") as f:
+        token_c = f.read()
+    current = MULTIPLIER.search(token_c)
+    multiplier, shift, table = find_table(
+        keywords, int(current.group(1), 16) if current else None)
+    token_c = TABLE.sub(
+        lambda _: format_table(keywords, multiplier, shift, table), token_c, 1)
+    with open("token.c", "w") as f:
+        f.write(token_c)
+
+
+if __name__ == "__main__":
+    main()
@@ -5,300 +5,440 @@
 // scratch registers: rax, rdi, rsi, rdx, rcx, r8, r9, r10, r11
 // return value: rax
 
-#define NUM_OF_SCRATCH_REGS 9
+#define NUM_OF_PARAM_REGS 6
 
-#define REAL_REG_RAX 1
-#define REAL_REG_RDI 2
-#define REAL_REG_RSI 3
-#define REAL_REG_RDX 4
-#define REAL_REG_RCX 5
-#define REAL_REG_R8 6
-#define REAL_REG_R9 7
-#define REAL_REG_R10 8
-#define REAL_REG_R11 9
-
-const char *ScratchRegNames[NUM_OF_SCRATCH_REGS + 1] = {
-    "NULL", "rax", "rdi", "rsi", "rdx", "rcx", "r8", "r9", "r10", "r11"};
+const char *RealRegNames[kNumOfRealRegs] = {
+    "NULL", "rax", "rdi", "rsi", "rdx", "rcx", "r8",  "r9",
+    "r10",  "r11", "rbx", "r12", "r13", "r14", "r15"};
+// The lower 32, 16 and 8 bits of the registers
+const char *RealRegNames32[kNumOfRealRegs] = {
+    "NULL", "eax",  "edi", "esi",  "edx",  "ecx",  "r8d", "r9d",
+    "r10d", "r11d", "ebx", "r12d", "r13d", "r14d", "r15d"};
+const char *RealRegNames16[kNumOfRealRegs] = {
+    "NULL", "ax",   "di", "si",   "dx",   "cx",   "r8w", "r9w",
+    "r10w", "r11w", "bx", "r12w", "r13w", "r14w", "r15w"};
+const char *RealRegNames8[kNumOfRealRegs] = {
+    "NULL", "al",   "dil", "sil",  "dl",   "cl",   "r8b", "r9b",
+    "r10b", "r11b", "bl",  "r12b", "r13b", "r14b", "r15b"};
 
 int GetLabelNumber() {
   static int num = 1;
   return num++;
 }
 
-typedef struct {
-  int save_label_num;
-  int real_reg;
-} RegAssignInfo;
-
-#define NUM_OF_ASSIGN_INFOS 128
-RegAssignInfo reg_assign_infos[NUM_OF_ASSIGN_INFOS];
-
-int RealRegAssignTable[NUM_OF_SCRATCH_REGS + 1];
-int RealRegRefOrder[NUM_OF_SCRATCH_REGS + 1];
-int order_count = 1;
-
-void GenerateSpillData(FILE *fp) {
-  fprintf(fp, ".data\n");
-  for (int i = 0; i < NUM_OF_ASSIGN_INFOS; i++) {
-    if (reg_assign_infos[i].save_label_num) {
-      fprintf(fp, "L%d: .quad 0\n", reg_assign_infos[i].save_label_num);
-    }
+const char *GetRealRegNameOfSize(int real_reg, int size) {
+  switch (size) {
+    case 1:
+      return RealRegNames8[real_reg];
+    case 2:
+      return RealRegNames16[real_reg];
+    case 4:
+      return RealRegNames32[real_reg];
   }
+  return RealRegNames[real_reg];
 }
 
-void PrintRegisterAssignment() {
-  puts("==== ASSIGNMENT ====");
-  for (int i = 1; i < NUM_OF_SCRATCH_REGS + 1; i++) {
-    if (RealRegAssignTable[i]) {
-      printf("\treg[%d] => %s (%d)\n", RealRegAssignTable[i],
-             ScratchRegNames[i], RealRegRefOrder[i]);
-    } else {
-      printf("\tnone => %s (%d)\n", ScratchRegNames[i], RealRegRefOrder[i]);
-    }
+const char *GetPtrSizeName(int size) {
+  switch (size) {
+    case 1:
+      return "byte";
+    case 2:
+      return "word";
+    case 4:
+      return "dword";
   }
-  puts("==== END OF ASSIGNMENT ====");
+  return "qword";
 }
 
-int SelectVirtualRegisterToSpill() {
-  for (int i = 1; i < NUM_OF_SCRATCH_REGS + 1; i++) {
-    if (RealRegAssignTable[i]) {
-      printf("\treg[%d] => %s (%d)\n", RealRegAssignTable[i],
-             ScratchRegNames[i], RealRegRefOrder[i]);
-    }
-    if (RealRegAssignTable[i] &&
-        RealRegRefOrder[i] <= order_count - NUM_OF_SCRATCH_REGS)
-      return RealRegAssignTable[i];
+void GenerateLoadVar(FILE *fp, int real_reg, const Var *var) {
+  // Loads the value of a param or local, widened to 64 bits.
+  const Type *type = var->type;
+  const char *dst = RealRegNames[real_reg];
+  if (type->kind == kTypeArray) {
+    fprintf(fp, "lea     %s, [rbp - %d]\n", dst, var->offset);
+  } else if (type->size == 4 && type->is_unsigned) {
+    // Writing a 32-bit register clears the upper half.
+    fprintf(fp, "mov     %s, dword ptr [rbp - %d]\n",
+            RealRegNames32[real_reg], var->offset);
+  } else if (type->size < 8) {
+    const char *op = type->is_unsigned ? "movzx" : "movsx";
+    if (type->size == 4) op = "movsxd";
+    fprintf(fp, "%-7s %s, %s ptr [rbp - %d]\n", op, dst,
+            GetPtrSizeName(type->size), var->offset);
+  } else {
+    fprintf(fp, "mov     %s, qword ptr [rbp - %d]\n", dst, var->offset);
   }
-  Error("SelectVirtualRegisterToSpill: NOT_REACHED");
-  return 0;
 }
 
-void SpillVirtualRegister(FILE *fp, int virtual_reg) {
-  RegAssignInfo *info = &reg_assign_infos[virtual_reg];
-  if (!info->save_label_num) info->save_label_num = GetLabelNumber();
-  //
-  fprintf(fp, "mov [rip + L%d], %s\n", info->save_label_num,
-          ScratchRegNames[info->real_reg]);
-  //
-  RealRegAssignTable[info->real_reg] = 0;
-  info->real_reg = 0;
-  printf("\tvirtual_reg[%d] is spilled to label %d\n", virtual_reg,
-         info->save_label_num);
+// Of the function being generated. Values that are not in a register are
+// read from their stack slots in place where x86 allows it, and go through
+// rax otherwise.
+static const RegAllocation *allocation;
+
+typedef char LocationStr[32];
+
+static const RegLocation *GetLocation(const ILOperand *operand) {
+  if (operand->kind != kILOperandReg) Error("Operand is not a register");
+  return &allocation->locations[operand->reg];
 }
 
-void SpillRealRegister(FILE *fp, int rreg) {
-  if (RealRegAssignTable[rreg]) {
-    SpillVirtualRegister(fp, RealRegAssignTable[rreg]);
+static const char *FormatLocation(LocationStr s, const RegLocation *location,
+                                  int size) {
+  if (location->real_reg) {
+    return GetRealRegNameOfSize(location->real_reg, size);
   }
+  snprintf(s, sizeof(LocationStr), "%s ptr [rbp - %d]", GetPtrSizeName(size),
+           location->offset);
+  return s;
 }
 
-int FindFreeRealReg(FILE *fp) {
-  for (int i = 1; i < NUM_OF_SCRATCH_REGS + 1; i++) {
-    if (!RealRegAssignTable[i]) return i;
-  }
-  PrintRegisterAssignment();
-  SpillVirtualRegister(fp, SelectVirtualRegisterToSpill());
-  PrintRegisterAssignment();
-  for (int i = 1; i < NUM_OF_SCRATCH_REGS + 1; i++) {
-    if (!RealRegAssignTable[i]) return i;
+static const char *FormatOperand(LocationStr s, const ILOperand *operand) {
+  return FormatLocation(s, GetLocation(operand), 8);
+}
+
+static RealReg GetDstReg(int dst) {
+  // The register to compute the value of dst in
+  RealReg real_reg = allocation->locations[dst].real_reg;
+  return real_reg ? real_reg : kRealRegRax;
+}
+
+static void StoreDst(FILE *fp, int dst) {
+  const RegLocation *location = &allocation->locations[dst];
+  if (location->real_reg) return;
+  fprintf(fp, "mov     qword ptr [rbp - %d], rax\n", location->offset);
+}
+
+static const char *LoadOperandToReg(FILE *fp, LocationStr s,
+                                    const ILOperand *operand) {
+  // Returns the register that holds operand, loading it to rax if needed.
+  const RegLocation *location = GetLocation(operand);
+  if (location->real_reg) return RealRegNames[location->real_reg];
+  fprintf(fp, "mov     rax, %s\n", FormatLocation(s, location, 8));
+  return "rax";
+}
+
+static int GetNextEmittedBlock(const ILFunc *func, int index) {
+  // Unreachable blocks are not emitted.
+  for (int i = index + 1; i < func->num_of_blocks; i++) {
+    if (func->blocks[i].num_of_preds) return i;
   }
-  Error("FindFreeRealReg: NOT_REACHED");
-  return 0;
+  return -1;
 }
 
-void AssignVirtualRegToRealReg(FILE *fp, int virtual_reg, int real_reg) {
-  RegAssignInfo *info = &reg_assign_infos[virtual_reg];
-  if (info->real_reg == real_reg) {
-    // already satisfied.
-    RealRegRefOrder[real_reg] = order_count++;
-    return;
+static void GenerateFuncPrologue(FILE *fp, ASTFuncDef *func_def) {
+  const char *func_name = GetFuncNameStrFromFuncDef(func_def);
+  if (!func_name) {
+    Error("func_name is null");
+  }
+  const char *prefix = kernel_type == kKernelDarwin ? "_" : "";
+  fprintf(fp, ".global %s%s\n", prefix, func_name);
+  fprintf(fp, "%s%s:\n", prefix, func_name);
+  fprintf(fp, "push    rbp\n");
+  fprintf(fp, "mov     rbp, rsp\n");
+  // rsp stays 16-byte aligned for calls.
+  int frame_size = (allocation->frame_size + 15) & ~15;
+  if (frame_size) fprintf(fp, "sub     rsp, %d\n", frame_size);
+  if (func_def->num_of_params > NUM_OF_PARAM_REGS) {
+    Error("Passing more than %d params is not implemented",
+          NUM_OF_PARAM_REGS);
   }
-  // first, free target real reg.
-  SpillRealRegister(fp, real_reg);
-  // next, assign virtual reg to real reg.
-  if (info->real_reg) {
-    printf("\tvirtual_reg[%d] is stored on %s, moving...\n", virtual_reg,
-           ScratchRegNames[info->real_reg]);
-    fprintf(fp, "mov %s, %s\n", ScratchRegNames[real_reg],
-            ScratchRegNames[info->real_reg]);
-    RealRegAssignTable[info->real_reg] = 0;
-  } else if (info->save_label_num) {
-    printf("\tvirtual_reg[%d] is stored at label %d, restoring...\n",
-           virtual_reg, info->save_label_num);
-    fprintf(fp, "mov %s, [rip + L%d]\n", ScratchRegNames[real_reg],
-            info->save_label_num);
+  for (int i = 0; i < func_def->num_of_params; i++) {
+    fprintf(fp, "mov     qword ptr [rbp - %d], %s\n", 8 * (i + 1),
+            RealRegNames[kRealRegRdi + i]);
   }
-  RealRegAssignTable[real_reg] = virtual_reg;
-  RealRegRefOrder[real_reg] = order_count++;
-  info->real_reg = real_reg;
-  if (info->save_label_num) {
+  for (int r = kRealRegRbx; r < kNumOfRealRegs; r++) {
+    if (!allocation->saved_offsets[r]) continue;
+    fprintf(fp, "mov     qword ptr [rbp - %d], %s\n",
+            allocation->saved_offsets[r], RealRegNames[r]);
   }
-  printf("\tvirtual_reg[%d] => %s\n", virtual_reg, ScratchRegNames[real_reg]);
 }
 
-const char *AssignRegister(FILE *fp, int reg_id) {
-  printf("requested reg_id = %d\n", reg_id);
-  if (reg_id < 1 || NUM_OF_ASSIGN_INFOS <= reg_id) {
-    Error("reg_id out of range (%d)", reg_id);
+static void GenerateFuncEpilogue(FILE *fp) {
+  for (int r = kRealRegRbx; r < kNumOfRealRegs; r++) {
+    if (!allocation->saved_offsets[r]) continue;
+    fprintf(fp, "mov     %s, qword ptr [rbp - %d]\n", RealRegNames[r],
+            allocation->saved_offsets[r]);
   }
-  RegAssignInfo *info = &reg_assign_infos[reg_id];
-  if (info->real_reg) {
-    printf("\texisted on %s\n", ScratchRegNames[info->real_reg]);
-    RealRegRefOrder[info->real_reg] = order_count++;
-    return ScratchRegNames[info->real_reg];
-  }
-  int real_reg = FindFreeRealReg(fp);
-  AssignVirtualRegToRealReg(fp, reg_id, real_reg);
-  return ScratchRegNames[real_reg];
+  fprintf(fp, "mov     rsp, rbp\n");
+  fprintf(fp, "pop     rbp\n");
+  fprintf(fp, "ret\n");
 }
 
-const char *GetParamRegister(int param_index) {
-  // param-index: 1-based
-  if (param_index < 1 || NUM_OF_SCRATCH_REGS <= param_index) {
-    Error("param_index exceeded (%d)", param_index);
+static void GenerateArgMoves(FILE *fp, const ILOperand *args,
+                             int num_of_args) {
+  // The args are moved to the param registers all at once: a move waits
+  // while its destination holds an arg that is not moved yet, and a cycle
+  // of such moves is broken through rax.
+  RegLocation srcs[NUM_OF_PARAM_REGS];
+  int is_pending[NUM_OF_PARAM_REGS];
+  for (int i = 0; i < num_of_args; i++) {
+    srcs[i] = *GetLocation(&args[i]);
+    is_pending[i] = 1;
+  }
+  for (int num_of_pending = num_of_args; num_of_pending;) {
+    int is_moved = 0;
+    for (int i = 0; i < num_of_args; i++) {
+      if (!is_pending[i]) continue;
+      RealReg dst = kRealRegRdi + i;
+      int is_blocked = 0;
+      for (int k = 0; k < num_of_args; k++) {
+        if (k != i && is_pending[k] && srcs[k].real_reg == dst) {
+          is_blocked = 1;
+        }
+      }
+      if (is_blocked) continue;
+      if (srcs[i].real_reg != dst) {
+        LocationStr s;
+        fprintf(fp, "mov     %s, %s\n", RealRegNames[dst],
+                FormatLocation(s, &srcs[i], 8));
+      }
+      is_pending[i] = 0;
+      num_of_pending--;
+      is_moved = 1;
+    }
+    if (is_moved) continue;
+    // Every pending move waits for another, so the first one waits for a
+    // move from its destination.
+    int first = 0;
+    while (!is_pending[first]) first++;
+    for (int k = 0; k < num_of_args; k++) {
+      if (!is_pending[k] || srcs[k].real_reg != kRealRegRdi + first) continue;
+      fprintf(fp, "mov     rax, %s\n", RealRegNames[srcs[k].real_reg]);
+      srcs[k].real_reg = kRealRegRax;
+      break;
+    }
   }
-  return ScratchRegNames[param_index];
 }
 
-void GenerateCode(FILE *fp, ASTList *il) {
-  fputs(".intel_syntax noprefix\n", fp);
-  // generate func symbol
-  for (int i = 0; i < GetSizeOfASTList(il); i++) {
-    ASTNode *node = GetASTNodeAt(il, i);
-    ASTILOp *op = ToASTILOp(node);
-    if (op->op == kILOpFuncBegin) {
-      const char *func_name =
-          GetFuncNameStrFromFuncDef(ToASTFuncDef(op->ast_node));
-      if (!func_name) {
-        Error("func_name is null");
+static void GenerateInstr(FILE *fp, const ILFunc *func, const ILBlock *block,
+                          const ILInstr *op, const int *labels, int next) {
+  // next: the block emitted after block, or -1
+  LocationStr left_str, right_str;
+  switch (op->op) {
+    case kILOpLoadImm: {
+      const char *dst_name = RealRegNames[GetDstReg(op->dst)];
+      if (op->left.kind == kILOperandStr) {
+        const Token *token = op->left.token;
+        int label_for_skip = GetLabelNumber();
+        int label_str = GetLabelNumber();
+        fprintf(fp, "jmp L%d\n", label_for_skip);
+        fprintf(fp, "L%d:\n", label_str);
+        fprintf(fp, ".asciz  \"%.*s\"\n", token->length, token->begin);
+        fprintf(fp, "L%d:\n", label_for_skip);
+        fprintf(fp, "lea     %s, [rip + L%d]\n", dst_name, label_str);
+      } else {
+        fprintf(fp, "mov %s, %lld\n", dst_name, op->left.imm);
       }
-      fprintf(fp, ".global %s%s\n", kernel_type == kKernelDarwin ? "_" : "",
-              func_name);
-    }
+      StoreDst(fp, op->dst);
+    } break;
+    case kILOpLoadAddr:
+      fprintf(fp, "lea     %s, [rip + %s%.*s]\n",
+              RealRegNames[GetDstReg(op->dst)],
+              kernel_type == kKernelDarwin ? "_" : "", op->left.token->length,
+              op->left.token->begin);
+      StoreDst(fp, op->dst);
+      break;
+    case kILOpLoadVar:
+      GenerateLoadVar(fp, GetDstReg(op->dst), op->left.var);
+      StoreDst(fp, op->dst);
+      break;
+    case kILOpStoreVar: {
+      const RegLocation *value = GetLocation(&op->right);
+      RealReg real_reg = value->real_reg;
+      if (!real_reg) {
+        fprintf(fp, "mov     rax, %s\n", FormatLocation(left_str, value, 8));
+        real_reg = kRealRegRax;
+      }
+      const Var *var = op->left.var;
+      int size = var->type->size;
+      fprintf(fp, "mov     %s ptr [rbp - %d], %s\n", GetPtrSizeName(size),
+              var->offset, GetRealRegNameOfSize(real_reg, size));
+    } break;
+    case kILOpAdd:
+    case kILOpSub:
+    case kILOpMul: {
+      // The result never shares a register with the operands. A 32-bit
+      // result is computed in the lower half, whose write clears the upper
+      // half, and a signed one is then sign-extended.
+      int size = op->type->size;
+      RealReg dst_reg = GetDstReg(op->dst);
+      const char *dst = GetRealRegNameOfSize(dst_reg, size);
+      const char *left =
+          FormatLocation(left_str, GetLocation(&op->left), size);
+      const char *right =
+          FormatLocation(right_str, GetLocation(&op->right), size);
+      const char *mnemonic = op->op == kILOpAdd   ? "add"
+                             : op->op == kILOpSub ? "sub"
+                                                  : "imul";
+      fprintf(fp, "mov     %s, %s\n", dst, left);
+      fprintf(fp, "%-7s %s, %s\n", mnemonic, dst, right);
+      if (size == 4 && !op->type->is_unsigned) {
+        fprintf(fp, "movsxd  %s, %s\n", RealRegNames[dst_reg], dst);
+      }
+      StoreDst(fp, op->dst);
+    } break;
+    case kILOpEq:
+    case kILOpNotEq:
+    case kILOpLt:
+    case kILOpLtEq: {
+      // Compared at the width of the type, since an int converted to
+      // unsigned int is the lower half of its sign extension.
+      int size = op->type->size;
+      const RegLocation *left_location = GetLocation(&op->left);
+      const char *left = FormatLocation(left_str, left_location, size);
+      const char *right =
+          FormatLocation(right_str, GetLocation(&op->right), size);
+      if (!left_location->real_reg && !GetLocation(&op->right)->real_reg) {
+        LoadOperandToReg(fp, left_str, &op->left);
+        left = GetRealRegNameOfSize(kRealRegRax, size);
+      }
+      RealReg dst = GetDstReg(op->dst);
+      int is_unsigned = op->type->is_unsigned;
+      const char *set = "sete";
+      if (op->op == kILOpNotEq) set = "setne";
+      if (op->op == kILOpLt) set = is_unsigned ? "setb" : "setl";
+      if (op->op == kILOpLtEq) set = is_unsigned ? "setbe" : "setle";
+      fprintf(fp, "cmp     %s, %s\n", left, right);
+      fprintf(fp, "%-7s %s\n", set, RealRegNames8[dst]);
+      fprintf(fp, "movzx   %s, %s\n", RealRegNames[dst], RealRegNames8[dst]);
+      StoreDst(fp, op->dst);
+    } break;
+    case kILOpCopy: {
+      const RegLocation *dst = &allocation->locations[op->dst];
+      const RegLocation *src = GetLocation(&op->left);
+      if (dst->real_reg && dst->real_reg == src->real_reg) break;
+      if (dst->real_reg) {
+        fprintf(fp, "mov     %s, %s\n", RealRegNames[dst->real_reg],
+                FormatLocation(left_str, src, 8));
+        break;
+      }
+      const char *value = LoadOperandToReg(fp, left_str, &op->left);
+      fprintf(fp, "mov     %s, %s\n", FormatLocation(right_str, dst, 8),
+              value);
+    } break;
+    case kILOpCast: {
+      // Truncates to the type and widens back to 64 bits, as a store and
+      // a load of a var of the type would.
+      RealReg dst = GetDstReg(op->dst);
+      const Type *type = op->right.type;
+      const char *src = FormatLocation(left_str, GetLocation(&op->left),
+                                       type->size);
+      if (type->size == 4 && type->is_unsigned) {
+        fprintf(fp, "mov     %s, %s\n", RealRegNames32[dst], src);
+      } else {
+        const char *ext = type->is_unsigned ? "movzx" : "movsx";
+        if (type->size == 4) ext = "movsxd";
+        fprintf(fp, "%-7s %s, %s\n", ext, RealRegNames[dst], src);
+      }
+      StoreDst(fp, op->dst);
+    } break;
+    case kILOpCall: {
+      const ILOperand *args = &func->operands[op->right.list.begin];
+      int num_of_args = op->right.list.count;
+      if (num_of_args > NUM_OF_PARAM_REGS) {
+        Error("Passing more than %d args is not implemented",
+              NUM_OF_PARAM_REGS);
+      }
+      // Values that live across the call are in callee-saved registers or
+      // stack slots, so the other registers are free here.
+      GenerateArgMoves(fp, args, num_of_args);
+      const Token *func_name = op->left.token;
+      fprintf(fp, ".global %s%.*s\n", kernel_type == kKernelDarwin ? "_" : "",
+              func_name->length, func_name->begin);
+      fprintf(fp, "call %s%.*s\n", kernel_type == kKernelDarwin ? "_" : "",
+              func_name->length, func_name->begin);
+      // The return value is in rax.
+      const RegLocation *dst = &allocation->locations[op->dst];
+      if (dst->real_reg) {
+        fprintf(fp, "mov     %s, rax\n", RealRegNames[dst->real_reg]);
+      }
+      StoreDst(fp, op->dst);
+    } break;
+    case kILOpJump:
+      if (block->succs[0] != next) {
+        fprintf(fp, "jmp L%d\n", labels[block->succs[0]]);
+      }
+      break;
+    case kILOpBranch: {
+      fprintf(fp, "cmp     %s, 0\n", FormatOperand(left_str, &op->left));
+      if (block->succs[1] == next) {
+        fprintf(fp, "jne L%d\n", labels[block->succs[0]]);
+        break;
+      }
+      fprintf(fp, "je L%d\n", labels[block->succs[1]]);
+      if (block->succs[0] != next) {
+        fprintf(fp, "jmp L%d\n", labels[block->succs[0]]);
+      }
+    } break;
+    case kILOpReturn:
+      if (op->left.kind == kILOperandReg) {
+        fprintf(fp, "mov     rax, %s\n", FormatOperand(left_str, &op->left));
+      }
+      GenerateFuncEpilogue(fp);
+      break;
+    default:
+      Error("Not implemented code generation for ILOp%s",
+            GetILOpTypeName(op->op));
   }
-  // generate code
-  for (int i = 0; i < GetSizeOfASTList(il); i++) {
-    ASTNode *node = GetASTNodeAt(il, i);
-    ASTILOp *op = ToASTILOp(node);
-    if (!op) {
-      Error("op is null!");
+}
+
+static void PrintRegAllocation(const ILFunc *func) {
+  puts("==== ASSIGNMENT ====");
+  for (int i = 1; i < func->num_of_regs; i++) {
+    const RegLocation *location = &allocation->locations[i];
+    if (!location->real_reg && !location->offset) continue;  // unused
+    if (location->real_reg) {
+      printf("\tr%d => %s\n", i, RealRegNames[location->real_reg]);
+    } else {
+      printf("\tr%d => [rbp - %d]\n", i, location->offset);
     }
-    switch (op->op) {
-      case kILOpFuncBegin: {
-        const char *func_name =
-            GetFuncNameStrFromFuncDef(ToASTFuncDef(op->ast_node));
-        if (!func_name) {
-          Error("func_name is null");
-        }
-        fprintf(fp, "%s%s:\n", kernel_type == kKernelDarwin ? "_" : "",
-                func_name);
-        fprintf(fp, "push    rbp\n");
-        fprintf(fp, "mov     rbp, rsp\n");
-      } break;
-      case kILOpFuncEnd:
-        fprintf(fp, "mov     dword ptr [rbp - 4], 0\n");
-        fprintf(fp, "pop     rbp\n");
-        fprintf(fp, "ret\n");
-        break;
-      case kILOpLoadImm: {
-        const char *dst_name = AssignRegister(fp, op->dst_reg);
-        //
-        ASTConstant *val = ToASTConstant(op->ast_node);
-        switch (val->token->type) {
-          case kInteger: {
-            char *p;
-            const char *s = val->token->str;
-            int n = strtol(s, &p, 0);
-            if (!(s[0] != 0 && *p == 0)) {
-              Error("%s is not valid as integer.", s);
-            }
-            fprintf(fp, "mov %s, %d\n", dst_name, n);
+  }
+  puts("==== END OF ASSIGNMENT ====");
+}
 
-          } break;
-          case kStringLiteral: {
-            int label_for_skip = GetLabelNumber();
-            int label_str = GetLabelNumber();
-            fprintf(fp, "jmp L%d\n", label_for_skip);
-            fprintf(fp, "L%d:\n", label_str);
-            fprintf(fp, ".asciz  \"%s\"\n", val->token->str);
-            fprintf(fp, "L%d:\n", label_for_skip);
-            fprintf(fp, "lea     %s, [rip + L%d]\n", dst_name, label_str);
-          } break;
-          default:
-            Error("kILOpLoadImm: not implemented for token type %d",
-                  val->token->type);
-        }
-      } break;
-      case kILOpLoadIdent: {
-        const char *dst_name = AssignRegister(fp, op->dst_reg);
-        //
-        ASTIdent *ident = ToASTIdent(op->ast_node);
-        switch (ident->token->type) {
-          case kIdentifier: {
-            fprintf(fp, "lea     %s, [rip + %s%s]\n", dst_name,
-                    kernel_type == kKernelDarwin ? "_" : "", ident->token->str);
-          } break;
-          default:
-            Error("kILOpLoadIdent: not implemented for token type %d",
-                  ident->token->type);
-        }
-      } break;
-      case kILOpAdd:
-      case kILOpSub:
-      case kILOpMul: {
-        const char *dst = AssignRegister(fp, op->dst_reg);
-        const char *left = AssignRegister(fp, op->left_reg);
-        const char *right = AssignRegister(fp, op->right_reg);
-        //
-        if (op->op == kILOpAdd) {
-          fprintf(fp, "add %s, %s\n", left, right);
-          fprintf(fp, "mov %s, %s\n", dst, left);
-        } else if (op->op == kILOpSub) {
-          fprintf(fp, "sub %s, %s\n", left, right);
-          fprintf(fp, "mov %s, %s\n", dst, left);
-        } else if (op->op == kILOpMul) {
-          // eDX: eAX <- eAX * r/m
-          fprintf(fp, "push rax\n");
-          fprintf(fp, "mov rax, %s\n", left);
-          fprintf(fp, "push rdx\n");
-          fprintf(fp, "imul %s\n", right);
-          fprintf(fp, "pop rdx\n");
-          fprintf(fp, "mov %s, rax\n", dst);
-          fprintf(fp, "pop rax\n");
-        }
-      } break;
-      case kILOpReturn: {
-        AssignVirtualRegToRealReg(fp, op->left_reg, REAL_REG_RAX);
-      } break;
-      case kILOpCall: {
-        ASTList *call_params = ToASTList(op->ast_node);
-        if (!call_params) Error("call_params is not an ASTList");
-        for (int i = 1; i < GetSizeOfASTList(call_params); i++) {
-          AssignVirtualRegToRealReg(
-              fp, ToASTILOp(GetASTNodeAt(call_params, i))->dst_reg, i + 1);
-        }
-        ASTIdent *func_ident = ToASTIdent(GetASTNodeAt(call_params, 0));
-        if (!func_ident) Error("call_params[0] is not an ASTIdent");
-        fprintf(fp, ".global %s%s\n", kernel_type == kKernelDarwin ? "_" : "",
-                func_ident->token->str);
-        fprintf(fp, "call %s%s\n", kernel_type == kKernelDarwin ? "_" : "",
-                func_ident->token->str);
-      } break;
-      default:
-        Error("Not implemented code generation for ILOp%s",
-              GetILOpTypeName(op->op));
+static void GenerateCode(FILE *fp, const ILFunc *func) {
+  ILLiveness *liveness = AnalyzeLiveness(func);
+  RegAllocation *func_allocation = AllocateRegisters(func, liveness);
+  FreeILLiveness(liveness);
+  allocation = func_allocation;
+  PrintRegAllocation(func);
+  GenerateFuncPrologue(fp, func->func_def);
+  int *labels = malloc(sizeof(int) * func->num_of_blocks);
+  if (!labels) Error("Failed to allocate block labels");
+  for (int i = 0; i < func->num_of_blocks; i++) labels[i] = GetLabelNumber();
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    const ILBlock *block = &func->blocks[i];
+    if (i && !block->num_of_preds) continue;
+    fprintf(fp, "L%d:\n", labels[i]);
+    int next = GetNextEmittedBlock(func, i);
+    for (int k = 0; k < block->num_of_instrs; k++) {
+      GenerateInstr(fp, func, block, &block->instrs[k], labels, next);
     }
   }
-  GenerateSpillData(fp);
+  free(labels);
+  allocation = NULL;
+  FreeRegAllocation(func_allocation);
 }
 
-#define MAX_IL_NODES 2048
 void Generate(FILE *fp, ASTNode *root) {
-  ASTList *intermediate_code = AllocASTList(MAX_IL_NODES);
-
-  GenerateIL(intermediate_code, root);
-  PrintASTNode(ToASTNode(intermediate_code), 0);
-  putchar('\n');
-
-  GenerateCode(fp, intermediate_code);
+  FoldConstants(root);
+  fputs(".intel_syntax noprefix\n", fp);
+  ASTList *list = ToASTList(root);
+  for (int i = 0; i < GetSizeOfASTList(list); i++) {
+    ASTFuncDef *func_def = ToASTFuncDef(GetASTNodeAt(list, i));
+    // The body of an unreferenced static or inline function is not parsed.
+    if (!func_def || !func_def->comp_stmt) continue;
+    ILFunc *func = GenerateIL(func_def);
+    ConvertToSSA(func);
+    PropagateCopies(func);
+    NumberValues(func);
+    PropagateCopies(func);
+    EliminateDeadCode(func);
+    PrintILFunc(func);
+    putchar('\n');
+    ConvertFromSSA(func);
+    RenumberILRegs(func);
+    GenerateCode(fp, func);
+    FreeILFunc(func);
+  }
 }
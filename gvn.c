@@ -0,0 +1,207 @@
+#include <stdint.h>
+
+#include "compilium.h"
+
+// Global value numbering.
+// The dominator tree is walked with a table of the values computed in the
+// blocks that dominate the current one, keyed by the op, the operands and
+// the type.
+// An instruction that computes a value already in the table becomes a copy
+// of it, and PropagateCopies() then moves its uses to the earlier value.
+// Only the ops that have no side effects and depend only on their operands
+// are numbered. This runs on SSA form, where a register has a single
+// definition that dominates its uses.
+
+typedef struct {
+  ILOpType op;
+  ILOperand left;
+  ILOperand right;
+  const Type *type;  // of arithmetic and compares
+  int value;
+  int next;  // in the bucket, -1: end
+} ValueEntry;
+
+typedef struct {
+  ILFunc *func;
+  int *heads;  // of the buckets, -1: empty
+  int mask;
+  ValueEntry *entries;  // a stack, popped when a block is left
+  int num_of_entries;
+  int *value_of;  // by register
+  int *first_child;  // in the dominator tree, -1: none
+  int *next_sibling;
+} ValueNumbering;
+
+static int IsNumberedOp(ILOpType op) {
+  switch (op) {
+    case kILOpAdd:
+    case kILOpSub:
+    case kILOpMul:
+    case kILOpEq:
+    case kILOpNotEq:
+    case kILOpLt:
+    case kILOpLtEq:
+    case kILOpLoadImm:
+    case kILOpLoadAddr:
+    case kILOpLoadVar:  // no var left in memory is stored to in SSA
+    case kILOpCast:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int IsCommutativeOp(ILOpType op) {
+  return op == kILOpAdd || op == kILOpMul || op == kILOpEq ||
+         op == kILOpNotEq;
+}
+
+static unsigned int HashOperand(unsigned int hash, const ILOperand *operand) {
+  unsigned long long key = 0;
+  switch (operand->kind) {
+    case kILOperandReg:
+      key = operand->reg;
+      break;
+    case kILOperandImm:
+      key = operand->imm;
+      break;
+    case kILOperandSym:
+      key = operand->token->sym;
+      break;
+    case kILOperandVar:
+      key = (uintptr_t)operand->var;
+      break;
+    case kILOperandStr:
+      key = (uintptr_t)operand->token;
+      break;
+    case kILOperandType:
+      key = (uintptr_t)operand->type;
+      break;
+    default:
+      break;
+  }
+  // FNV-1a
+  hash = (hash ^ operand->kind) * 16777619u;
+  hash = (hash ^ (unsigned int)key) * 16777619u;
+  return (hash ^ (unsigned int)(key >> 32)) * 16777619u;
+}
+
+static int IsSameOperand(const ILOperand *a, const ILOperand *b) {
+  if (a->kind != b->kind) return 0;
+  switch (a->kind) {
+    case kILOperandNone:
+      return 1;
+    case kILOperandReg:
+      return a->reg == b->reg;
+    case kILOperandImm:
+      return a->imm == b->imm;
+    case kILOperandSym:
+      // Globals are named by identifiers, whose symbols are interned.
+      return a->token->sym == b->token->sym;
+    case kILOperandVar:
+      return a->var == b->var;
+    case kILOperandStr:
+      return a->token == b->token;
+    case kILOperandType:
+      return a->type == b->type;
+    default:
+      return 0;
+  }
+}
+
+static void NumberBlock(ValueNumbering *vn, int block_index) {
+  ILBlock *block = &vn->func->blocks[block_index];
+  int num_of_entries = vn->num_of_entries;
+  for (int i = 0; i < block->num_of_instrs; i++) {
+    ILInstr *instr = &block->instrs[i];
+    if (!IsNumberedOp(instr->op)) continue;
+    if (instr->left.kind == kILOperandReg) {
+      instr->left.reg = vn->value_of[instr->left.reg];
+    }
+    if (instr->right.kind == kILOperandReg) {
+      instr->right.reg = vn->value_of[instr->right.reg];
+    }
+    if (IsCommutativeOp(instr->op) && instr->left.reg > instr->right.reg) {
+      ILOperand left = instr->left;
+      instr->left = instr->right;
+      instr->right = left;
+    }
+    unsigned int hash = (2166136261u ^ instr->op) * 16777619u;
+    hash = HashOperand(hash, &instr->left);
+    hash = HashOperand(hash, &instr->right);
+    int *head = &vn->heads[hash & vn->mask];
+    int e = *head;
+    for (; e >= 0; e = vn->entries[e].next) {
+      const ValueEntry *entry = &vn->entries[e];
+      if (entry->op == instr->op && entry->type == instr->type &&
+          IsSameOperand(&entry->left, &instr->left) &&
+          IsSameOperand(&entry->right, &instr->right)) {
+        break;
+      }
+    }
+    if (e >= 0) {
+      int value = vn->entries[e].value;
+      vn->value_of[instr->dst] = value;
+      instr->op = kILOpCopy;
+      instr->left.kind = kILOperandReg;
+      instr->left.reg = value;
+      instr->right.kind = kILOperandNone;
+      continue;
+    }
+    ValueEntry *entry = &vn->entries[vn->num_of_entries];
+    entry->op = instr->op;
+    entry->left = instr->left;
+    entry->right = instr->right;
+    entry->type = instr->type;
+    entry->value = instr->dst;
+    entry->next = *head;
+    *head = vn->num_of_entries++;
+  }
+  for (int child = vn->first_child[block_index]; child >= 0;
+       child = vn->next_sibling[child]) {
+    NumberBlock(vn, child);
+  }
+  // The values of this block do not dominate its siblings.
+  while (vn->num_of_entries > num_of_entries) {
+    const ValueEntry *entry = &vn->entries[--vn->num_of_entries];
+    unsigned int hash = (2166136261u ^ entry->op) * 16777619u;
+    hash = HashOperand(hash, &entry->left);
+    hash = HashOperand(hash, &entry->right);
+    vn->heads[hash & vn->mask] = entry->next;
+  }
+}
+
+void NumberValues(ILFunc *func) {
+  // Needs the dominators computed by ConvertToSSA().
+  ValueNumbering vn = {.func = func};
+  int num_of_instrs = 0;
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    num_of_instrs += func->blocks[i].num_of_instrs;
+  }
+  int num_of_buckets = 16;
+  while (num_of_buckets < num_of_instrs * 2) num_of_buckets *= 2;
+  vn.mask = num_of_buckets - 1;
+  vn.heads = malloc(sizeof(int) * num_of_buckets);
+  vn.entries = malloc(sizeof(ValueEntry) * (num_of_instrs + 1));
+  vn.value_of = malloc(sizeof(int) * func->num_of_regs);
+  vn.first_child = malloc(sizeof(int) * func->num_of_blocks);
+  vn.next_sibling = malloc(sizeof(int) * func->num_of_blocks);
+  if (!vn.heads || !vn.entries || !vn.value_of || !vn.first_child ||
+      !vn.next_sibling) {
+    Error("Failed to allocate ValueNumbering");
+  }
+  for (int i = 0; i < num_of_buckets; i++) vn.heads[i] = -1;
+  for (int i = 0; i < func->num_of_regs; i++) vn.value_of[i] = i;
+  for (int i = 0; i < func->num_of_blocks; i++) vn.first_child[i] = -1;
+  for (int i = func->num_of_blocks - 1; i > 0; i--) {
+    int idom = func->blocks[i].idom;
+    vn.next_sibling[i] = vn.first_child[idom];
+    vn.first_child[idom] = i;
+  }
+  NumberBlock(&vn, 0);
+  free(vn.heads);
+  free(vn.entries);
+  free(vn.value_of);
+  free(vn.first_child);
+  free(vn.next_sibling);
+}
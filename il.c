@@ -1,19 +1,26 @@
 #include "compilium.h"
 
-#define REG_NULL 0
-
 const char *ILOpTypeName[kNumOfILOpFunc];
 
 void InitILOpTypeName() {
   ILOpTypeName[kILOpAdd] = "Add";
   ILOpTypeName[kILOpSub] = "Sub";
   ILOpTypeName[kILOpMul] = "Mul";
+  ILOpTypeName[kILOpEq] = "Eq";
+  ILOpTypeName[kILOpNotEq] = "NotEq";
+  ILOpTypeName[kILOpLt] = "Lt";
+  ILOpTypeName[kILOpLtEq] = "LtEq";
   ILOpTypeName[kILOpLoadImm] = "LoadImm";
-  ILOpTypeName[kILOpLoadIdent] = "LoadIdent";
-  ILOpTypeName[kILOpFuncBegin] = "FuncBegin";
-  ILOpTypeName[kILOpFuncEnd] = "FuncEnd";
-  ILOpTypeName[kILOpReturn] = "Return";
+  ILOpTypeName[kILOpLoadAddr] = "LoadAddr";
+  ILOpTypeName[kILOpLoadVar] = "LoadVar";
+  ILOpTypeName[kILOpStoreVar] = "StoreVar";
   ILOpTypeName[kILOpCall] = "Call";
+  ILOpTypeName[kILOpPhi] = "Phi";
+  ILOpTypeName[kILOpCopy] = "Copy";
+  ILOpTypeName[kILOpCast] = "Cast";
+  ILOpTypeName[kILOpJump] = "Jump";
+  ILOpTypeName[kILOpBranch] = "Branch";
+  ILOpTypeName[kILOpReturn] = "Return";
 }
 
 const char *GetILOpTypeName(ILOpType type) {
@@ -21,173 +28,558 @@ const char *GetILOpTypeName(ILOpType type) {
   return ILOpTypeName[type];
 }
 
-int GetRegNumber() {
-  static int num = 2;
-  return num++;
+int AddILBlock(ILFunc *func) {
+  if (func->num_of_blocks >= func->blocks_capacity) {
+    int capacity = func->blocks_capacity ? func->blocks_capacity * 2 : 16;
+    func->blocks = ReallocFromArena(&il_arena, func->blocks,
+                                    sizeof(ILBlock) * func->blocks_capacity,
+                                    sizeof(ILBlock) * capacity);
+    func->blocks_capacity = capacity;
+  }
+  memset(&func->blocks[func->num_of_blocks], 0, sizeof(ILBlock));
+  func->blocks[func->num_of_blocks].idom = -1;
+  return func->num_of_blocks++;
+}
+
+static void AddILPred(ILBlock *block, int pred) {
+  if (block->num_of_preds >= block->preds_capacity) {
+    int capacity = block->preds_capacity ? block->preds_capacity * 2 : 4;
+    block->preds = ReallocFromArena(&il_arena, block->preds,
+                                    sizeof(int) * block->preds_capacity,
+                                    sizeof(int) * capacity);
+    block->preds_capacity = capacity;
+  }
+  block->preds[block->num_of_preds++] = pred;
+}
+
+static void AddILEdge(ILFunc *func, int from, int to) {
+  // Edges from unreachable blocks are not added, so a block other than the
+  // entry is reachable iff it has preds. Blocks are connected in the order
+  // they are made, and back edges only come from blocks after their target.
+  ILBlock *src = &func->blocks[from];
+  if (from && !src->num_of_preds) return;
+  if (src->num_of_succs >= 2) Error("AddILEdge: too many succs");
+  src->succs[src->num_of_succs++] = to;
+  AddILPred(&func->blocks[to], from);
+}
+
+int SplitILEdge(ILFunc *func, int from, int succ_index) {
+  // Inserts an empty block on an edge and returns it. The new block takes
+  // the place of from in the preds of the target, so phis stay in order.
+  int mid = AddILBlock(func);
+  ILBlock *src = &func->blocks[from];
+  int to = src->succs[succ_index];
+  src->succs[succ_index] = mid;
+  ILBlock *dst = &func->blocks[to];
+  for (int i = 0; i < dst->num_of_preds; i++) {
+    if (dst->preds[i] == from) dst->preds[i] = mid;
+  }
+  ILBlock *mid_block = &func->blocks[mid];
+  AddILPred(mid_block, from);
+  mid_block->succs[mid_block->num_of_succs++] = to;
+  InsertILInstr(func, mid, 0, kILOpJump, 0);
+  return mid;
+}
+
+ILInstr *InsertILInstr(ILFunc *func, int block_index, int index, ILOpType op,
+                       int dst) {
+  // Inserts an instruction before instrs[index] and returns it.
+  ILBlock *block = &func->blocks[block_index];
+  if (block->num_of_instrs >= block->instrs_capacity) {
+    int capacity = block->instrs_capacity ? block->instrs_capacity * 2 : 8;
+    block->instrs = ReallocFromArena(&il_arena, block->instrs,
+                                     sizeof(ILInstr) * block->instrs_capacity,
+                                     sizeof(ILInstr) * capacity);
+    block->instrs_capacity = capacity;
+  }
+  memmove(&block->instrs[index + 1], &block->instrs[index],
+          sizeof(ILInstr) * (block->num_of_instrs - index));
+  block->num_of_instrs++;
+  ILInstr *instr = &block->instrs[index];
+  memset(instr, 0, sizeof(ILInstr));
+  instr->op = op;
+  instr->dst = dst;
+  return instr;
+}
+
+static ILInstr *AppendILInstr(ILFunc *func, int block_index, ILOpType op,
+                              int dst) {
+  return InsertILInstr(func, block_index,
+                       func->blocks[block_index].num_of_instrs, op, dst);
 }
 
-void GenerateILForCompStmt(ASTList *il, ASTNode *node) {
-  ASTCompStmt *comp = ToASTCompStmt(node);
-  ASTList *stmt_list = comp->stmt_list;
-  for (int i = 0; i < GetSizeOfASTList(stmt_list); i++) {
-    GenerateIL(il, GetASTNodeAt(stmt_list, i));
+ILOperand AddILOperandList(ILFunc *func, const ILOperand *elements,
+                           int count) {
+  ILOperand list = {.kind = kILOperandList};
+  list.list.begin = func->num_of_operands;
+  list.list.count = count;
+  if (!count) return list;
+  if (func->num_of_operands + count > func->operands_capacity) {
+    int capacity = func->operands_capacity ? func->operands_capacity : 16;
+    while (func->num_of_operands + count > capacity) capacity *= 2;
+    func->operands = ReallocFromArena(
+        &il_arena, func->operands,
+        sizeof(ILOperand) * func->operands_capacity,
+        sizeof(ILOperand) * capacity);
+    func->operands_capacity = capacity;
   }
+  memcpy(&func->operands[func->num_of_operands], elements,
+         sizeof(ILOperand) * count);
+  func->num_of_operands += count;
+  return list;
 }
 
-void GenerateILForFuncDef(ASTList *il, ASTNode *node) {
-  ASTFuncDef *def = ToASTFuncDef(node);
-  PushASTNodeToList(
-      il, ToASTNode(AllocAndInitASTILOp(kILOpFuncBegin, REG_NULL, REG_NULL,
-                                        REG_NULL, node)));
-  GenerateILForCompStmt(il, ToASTNode(def->comp_stmt));
-  PushASTNodeToList(il, ToASTNode(AllocAndInitASTILOp(
-                            kILOpFuncEnd, REG_NULL, REG_NULL, REG_NULL, node)));
+static ILOperand RegOperand(int reg) {
+  ILOperand operand = {.kind = kILOperandReg, .reg = reg};
+  return operand;
 }
 
-ASTILOp *GenerateILForExprBinOp(ASTList *il, ASTNode *node) {
-  int dst = REG_NULL;
+static const ILOperand no_operand = {.kind = kILOperandNone};
+
+typedef struct {
+  int *sources;  // blocks that end with a Jump to the target
+  int num_of_sources;
+  int capacity;
+} ILJumpList;
+
+typedef struct {
+  ILJumpList breaks;
+  ILJumpList continues;
+} ILLoop;
+
+typedef struct {
+  ILFunc *func;
+  int block;     // instructions are appended to this block
+  ILLoop *loop;  // the innermost loop, NULL: none
+} ILBuilder;
+
+static int EmitILValue(ILBuilder *b, ILOpType op, ILOperand left,
+                       ILOperand right) {
+  // Returns the virtual register that holds the result.
+  int dst = b->func->num_of_regs++;
+  ILInstr *instr = AppendILInstr(b->func, b->block, op, dst);
+  instr->left = left;
+  instr->right = right;
+  return dst;
+}
+
+static void EmitILInstr(ILBuilder *b, ILOpType op, ILOperand left,
+                        ILOperand right) {
+  ILInstr *instr = AppendILInstr(b->func, b->block, op, 0);
+  instr->left = left;
+  instr->right = right;
+}
+
+static int EmitILTypedValue(ILBuilder *b, ILOpType op, int left, int right,
+                            const Type *type) {
+  int dst = b->func->num_of_regs++;
+  ILInstr *instr = AppendILInstr(b->func, b->block, op, dst);
+  instr->left = RegOperand(left);
+  instr->right = RegOperand(right);
+  instr->type = type;
+  return dst;
+}
+
+static int StartILBlock(ILBuilder *b) {
+  // The current block must be terminated.
+  b->block = AddILBlock(b->func);
+  return b->block;
+}
+
+static int GenerateILForExpr(ILBuilder *b, ASTNode *node);
+
+static int GenerateILForCall(ILBuilder *b, ASTExprBinOp *call) {
+  ASTIdent *func_ident = ToASTIdent(GetASTNode(call->left));
+  if (!func_ident) Error("Calling non-labeled function is not implemented.");
+  ILOperand func = {.kind = kILOperandSym, .token = func_ident->token};
+  ASTList *arg_list = ToASTList(GetASTNode(call->right));
+  if (call->right && !arg_list) Error("arg_list is not an ASTList");
+  int num_of_args = arg_list ? GetSizeOfASTList(arg_list) : 0;
+  ILOperand *args = malloc(sizeof(ILOperand) * (num_of_args + 1));
+  if (!args) Error("Failed to allocate args");
+  for (int i = 0; i < num_of_args; i++) {
+    args[i] = RegOperand(GenerateILForExpr(b, GetASTNodeAt(arg_list, i)));
+  }
+  // Nested calls have added their lists already, so this one is contiguous.
+  ILOperand list = AddILOperandList(b->func, args, num_of_args);
+  free(args);
+  return EmitILValue(b, kILOpCall, func, list);
+}
+
+static const Type *PromoteILType(const Type *type) {
+  // The integer promotions. Addresses are compared as unsigned long.
+  if (type->kind == kTypePointer || type->kind == kTypeArray ||
+      type->kind == kTypeFunc) {
+    return GetIntegerType(kTypeLong, 1);
+  }
+  if (type->kind == kTypeVoid || type->size < 4) {
+    return GetIntegerType(kTypeInt, 0);
+  }
+  return GetIntegerType(type->size == 8 ? kTypeLong : kTypeInt,
+                        type->is_unsigned);
+}
+
+static const Type *GetCommonILType(const Type *left, const Type *right) {
+  // The usual arithmetic conversions of promoted types. long can represent
+  // every unsigned int.
+  if (left->size != right->size) {
+    return left->size > right->size ? left : right;
+  }
+  return left->is_unsigned ? left : right;
+}
+
+static const Type *GetILTypeOfExpr(ASTNode *node) {
+  // Returns the promoted type of the value of node.
+  if (node->type == kASTConstant) {
+    ASTConstant *constant = ToASTConstant(node);
+    if (constant->token->type == kStringLiteral) {
+      return GetIntegerType(kTypeLong, 1);
+    }
+    return GetIntegerType(constant->size == 8 ? kTypeLong : kTypeInt,
+                          constant->is_unsigned);
+  }
+  if (node->type == kASTIdent) {
+    const Var *var = ToASTIdent(node)->var;
+    if (var && (var->kind == kVarParam || var->kind == kVarLocal)) {
+      return PromoteILType(var->type);
+    }
+    // Other identifiers are loaded as addresses.
+    return GetIntegerType(kTypeLong, 1);
+  }
   ASTExprBinOp *bin_op = ToASTExprBinOp(node);
-  ILOpType il_op_type = kILOpNop;
-  if (IsEqualToken(bin_op->op, "+")) {
-    il_op_type = kILOpAdd;
-  } else if (IsEqualToken(bin_op->op, "-")) {
-    il_op_type = kILOpSub;
-  } else if (IsEqualToken(bin_op->op, "*")) {
-    il_op_type = kILOpMul;
-  }
-  if (il_op_type != kILOpNop) {
-    dst = GetRegNumber();
-    int il_left = GenerateIL(il, bin_op->left)->dst_reg;
-    int il_right = GenerateIL(il, bin_op->right)->dst_reg;
-    ASTILOp *il_op =
-        AllocAndInitASTILOp(il_op_type, dst, il_left, il_right, node);
-    PushASTNodeToList(il, ToASTNode(il_op));
-    return il_op;
-  } else if (IsEqualToken(bin_op->op, ",")) {
-    GenerateIL(il, bin_op->left);
-    return GenerateIL(il, bin_op->right);
-  } else if (IsEqualToken(bin_op->op, "(")) {
-    // func_call
-    // call_params = [func_addr: ILOp, arg1: ILOp, arg2: ILOp, ...]
-    ASTList *call_params = AllocASTList(8);
-
-    // func_addr
-    if (bin_op->left->type == kASTIdent) {
-      PushASTNodeToList(call_params, bin_op->left);
-    } else {
-      Error("Calling non-labeled function is not implemented.");
+  if (!bin_op) return GetIntegerType(kTypeInt, 0);
+  ASTNode *left = GetASTNode(bin_op->left);
+  switch (bin_op->op->sym) {
+    case kSymPlus:
+    case kSymMinus:
+    case kSymStar:
+      return GetCommonILType(GetILTypeOfExpr(left),
+                             GetILTypeOfExpr(GetASTNode(bin_op->right)));
+    case kSymAssign:
+      return GetILTypeOfExpr(left);
+    case kSymComma:
+      return GetILTypeOfExpr(GetASTNode(bin_op->right));
+    case kSymLParen: {
+      ASTIdent *func_ident = ToASTIdent(left);
+      const Var *var = func_ident ? func_ident->var : NULL;
+      if (var && var->type->kind == kTypeFunc) {
+        return PromoteILType(var->type->base);
+      }
+    } break;
+  }
+  return GetIntegerType(kTypeInt, 0);
+}
+
+static int GenerateILForExprBinOp(ILBuilder *b, ASTExprBinOp *bin_op) {
+  ILOpType op = kILOpNop;
+  int is_swapped = 0;  // a > b is b < a
+  switch (bin_op->op->sym) {
+    case kSymPlus:
+      op = kILOpAdd;
+      break;
+    case kSymMinus:
+      op = kILOpSub;
+      break;
+    case kSymStar:
+      op = kILOpMul;
+      break;
+    case kSymEq:
+      op = kILOpEq;
+      break;
+    case kSymNotEq:
+      op = kILOpNotEq;
+      break;
+    case kSymLt:
+      op = kILOpLt;
+      break;
+    case kSymLtEq:
+      op = kILOpLtEq;
+      break;
+    case kSymGt:
+      op = kILOpLt;
+      is_swapped = 1;
+      break;
+    case kSymGtEq:
+      op = kILOpLtEq;
+      is_swapped = 1;
+      break;
+  }
+  if (op != kILOpNop) {
+    ASTNode *left_expr = GetASTNode(bin_op->left);
+    ASTNode *right_expr = GetASTNode(bin_op->right);
+    const Type *type = GetCommonILType(GetILTypeOfExpr(left_expr),
+                                       GetILTypeOfExpr(right_expr));
+    int left = GenerateILForExpr(b, left_expr);
+    int right = GenerateILForExpr(b, right_expr);
+    if (is_swapped) return EmitILTypedValue(b, op, right, left, type);
+    return EmitILTypedValue(b, op, left, right, type);
+  }
+  if (IsEqualToken(bin_op->op, kSymAssign)) {
+    ASTIdent *ident = ToASTIdent(GetASTNode(bin_op->left));
+    const Var *var = ident ? ident->var : NULL;
+    if (!var || (var->kind != kVarParam && var->kind != kVarLocal) ||
+        var->type->kind == kTypeArray) {
+      Error("Assignment is only implemented for params and locals.");
     }
+    // The value of an assignment is the value stored.
+    int value = GenerateILForExpr(b, GetASTNode(bin_op->right));
+    ILOperand dst = {.kind = kILOperandVar, .var = var};
+    EmitILInstr(b, kILOpStoreVar, dst, RegOperand(value));
+    return value;
+  }
+  if (IsEqualToken(bin_op->op, kSymComma)) {
+    GenerateILForExpr(b, GetASTNode(bin_op->left));
+    return GenerateILForExpr(b, GetASTNode(bin_op->right));
+  }
+  if (IsEqualToken(bin_op->op, kSymLParen)) {
+    return GenerateILForCall(b, bin_op);
+  }
+  Error("Not implemented GenerateILForExprBinOp (op: %s)",
+        GetTokenStr(bin_op->op));
+  return 0;
+}
 
-    // args
-    if (bin_op->right) {
-      ASTList *arg_list = ToASTList(bin_op->right);
-      if (!arg_list) Error("arg_list is not an ASTList");
-      for (int i = 0; i < GetSizeOfASTList(arg_list); i++) {
-        ASTNode *node = GetASTNodeAt(arg_list, i);
-        PushASTNodeToList(call_params, ToASTNode(GenerateIL(il, node)));
-      }
+static int GenerateILForExpr(ILBuilder *b, ASTNode *node) {
+  // Returns the virtual register that holds the value of node.
+  if (node->type == kASTExprBinOp) {
+    return GenerateILForExprBinOp(b, ToASTExprBinOp(node));
+  }
+  if (node->type == kASTConstant) {
+    ASTConstant *constant = ToASTConstant(node);
+    ILOperand value = {.kind = kILOperandImm, .imm = constant->value};
+    if (constant->token->type == kStringLiteral) {
+      value.kind = kILOperandStr;
+      value.token = constant->token;
     }
-    ASTILOp *il_op_call = AllocAndInitASTILOp(
-        kILOpCall, GetRegNumber(), REG_NULL, REG_NULL, ToASTNode(call_params));
-    PushASTNodeToList(il, ToASTNode(il_op_call));
-    return il_op_call;
-  }
-  Error("Not implemented GenerateILForExprBinOp (op: %s)", bin_op->op->str);
-  return NULL;
-}
-
-ASTILOp *GenerateILForConstant(ASTList *il, ASTNode *node) {
-  int dst = GetRegNumber();
-  ASTILOp *il_op =
-      AllocAndInitASTILOp(kILOpLoadImm, dst, REG_NULL, REG_NULL, node);
-  PushASTNodeToList(il, ToASTNode(il_op));
-  return il_op;
-}
-
-ASTILOp *GenerateILForIdent(ASTList *il, ASTNode *node) {
-  int dst = GetRegNumber();
-  ASTILOp *il_op =
-      AllocAndInitASTILOp(kILOpLoadIdent, dst, REG_NULL, REG_NULL, node);
-  PushASTNodeToList(il, ToASTNode(il_op));
-  return il_op;
-}
-
-ASTILOp *GenerateILForExprStmt(ASTList *il, ASTNode *node) {
-  // https://wiki.osdev.org/System_V_ABI
-  const ASTExprStmt *expr_stmt = ToASTExprStmt(node);
-  return GenerateIL(il, expr_stmt->expr);
-  /*
-  const TokenList *token_list = expr_stmt->expr;
-  if (token_list->used == 1 && token_list->tokens[0]->type == kInteger) {
-    char *p;
-    const char *s = token_list->tokens[0]->str;
-    int var = strtol(s, &p, 0);
-    if (!(s[0] != 0 && *p == 0)) {
-      Error("%s is not valid as integer.", s);
+    return EmitILValue(b, kILOpLoadImm, value, no_operand);
+  }
+  if (node->type == kASTIdent) {
+    ASTIdent *ident = ToASTIdent(node);
+    const Var *var = ident->var;
+    if (var && (var->kind == kVarParam || var->kind == kVarLocal)) {
+      ILOperand src = {.kind = kILOperandVar, .var = var};
+      return EmitILValue(b, kILOpLoadVar, src, no_operand);
     }
-    fprintf(fp, "mov     rax, %d\n", var);
-  } else if (token_list->used == 4 &&
-             IsEqualToken(token_list->tokens[0], "puts") &&
-             IsEqualToken(token_list->tokens[1], "(") &&
-             token_list->tokens[2]->type == kStringLiteral &&
-             IsEqualToken(token_list->tokens[3], ")")) {
-    int label_for_skip = GetLabelNumber();
-    int label_str = GetLabelNumber();
-    fprintf(fp, "jmp L%d\n", label_for_skip);
-    fprintf(fp, "L%d:\n", label_str);
-    fprintf(fp, ".asciz  \"%s\"\n", token_list->tokens[2]->str);
-    fprintf(fp, "L%d:\n", label_for_skip);
-    fprintf(fp, "sub     rsp, 16\n");
-    fprintf(fp, "lea     rdi, [rip + L%d]\n", label_str);
-    fprintf(fp, "call    _%s\n", token_list->tokens[0]->str);
-    fprintf(fp, "add     rsp, 16\n");
-    //Error("GenerateILForExprStmt: puts case ");
+    // Globals and undeclared functions are addressed by name.
+    ILOperand sym = {.kind = kILOperandSym, .token = ident->token};
+    return EmitILValue(b, kILOpLoadAddr, sym, no_operand);
+  }
+  PrintASTNode(node, 0);
+  Error("Generation for AST%s is not implemented.", GetASTTypeName(node));
+  return 0;
+}
+
+static void GenerateILForStmt(ILBuilder *b, ASTNode *node);
+
+static void GenerateILForIfStmt(ILBuilder *b, ASTIfStmt *if_stmt) {
+  int cond = GenerateILForExpr(b, GetASTNode(if_stmt->cond_expr));
+  int cond_block = b->block;
+  EmitILInstr(b, kILOpBranch, RegOperand(cond), no_operand);
+  AddILEdge(b->func, cond_block, StartILBlock(b));
+  GenerateILForStmt(b, GetASTNode(if_stmt->true_stmt));
+  int true_end = b->block;
+  EmitILInstr(b, kILOpJump, no_operand, no_operand);
+  int false_end = cond_block;
+  if (if_stmt->false_stmt) {
+    AddILEdge(b->func, cond_block, StartILBlock(b));
+    GenerateILForStmt(b, GetASTNode(if_stmt->false_stmt));
+    false_end = b->block;
+    EmitILInstr(b, kILOpJump, no_operand, no_operand);
+  }
+  int join = StartILBlock(b);
+  AddILEdge(b->func, true_end, join);
+  AddILEdge(b->func, false_end, join);
+}
+
+static void AddILJump(ILJumpList *list, int block) {
+  if (list->num_of_sources >= list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 4;
+    list->sources = realloc(list->sources, sizeof(int) * list->capacity);
+    if (!list->sources) Error("Failed to allocate ILJumpList");
+  }
+  list->sources[list->num_of_sources++] = block;
+}
 
+static void LinkILJumps(ILFunc *func, ILJumpList *list, int target) {
+  for (int i = 0; i < list->num_of_sources; i++) {
+    AddILEdge(func, list->sources[i], target);
+  }
+  free(list->sources);
+}
 
+static void GenerateILForForStmt(ILBuilder *b, ASTForStmt *for_stmt) {
+  // init; Jump cond
+  // cond: Branch cond, body, exit
+  // body: body; Jump updt
+  // updt: updt; Jump cond
+  // exit:
+  // break jumps to exit, and continue to updt.
+  if (for_stmt->init_expr) {
+    GenerateILForExpr(b, GetASTNode(for_stmt->init_expr));
+  }
+  int entry_end = b->block;
+  EmitILInstr(b, kILOpJump, no_operand, no_operand);
+  int cond_block = StartILBlock(b);
+  AddILEdge(b->func, entry_end, cond_block);
+  if (for_stmt->cond_expr) {
+    int cond = GenerateILForExpr(b, GetASTNode(for_stmt->cond_expr));
+    EmitILInstr(b, kILOpBranch, RegOperand(cond), no_operand);
   } else {
-    Error("GenerateILForExprStmt: Not implemented ");
+    EmitILInstr(b, kILOpJump, no_operand, no_operand);
+  }
+  int cond_end = b->block;
+  AddILEdge(b->func, cond_end, StartILBlock(b));
+  ILLoop loop = {0};
+  ILLoop *outer_loop = b->loop;
+  b->loop = &loop;
+  GenerateILForStmt(b, GetASTNode(for_stmt->body_stmt));
+  b->loop = outer_loop;
+  AddILJump(&loop.continues, b->block);
+  EmitILInstr(b, kILOpJump, no_operand, no_operand);
+  LinkILJumps(b->func, &loop.continues, StartILBlock(b));
+  if (for_stmt->updt_expr) {
+    GenerateILForExpr(b, GetASTNode(for_stmt->updt_expr));
   }
-  */
+  int updt_end = b->block;
+  EmitILInstr(b, kILOpJump, no_operand, no_operand);
+  AddILEdge(b->func, updt_end, cond_block);
+  int exit_block = StartILBlock(b);
+  if (for_stmt->cond_expr) AddILEdge(b->func, cond_end, exit_block);
+  LinkILJumps(b->func, &loop.breaks, exit_block);
 }
 
-ASTILOp *GenerateILForJumpStmt(ASTList *il, ASTNode *node) {
-  ASTJumpStmt *jump_stmt = ToASTJumpStmt(node);
-  if (IsEqualToken(jump_stmt->kw->token, "return")) {
-    int expr_reg = GenerateILForExprStmt(il, jump_stmt->param)->dst_reg;
+static void GenerateILForStmt(ILBuilder *b, ASTNode *node) {
+  if (!node) return;
+  switch (node->type) {
+    case kASTCompStmt: {
+      ASTList *stmt_list =
+          ToASTList(GetASTNode(ToASTCompStmt(node)->stmt_list));
+      for (int i = 0; i < GetSizeOfASTList(stmt_list); i++) {
+        GenerateILForStmt(b, GetASTNodeAt(stmt_list, i));
+      }
+    } break;
+    case kASTExprStmt: {
+      ASTNode *expr = GetASTNode(ToASTExprStmt(node)->expr);
+      if (expr) GenerateILForExpr(b, expr);
+    } break;
+    case kASTJumpStmt: {
+      ASTJumpStmt *jump_stmt = ToASTJumpStmt(node);
+      ASTKeyword *kw = ToASTKeyword(GetASTNode(jump_stmt->kw));
+      if (!IsEqualToken(kw->token, kSymReturn)) {
+        if (!b->loop) {
+          Error("%s is not in a loop (%s)", GetTokenStr(kw->token),
+                GetSourceLocationStr(kw->token->loc));
+        }
+        AddILJump(IsEqualToken(kw->token, kSymBreak) ? &b->loop->breaks
+                                                     : &b->loop->continues,
+                  b->block);
+        EmitILInstr(b, kILOpJump, no_operand, no_operand);
+        StartILBlock(b);
+        break;
+      }
+      ASTExprStmt *expr_stmt = ToASTExprStmt(GetASTNode(jump_stmt->param));
+      ASTNode *expr = GetASTNode(expr_stmt->expr);
+      ILOperand value = no_operand;
+      if (expr) value = RegOperand(GenerateILForExpr(b, expr));
+      EmitILInstr(b, kILOpReturn, value, no_operand);
+      // Code after return is unreachable until a label.
+      StartILBlock(b);
+    } break;
+    case kASTIfStmt:
+      GenerateILForIfStmt(b, ToASTIfStmt(node));
+      break;
+    case kASTForStmt:
+      GenerateILForForStmt(b, ToASTForStmt(node));
+      break;
+    case kASTDecl:
+      // Locals have frame slots; initializers are not implemented yet.
+      break;
+    default:
+      PrintASTNode(node, 0);
+      Error("Generation for AST%s is not implemented.", GetASTTypeName(node));
+  }
+}
+
+ILFunc *GenerateIL(ASTFuncDef *func_def) {
+  // The IL is allocated from il_arena, so the IL of one function is alive at
+  // a time.
+  ILFunc *func = AllocFromArena(&il_arena, sizeof(ILFunc));
+  memset(func, 0, sizeof(ILFunc));
+  func->func_def = func_def;
+  func->num_of_regs = 1;
+  ILBuilder b = {func, AddILBlock(func)};
+  GenerateILForStmt(&b, GetASTNode(func_def->comp_stmt));
+  // Falling off the end of a function returns.
+  EmitILInstr(&b, kILOpReturn, no_operand, no_operand);
+  return func;
+}
 
-    ASTILOp *il_op =
-        AllocAndInitASTILOp(kILOpReturn, REG_NULL, expr_reg, REG_NULL, node);
-    PushASTNodeToList(il, ToASTNode(il_op));
-    return il_op;
+static void PrintILOperand(const ILFunc *func, const ILOperand *operand) {
+  switch (operand->kind) {
+    case kILOperandNone:
+      break;
+    case kILOperandReg:
+      printf(" r%d", operand->reg);
+      break;
+    case kILOperandImm:
+      printf(" %lld", operand->imm);
+      break;
+    case kILOperandVar:
+      printf(" [rbp - %d]", operand->var->offset);
+      break;
+    case kILOperandSym:
+      printf(" %.*s", operand->token->length, operand->token->begin);
+      break;
+    case kILOperandStr:
+      printf(" \"%.*s\"", operand->token->length, operand->token->begin);
+      break;
+    case kILOperandType:
+      printf(" %s%d", operand->type->is_unsigned ? "u" : "i",
+             operand->type->size * 8);
+      break;
+    case kILOperandList:
+      printf(" (");
+      for (int i = 0; i < operand->list.count; i++) {
+        PrintILOperand(func, &func->operands[operand->list.begin + i]);
+      }
+      printf(" )");
+      break;
   }
-  Error("Not implemented JumpStmt (%s)", jump_stmt->kw->token->str);
-  return NULL;
 }
 
-ASTILOp *GenerateIL(ASTList *il, ASTNode *node) {
-  printf("GenerateIL: AST%s...\n", GetASTTypeName(node));
-  if (node->type == kASTList) {
-    // translation-unit
-    ASTList *list = ToASTList(node);
-    for (int i = 0; i < GetSizeOfASTList(list); i++) {
-      ASTNode *child_node = GetASTNodeAt(list, i);
-      if (child_node->type == kASTFuncDef) {
-        GenerateILForFuncDef(il, child_node);
+void PrintILFunc(const ILFunc *func) {
+  printf("IL of %s:\n", GetFuncNameStrFromFuncDef(func->func_def));
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    const ILBlock *block = &func->blocks[i];
+    printf("B%d: preds =", i);
+    for (int k = 0; k < block->num_of_preds; k++) {
+      printf(" B%d", block->preds[k]);
+    }
+    if (i && !block->num_of_preds) printf(" (unreachable)");
+    if (block->idom >= 0) printf(", idom = B%d", block->idom);
+    putchar('\n');
+    for (int k = 0; k < block->num_of_instrs; k++) {
+      const ILInstr *instr = &block->instrs[k];
+      printf("  ");
+      if (instr->dst) printf("r%d = ", instr->dst);
+      printf("%s", GetILOpTypeName(instr->op));
+      if (instr->type) {
+        printf(".%s%d", instr->type->is_unsigned ? "u" : "i",
+               instr->type->size * 8);
       }
+      PrintILOperand(func, &instr->left);
+      PrintILOperand(func, &instr->right);
+      if (instr->op == kILOpJump || instr->op == kILOpBranch) {
+        for (int s = 0; s < block->num_of_succs; s++) {
+          printf(" -> B%d", block->succs[s]);
+        }
+      }
+      putchar('\n');
     }
-    return NULL;
-  } else if (node->type == kASTJumpStmt) {
-    return GenerateILForJumpStmt(il, node);
-  } else if (node->type == kASTExprBinOp) {
-    return GenerateILForExprBinOp(il, node);
-  } else if (node->type == kASTConstant) {
-    return GenerateILForConstant(il, node);
-  } else if (node->type == kASTExprStmt) {
-    return GenerateILForExprStmt(il, node);
-  } else if (node->type == kASTIdent) {
-    return GenerateILForIdent(il, node);
   }
-  PrintASTNode(node, 0);
-  Error("Generation for AST%s is not implemented.", GetASTTypeName(node));
-  return NULL;
+}
+
+void FreeILFunc(ILFunc *func) {
+  // func is the only IL in il_arena.
+  ResetArena(&il_arena);
 }
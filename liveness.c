@@ -0,0 +1,194 @@
+#include "compilium.h"
+
+// Liveness of virtual registers.
+// Registers are renumbered densely after the passes on SSA form, which
+// leave many numbers unused. A register is live at a point if a use of it
+// can be reached from there without passing a def. The sets of registers
+// live at the start and the end of each block are solved backwards over
+// the CFG as bitsets. Each register also gets a single interval of
+// positions that covers all of its defs, uses and the blocks it is live
+// through.
+
+#define BITS_PER_WORD 64
+
+static int TestBit(const unsigned long long *set, int bit) {
+  return (set[bit / BITS_PER_WORD] >> (bit % BITS_PER_WORD)) & 1;
+}
+
+static void SetBit(unsigned long long *set, int bit) {
+  set[bit / BITS_PER_WORD] |= 1ULL << (bit % BITS_PER_WORD);
+}
+
+static void RenumberOperand(ILFunc *func, ILOperand *operand, int *new_reg) {
+  if (operand->kind == kILOperandReg) {
+    if (!new_reg[operand->reg]) new_reg[operand->reg] = func->num_of_regs++;
+    operand->reg = new_reg[operand->reg];
+  } else if (operand->kind == kILOperandList) {
+    for (int i = 0; i < operand->list.count; i++) {
+      RenumberOperand(func, &func->operands[operand->list.begin + i],
+                      new_reg);
+    }
+  }
+}
+
+void RenumberILRegs(ILFunc *func) {
+  // Numbers the registers from 1 in the order they appear.
+  int *new_reg = calloc(func->num_of_regs, sizeof(int));
+  if (!new_reg) Error("Failed to allocate register numbers");
+  func->num_of_regs = 1;
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    ILBlock *block = &func->blocks[i];
+    for (int k = 0; k < block->num_of_instrs; k++) {
+      ILInstr *instr = &block->instrs[k];
+      RenumberOperand(func, &instr->left, new_reg);
+      RenumberOperand(func, &instr->right, new_reg);
+      if (!instr->dst) continue;
+      if (!new_reg[instr->dst]) new_reg[instr->dst] = func->num_of_regs++;
+      instr->dst = new_reg[instr->dst];
+    }
+  }
+  free(new_reg);
+}
+
+static void ExtendInterval(ILInterval *interval, int position) {
+  if (interval->start < 0 || position < interval->start) {
+    interval->start = position;
+  }
+  if (interval->end < position) interval->end = position;
+}
+
+typedef struct {
+  const ILFunc *func;
+  ILLiveness *liveness;
+  unsigned long long *uses;  // read before any def in the block
+  unsigned long long *defs;
+} LivenessBuilder;
+
+static void AddUses(LivenessBuilder *b, int block_index, int position,
+                    const ILOperand *operand) {
+  if (operand->kind == kILOperandReg) {
+    int words = b->liveness->num_of_words;
+    if (!TestBit(&b->defs[block_index * words], operand->reg)) {
+      SetBit(&b->uses[block_index * words], operand->reg);
+    }
+    ExtendInterval(&b->liveness->intervals[operand->reg], position);
+  } else if (operand->kind == kILOperandList) {
+    const ILOperand *elements = &b->func->operands[operand->list.begin];
+    for (int i = 0; i < operand->list.count; i++) {
+      AddUses(b, block_index, position, &elements[i]);
+    }
+  }
+}
+
+static void CollectLocalSets(LivenessBuilder *b) {
+  const ILFunc *func = b->func;
+  ILLiveness *liveness = b->liveness;
+  int position = 0;
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    const ILBlock *block = &func->blocks[i];
+    liveness->block_begin[i] = position;
+    for (int k = 0; k < block->num_of_instrs; k++, position++) {
+      const ILInstr *instr = &block->instrs[k];
+      AddUses(b, i, position, &instr->left);
+      AddUses(b, i, position, &instr->right);
+      if (!instr->dst) continue;
+      SetBit(&b->defs[i * liveness->num_of_words], instr->dst);
+      ExtendInterval(&liveness->intervals[instr->dst], position);
+    }
+  }
+  liveness->block_begin[func->num_of_blocks] = position;
+}
+
+static void SolveLiveSets(LivenessBuilder *b) {
+  // Blocks are mostly numbered in the order of the flow, so going through
+  // them backwards converges quickly.
+  const ILFunc *func = b->func;
+  ILLiveness *liveness = b->liveness;
+  int words = liveness->num_of_words;
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (int i = func->num_of_blocks - 1; i >= 0; i--) {
+      const ILBlock *block = &func->blocks[i];
+      unsigned long long *live_out = &liveness->live_out[i * words];
+      unsigned long long *live_in = &liveness->live_in[i * words];
+      for (int w = 0; w < words; w++) {
+        unsigned long long out = 0;
+        for (int k = 0; k < block->num_of_succs; k++) {
+          out |= liveness->live_in[block->succs[k] * words + w];
+        }
+        unsigned long long in =
+            b->uses[i * words + w] | (out & ~b->defs[i * words + w]);
+        if (in != live_in[w]) changed = 1;
+        live_out[w] = out;
+        live_in[w] = in;
+      }
+    }
+  }
+}
+
+static void ExtendIntervalsToSet(ILInterval *intervals,
+                                 const unsigned long long *set, int words,
+                                 int position) {
+  // Extends the intervals of the registers in set to position.
+  for (int w = 0; w < words; w++) {
+    for (unsigned long long bits = set[w]; bits; bits &= bits - 1) {
+      int reg = w * BITS_PER_WORD + __builtin_ctzll(bits);
+      ExtendInterval(&intervals[reg], position);
+    }
+  }
+}
+
+static void ExtendIntervalsOverBlocks(ILLiveness *liveness,
+                                      const ILFunc *func) {
+  int words = liveness->num_of_words;
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    ExtendIntervalsToSet(liveness->intervals, &liveness->live_in[i * words],
+                         words, liveness->block_begin[i]);
+    ExtendIntervalsToSet(liveness->intervals, &liveness->live_out[i * words],
+                         words, liveness->block_begin[i + 1] - 1);
+  }
+}
+
+ILLiveness *AnalyzeLiveness(const ILFunc *func) {
+  ILLiveness *liveness = malloc(sizeof(ILLiveness));
+  if (!liveness) Error("Failed to allocate ILLiveness");
+  int words = (func->num_of_regs + BITS_PER_WORD - 1) / BITS_PER_WORD;
+  int num_of_words = words * func->num_of_blocks;
+  liveness->num_of_words = words;
+  liveness->live_in = calloc(num_of_words, sizeof(unsigned long long));
+  liveness->live_out = calloc(num_of_words, sizeof(unsigned long long));
+  liveness->block_begin = malloc(sizeof(int) * (func->num_of_blocks + 1));
+  liveness->intervals = malloc(sizeof(ILInterval) * func->num_of_regs);
+  LivenessBuilder b = {
+      .func = func,
+      .liveness = liveness,
+      .uses = calloc(num_of_words, sizeof(unsigned long long)),
+      .defs = calloc(num_of_words, sizeof(unsigned long long)),
+  };
+  if (!liveness->live_in || !liveness->live_out || !liveness->block_begin ||
+      !liveness->intervals || !b.uses || !b.defs) {
+    Error("Failed to allocate ILLiveness");
+  }
+  for (int i = 0; i < func->num_of_regs; i++) {
+    liveness->intervals[i].start = liveness->intervals[i].end = -1;
+  }
+  CollectLocalSets(&b);
+  SolveLiveSets(&b);
+  ExtendIntervalsOverBlocks(liveness, func);
+  free(b.uses);
+  free(b.defs);
+  return liveness;
+}
+
+int IsLiveOut(const ILLiveness *liveness, int block_index, int reg) {
+  return TestBit(&liveness->live_out[block_index * liveness->num_of_words],
+                 reg);
+}
+
+void FreeILLiveness(ILLiveness *liveness) {
+  free(liveness->live_in);
+  free(liveness->live_out);
+  free(liveness->block_begin);
+  free(liveness->intervals);
+  free(liveness);
+}
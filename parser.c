@@ -1,39 +1,148 @@
+#include <pthread.h>
+#include <stdatomic.h>
+
 #include "compilium.h"
 
 ASTExprStmt *ParseExprStmt(TokenList *tokens, int index, int *after_index);
+ASTCompStmt *ParseCompStmt(TokenList *tokens, int index, int *after_index);
+ASTNode *ParseStmt(TokenList *tokens, int index, int *after_index);
 ASTList *ParseDeclSpecs(TokenList *tokens, int index, int *after_index);
 ASTDecltor *ParseDecltor(TokenList *tokens, int index, int *after_index);
 ASTDecl *ParseDecl(TokenList *tokens, int index, int *after_index);
 ASTNode *ParseAssignExpr(TokenList *tokens, int index, int *after_index);
+ASTIdent *ParseIdent(TokenList *tokens, int index, int *after_index);
+
+// The parser is predictive: every choice between alternatives is made by
+// looking at the next token (its FIRST set), so no token is parsed twice.
+// Where a construct can still turn out to be something else after some of
+// it is parsed, its nodes are released with RollbackAST().
+static int IsDeclSpecTokenAt(TokenList *tokens, int index) {
+  // FIRST(declaration-specifiers)
+  switch (GetTokenSymAt(tokens, index)) {
+    case kSymStatic:
+    case kSymExtern:
+    case kSymVoid:
+    case kSymChar:
+    case kSymShort:
+    case kSymInt:
+    case kSymLong:
+    case kSymSigned:
+    case kSymUnsigned:
+    case kSymConst:
+    case kSymInline:
+      return 1;
+  }
+  return 0;
+}
+
+// Name resolution.
+// Identifiers in expressions are resolved while they are parsed. Globals
+// are declared as the translation unit is parsed; params and locals go to a
+// table of the thread that parses the function body, with a scope for each
+// compound statement. Bodies may be parsed after the whole translation unit
+// is skimmed, so a global is only visible after its declaration.
+static ScopeTable *global_scope;
+static _Thread_local ScopeTable *local_scope;
+static _Thread_local Arena var_arena;  // its chunks outlive the thread
+static _Thread_local int frame_size;   // of the function being parsed
+
+static void DeclareVarOfDecltor(ASTDecltor *decltor, const Type *type,
+                                VarKind kind, int declared_at) {
+  const Token *name = GetIdentTokenFromDecltor(decltor);
+  if (!name) return;
+  Var *var = AllocFromArena(&var_arena, sizeof(Var));
+  var->kind = kind;
+  var->offset = 0;
+  var->declared_at = declared_at;
+  var->type = type;
+  if (kind == kVarGlobal) {
+    DeclareVar(global_scope, name->sym, var);  // a redeclaration keeps one
+    return;
+  }
+  if (type->kind == kTypeFunc) {
+    // A function declared in a block is still a global.
+    var->kind = kVarGlobal;
+  } else if (kind == kVarParam) {
+    var->offset = frame_size;  // the caller has reserved the slot
+  } else {
+    if (!type->size) {
+      Error("%s has an incomplete type %s (%s)", GetTokenStr(name),
+            GetTypeStr(type), GetSourceLocationStr(name->loc));
+    }
+    frame_size += type->size;
+    frame_size = (frame_size + type->align - 1) / type->align * type->align;
+    var->offset = frame_size;
+  }
+  if (!DeclareVar(local_scope, name->sym, var)) {
+    Error("Redeclaration of %s (%s)", GetTokenStr(name),
+          GetSourceLocationStr(name->loc));
+  }
+}
+
+static void DeclareVarsOfDecl(ASTDecl *decl, VarKind kind, int declared_at) {
+  const Type *base =
+      GetTypeOfDeclSpecs(ToASTList(GetASTNode(decl->decl_specs)));
+  ASTList *init_decltors = ToASTList(GetASTNode(decl->init_decltors));
+  for (int i = 0; i < GetSizeOfASTList(init_decltors); i++) {
+    ASTDecltor *decltor = ToASTDecltor(GetASTNodeAt(init_decltors, i));
+    DeclareVarOfDecltor(decltor, GetTypeOfDecltor(base, decltor), kind,
+                        declared_at);
+  }
+}
+
+static void ResolveIdent(ASTIdent *ident, int index) {
+  const Var *var = NULL;
+  if (local_scope) var = LookupVar(local_scope, ident->token->sym);
+  if (!var && global_scope) {
+    var = LookupVar(global_scope, ident->token->sym);
+    if (var && var->declared_at >= index) var = NULL;
+  }
+  ident->var = var;
+}
 
-#define MAX_NUM_OF_NODES_IN_COMMA_SEPARATED_LIST 8
 ASTList *ParseCommaSeparatedList(TokenList *tokens, int index, int *after_index,
                                  ASTNode *(elem_parser)(TokenList *tokens,
                                                         int index,
                                                         int *after_index)) {
-  ASTList *list = AllocASTList(MAX_NUM_OF_NODES_IN_COMMA_SEPARATED_LIST);
+  ASTList *list = AllocASTList();
   ASTNode *node;
-  const Token *token;
   for (;;) {
     node = elem_parser(tokens, index, &index);
     if (!node) break;
     *after_index = index;
     PushASTNodeToList(list, node);
 
-    token = GetTokenAt(tokens, index++);
-    if (!IsEqualToken(token, ",")) break;
+    if (!IsEqualTokenAt(tokens, index++, kSymComma)) break;
   }
   return list;
 }
 
+ASTNode *ParseExpression(TokenList *tokens, int index, int *after_index);
+
 ASTNode *ParsePrimaryExpr(TokenList *tokens, int index, int *after_index) {
+  // primary-expression
   const Token *token = GetTokenAt(tokens, index++);
-  if (token->type == kInteger || token->type == kStringLiteral) {
+  if (!token) return NULL;
+  if (token->type == kInteger || token->type == kCharacterLiteral ||
+      token->type == kStringLiteral) {
     *after_index = index;
-    return AllocAndInitASTConstant(token);
+    return AllocAndInitASTConstant(RetainToken(tokens, token));
   } else if (token->type == kIdentifier) {
+    ASTIdent *ident = AllocAndInitASTIdent(RetainToken(tokens, token));
+    ResolveIdent(ident, index - 1);
+    *after_index = index;
+    return ToASTNode(ident);
+  } else if (IsEqualToken(token, kSymLParen)) {
+    // TODO: Impl cast-expression (a type-name follows the paren)
+    if (IsDeclSpecTokenAt(tokens, index)) return NULL;
+    ASTCheckpoint checkpoint = GetASTCheckpoint();
+    ASTNode *expr = ParseExpression(tokens, index, &index);
+    if (!expr || !IsEqualTokenAt(tokens, index++, kSymRParen)) {
+      RollbackAST(checkpoint);
+      return NULL;
+    }
     *after_index = index;
-    return ToASTNode(AllocAndInitASTIdent(token));
+    return expr;
   }
   return NULL;
 }
@@ -45,68 +154,144 @@ ASTNode *ParsePostExpr(TokenList *tokens, int index, int *after_index) {
   last = ParsePrimaryExpr(tokens, index, &index);
   *after_index = index;
   if (!last) return NULL;
+  ASTCheckpoint checkpoint;
   for (;;) {
+    // A suffix that fails to parse is not a part of this expression.
+    checkpoint = GetASTCheckpoint();
     op = GetTokenAt(tokens, index++);
-    if (IsEqualToken(op, "(")) {
+    if (!op) break;
+    if (op->sym == kSymLParen) {
+      op = RetainToken(tokens, op);
       ASTList *arg_expr_list =
           ParseCommaSeparatedList(tokens, index, &index, ParseAssignExpr);
-      if (!IsEqualToken(GetTokenAt(tokens, index++), ")")) break;
+      if (!IsEqualTokenAt(tokens, index++, kSymRParen)) break;
       last = AllocAndInitASTExprBinOp(op, last, ToASTNode(arg_expr_list));
-      *after_index = index;
-      continue;
+    } else if (op->sym == kSymLBracket) {
+      op = RetainToken(tokens, op);
+      ASTNode *subscript = ParseExpression(tokens, index, &index);
+      if (!subscript || !IsEqualTokenAt(tokens, index++, kSymRBracket)) break;
+      last = AllocAndInitASTExprBinOp(op, last, subscript);
+    } else if (op->sym == kSymDot || op->sym == kSymArrow) {
+      op = RetainToken(tokens, op);
+      ASTIdent *member = ParseIdent(tokens, index, &index);
+      if (!member) break;
+      last = AllocAndInitASTExprBinOp(op, last, ToASTNode(member));
+    } else if (op->sym == kSymInc || op->sym == kSymDec) {
+      last = AllocAndInitASTExprUnaryPostOp(RetainToken(tokens, op), last);
+    } else {
+      break;
     }
-    break;
+    *after_index = index;
   }
+  RollbackAST(checkpoint);
   return last;
 }
 
 ASTNode *ParseUnaryExpr(TokenList *tokens, int index, int *after_index) {
+  // unary-expression
+  // TODO: Impl sizeof ( type-name )
+  const Token *op = GetTokenAt(tokens, index);
+  if (!op) return NULL;
+  switch (op->sym) {
+    case kSymInc:
+    case kSymDec:
+    case kSymAnd:
+    case kSymStar:
+    case kSymPlus:
+    case kSymMinus:
+    case kSymTilde:
+    case kSymNot:
+    case kSymSizeof: {
+      // Parsing the operand may move the tokens of a stream.
+      op = RetainToken(tokens, op);
+      ASTNode *expr = ParseUnaryExpr(tokens, index + 1, &index);
+      if (!expr) return NULL;
+      *after_index = index;
+      return AllocAndInitASTExprUnaryPreOp(op, expr);
+    }
+  }
   return ParsePostExpr(tokens, index, after_index);
 }
 
-ASTNode *ParseCastExpr(TokenList *tokens, int index, int *after_index) {
-  return ParseUnaryExpr(tokens, index, after_index);
-}
+// Precedence of binary operators, including ?: and assignments.
+// A larger value binds tighter; 0 is not a binary operator.
+#define PRECEDENCE_COMMA 1
+#define PRECEDENCE_ASSIGN 2
+#define PRECEDENCE_COND 3
+static const unsigned char binary_op_precedence[kNumOfPredefinedSymbols] = {
+    [kSymComma] = PRECEDENCE_COMMA,
+    [kSymAssign] = PRECEDENCE_ASSIGN,
+    [kSymMulAssign] = PRECEDENCE_ASSIGN,
+    [kSymDivAssign] = PRECEDENCE_ASSIGN,
+    [kSymModAssign] = PRECEDENCE_ASSIGN,
+    [kSymAddAssign] = PRECEDENCE_ASSIGN,
+    [kSymSubAssign] = PRECEDENCE_ASSIGN,
+    [kSymShlAssign] = PRECEDENCE_ASSIGN,
+    [kSymShrAssign] = PRECEDENCE_ASSIGN,
+    [kSymAndAssign] = PRECEDENCE_ASSIGN,
+    [kSymXorAssign] = PRECEDENCE_ASSIGN,
+    [kSymOrAssign] = PRECEDENCE_ASSIGN,
+    [kSymQuestion] = PRECEDENCE_COND,
+    [kSymLogicalOr] = 4,
+    [kSymLogicalAnd] = 5,
+    [kSymOr] = 6,
+    [kSymXor] = 7,
+    [kSymAnd] = 8,
+    [kSymEq] = 9,
+    [kSymNotEq] = 9,
+    [kSymLt] = 10,
+    [kSymGt] = 10,
+    [kSymLtEq] = 10,
+    [kSymGtEq] = 10,
+    [kSymShl] = 11,
+    [kSymShr] = 11,
+    [kSymPlus] = 12,
+    [kSymMinus] = 12,
+    [kSymStar] = 13,
+    [kSymSlash] = 13,
+    [kSymPercent] = 13,
+};
 
-ASTNode *ParseMultiplicativeExpr(TokenList *tokens, int index,
-                                 int *after_index) {
-  // multiplicative-expression
-  ASTNode *last = NULL;
-  ASTNode *node = NULL;
-  const Token *op = NULL;
-  while ((node = ParseCastExpr(tokens, index, &index))) {
-    if (!last) {
-      last = node;
-    } else {
-      last = AllocAndInitASTExprBinOp(op, last, node);
-    }
-    op = GetTokenAt(tokens, index);
-    if (!IsEqualToken(op, "*") && !IsEqualToken(op, "/") &&
-        !IsEqualToken(op, "%")) {
-      break;
-    }
-    index++;
-  }
-  *after_index = index;
-  return last;
+static int GetBinaryOpPrecedence(int sym) {
+  if (sym < 0 || kNumOfPredefinedSymbols <= sym) return 0;
+  return binary_op_precedence[sym];
 }
 
-ASTNode *ParseAdditiveExpr(TokenList *tokens, int index, int *after_index) {
-  // additive-expression
-  ASTNode *last = NULL;
-  ASTNode *node = NULL;
-  const Token *op = NULL;
-  while ((node = ParseMultiplicativeExpr(tokens, index, &index))) {
-    if (!last) {
-      last = node;
-    } else {
-      last = AllocAndInitASTExprBinOp(op, last, node);
+static ASTNode *ParseBinaryExpr(TokenList *tokens, int index, int *after_index,
+                                int min_precedence) {
+  // Precedence climbing: parses operators that bind at least as tight as
+  // min_precedence. Assignments and ?: are right-associative.
+  ASTNode *last = ParseUnaryExpr(tokens, index, &index);
+  if (!last) return NULL;
+  for (;;) {
+    int precedence = GetBinaryOpPrecedence(GetTokenSymAt(tokens, index));
+    if (!precedence || precedence < min_precedence) break;
+    const Token *op = RetainToken(tokens, GetTokenAt(tokens, index++));
+    if (precedence == PRECEDENCE_COND) {
+      // conditional-expression:
+      //   logical-OR-expression ? expression : conditional-expression
+      ASTNode *true_expr = ParseExpression(tokens, index, &index);
+      if (!true_expr || !IsEqualTokenAt(tokens, index++, kSymColon)) {
+        Error("Expected : for ? (%s)", GetSourceLocationStr(op->loc));
+      }
+      ASTNode *false_expr =
+          ParseBinaryExpr(tokens, index, &index, PRECEDENCE_COND);
+      if (!false_expr) {
+        Error("Expected an expression after : (%s)",
+              GetSourceLocationStr(op->loc));
+      }
+      last = AllocAndInitASTCondExpr(last, true_expr, false_expr);
+      continue;
     }
-    op = GetTokenAt(tokens, index);
-    if (!IsEqualToken(op, "+") && !IsEqualToken(op, "-")) {
-      break;
+    int is_right_assoc = precedence == PRECEDENCE_ASSIGN;
+    ASTNode *right = ParseBinaryExpr(tokens, index, &index,
+                                     is_right_assoc ? precedence
+                                                    : precedence + 1);
+    if (!right) {
+      Error("Expected an expression after %s (%s)", GetTokenStr(op),
+            GetSourceLocationStr(op->loc));
     }
-    index++;
+    last = AllocAndInitASTExprBinOp(op, last, right);
   }
   *after_index = index;
   return last;
@@ -114,88 +299,99 @@ ASTNode *ParseAdditiveExpr(TokenList *tokens, int index, int *after_index) {
 
 ASTNode *ParseAssignExpr(TokenList *tokens, int index, int *after_index) {
   // assignment-expression
-  ASTNode *last = NULL;
-  ASTNode *node = NULL;
-  const Token *op = NULL;
-  // TODO: ParseAdditiveExpr -> ParseCondExpr
-  while ((node = ParseAdditiveExpr(tokens, index, &index))) {
-    if (!last) {
-      last = node;
-    } else {
-      last = AllocAndInitASTExprBinOp(op, last, node);
-    }
-    op = GetTokenAt(tokens, index);
-    if (!IsEqualToken(op, "=") && !IsEqualToken(op, "*=")) {
-      break;
-    }
-    index++;
-  }
-  *after_index = index;
-  return last;
+  return ParseBinaryExpr(tokens, index, after_index, PRECEDENCE_ASSIGN);
 }
 
-#define MAX_NODES_IN_EXPR 64
 ASTNode *ParseExpression(TokenList *tokens, int index, int *after_index) {
   // expression
-  ASTNode *last = NULL;
-  ASTNode *node = NULL;
-  const Token *op = NULL;
-  while ((node = ParseAssignExpr(tokens, index, &index))) {
-    if (!last) {
-      last = node;
-    } else {
-      last = AllocAndInitASTExprBinOp(op, last, node);
-    }
-    op = GetTokenAt(tokens, index);
-    if (!IsEqualToken(op, ",")) {
-      break;
-    }
-    index++;
+  return ParseBinaryExpr(tokens, index, after_index, PRECEDENCE_COMMA);
+}
+
+ASTNode *ParseSelectionStmt(TokenList *tokens, int index,
+                            int *after_index) {
+  // selection-statement:
+  //   if ( expression ) statement
+  //   if ( expression ) statement else statement
+  if (!IsEqualTokenAt(tokens, index++, kSymIf)) return NULL;
+  if (!IsEqualTokenAt(tokens, index++, kSymLParen)) return NULL;
+  ASTNode *cond_expr = ParseExpression(tokens, index, &index);
+  if (!cond_expr || !IsEqualTokenAt(tokens, index++, kSymRParen)) return NULL;
+  ASTNode *true_stmt = ParseStmt(tokens, index, &index);
+  if (!true_stmt) return NULL;
+  ASTNode *false_stmt = NULL;
+  if (IsEqualTokenAt(tokens, index, kSymElse)) {
+    false_stmt = ParseStmt(tokens, index + 1, &index);
+    if (!false_stmt) return NULL;
   }
+  ASTIfStmt *if_stmt = AllocASTIfStmt();
+  if_stmt->cond_expr = GetASTHandle(cond_expr);
+  if_stmt->true_stmt = GetASTHandle(true_stmt);
+  if_stmt->false_stmt = GetASTHandle(false_stmt);
   *after_index = index;
-  return last;
+  return ToASTNode(if_stmt);
 }
 
-/*
-ASTNode *TryReadForStatement(TokenList *tokens, int index, int *after_index) {
-  // 6.8.5.3
-  // for ( expression(opt) ; expression(opt) ; expression(opt) ) statement:
-
-  if (!IsEqualToken(GetTokenAt(tokens, index++), "for")) return NULL;
-  if (!IsEqualToken(GetTokenAt(tokens, index++), "(")) return NULL;
-  ASTNode *init_expr = ReadExpression(tokens, index, &index);
-  if (!IsEqualToken(GetTokenAt(tokens, index++), ";")) return NULL;
-  ASTNode *cond_expr = ReadExpression(tokens, index, &index);
-  if (!IsEqualToken(GetTokenAt(tokens, index++), ";")) return NULL;
-  ASTNode *updt_expr = ReadExpression(tokens, index, &index);
-  if (!IsEqualToken(GetTokenAt(tokens, index++), ")")) return NULL;
-  ASTNode *body_comp_stmt = TryReadCompoundStatement(tokens, index, &index);
-  if (!body_comp_stmt) {
-    Error("TryReadForStatement: body_comp_stmt is null");
+ASTNode *ParseIterationStmt(TokenList *tokens, int index, int *after_index) {
+  // iteration-statement:
+  //   while ( expression ) statement
+  //   for ( expression(opt) ; expression(opt) ; expression(opt) ) statement
+  // A while loop is a for loop without init_expr and updt_expr.
+  ASTNode *init_expr = NULL;
+  ASTNode *cond_expr = NULL;
+  ASTNode *updt_expr = NULL;
+  int is_for = IsEqualTokenAt(tokens, index++, kSymFor);
+  if (!IsEqualTokenAt(tokens, index++, kSymLParen)) return NULL;
+  if (is_for) {
+    init_expr = ParseExpression(tokens, index, &index);
+    if (!IsEqualTokenAt(tokens, index++, kSymSemicolon)) return NULL;
+    cond_expr = ParseExpression(tokens, index, &index);
+    if (!IsEqualTokenAt(tokens, index++, kSymSemicolon)) return NULL;
+    updt_expr = ParseExpression(tokens, index, &index);
+  } else {
+    cond_expr = ParseExpression(tokens, index, &index);
+    if (!cond_expr) return NULL;
   }
+  if (!IsEqualTokenAt(tokens, index++, kSymRParen)) return NULL;
+  ASTNode *body_stmt = ParseStmt(tokens, index, &index);
+  if (!body_stmt) return NULL;
   ASTForStmt *for_stmt = AllocASTForStmt();
-  for_stmt->init_expr = init_expr;
-  for_stmt->cond_expr = cond_expr;
-  for_stmt->updt_expr = updt_expr;
-  for_stmt->body_comp_stmt = body_comp_stmt;
+  for_stmt->init_expr = GetASTHandle(init_expr);
+  for_stmt->cond_expr = GetASTHandle(cond_expr);
+  for_stmt->updt_expr = GetASTHandle(updt_expr);
+  for_stmt->body_stmt = GetASTHandle(body_stmt);
   *after_index = index;
   return ToASTNode(for_stmt);
 }
-*/
+
 ASTNode *ParseJumpStmt(TokenList *tokens, int index, int *after_index) {
   const Token *token;
   token = GetTokenAt(tokens, index);
-  if (IsEqualToken(token, "return")) {
-    // jump-statement(return)
-    ASTNode *expr_stmt =
-        ToASTNode(ParseExprStmt(tokens, index + 1, after_index));
-    if (!expr_stmt) return NULL;
-    ASTKeyword *kw = AllocASTKeyword();
-    kw->token = token;
-    ASTJumpStmt *return_stmt = AllocASTJumpStmt();
-    return_stmt->kw = kw;
-    return_stmt->param = expr_stmt;
-    return ToASTNode(return_stmt);
+  if (!token) return NULL;
+  switch (token->sym) {
+    case kSymReturn: {
+      // jump-statement(return)
+      token = RetainToken(tokens, token);
+      ASTNode *expr_stmt =
+          ToASTNode(ParseExprStmt(tokens, index + 1, after_index));
+      if (!expr_stmt) return NULL;
+      ASTKeyword *kw = AllocASTKeyword();
+      kw->token = token;
+      ASTJumpStmt *return_stmt = AllocASTJumpStmt();
+      return_stmt->kw = GetASTHandle(kw);
+      return_stmt->param = GetASTHandle(expr_stmt);
+      return ToASTNode(return_stmt);
+    }
+    case kSymBreak:
+    case kSymContinue: {
+      // jump-statement(break, continue)
+      if (!IsEqualTokenAt(tokens, index + 1, kSymSemicolon)) return NULL;
+      ASTKeyword *kw = AllocASTKeyword();
+      kw->token = RetainToken(tokens, token);
+      ASTJumpStmt *jump_stmt = AllocASTJumpStmt();
+      jump_stmt->kw = GetASTHandle(kw);
+      *after_index = index + 2;
+      return ToASTNode(jump_stmt);
+    }
   }
   return NULL;
 }
@@ -209,26 +405,33 @@ ASTNode *ParseStmt(TokenList *tokens, int index, int *after_index) {
   //   selection-statement
   //   iteration-statement
   //   jump-statement
-  ASTNode *statement;
-  if ((statement = ParseJumpStmt(tokens, index, after_index)) ||
-      //(statement = TryReadForStatement(tokens, index, after_index)) ||
-      (statement = ToASTNode(ParseExprStmt(tokens, index, after_index))))
-    return statement;
-  return NULL;
+  switch (GetTokenSymAt(tokens, index)) {
+    case kSymLBrace:
+      return ToASTNode(ParseCompStmt(tokens, index, after_index));
+    case kSymIf:
+      return ParseSelectionStmt(tokens, index, after_index);
+    case kSymWhile:
+    case kSymFor:
+      return ParseIterationStmt(tokens, index, after_index);
+    case kSymReturn:
+    case kSymBreak:
+    case kSymContinue:
+      return ParseJumpStmt(tokens, index, after_index);
+  }
+  return ToASTNode(ParseExprStmt(tokens, index, after_index));
 }
 
 ASTExprStmt *ParseExprStmt(TokenList *tokens, int index, int *after_index) {
   // expression-statement:
   //   expression ;
   ASTNode *expr = ParseExpression(tokens, index, &index);
-  if (!IsEqualToken(GetTokenAt(tokens, index++), ";")) return NULL;
+  if (!IsEqualTokenAt(tokens, index++, kSymSemicolon)) return NULL;
   ASTExprStmt *expr_stmt = AllocASTExprStmt();
-  expr_stmt->expr = expr;
+  expr_stmt->expr = GetASTHandle(expr);
   *after_index = index;
   return expr_stmt;
 }
 
-#define MAX_NUM_OF_STATEMENTS_IN_BLOCK 64
 ASTCompStmt *ParseCompStmt(TokenList *tokens, int index, int *after_index) {
   // 6.8.2
   // compound-statement:
@@ -237,21 +440,29 @@ ASTCompStmt *ParseCompStmt(TokenList *tokens, int index, int *after_index) {
   // block-item:
   //   declaration
   //   statement
-  if (!IsEqualToken(GetTokenAt(tokens, index++), "{")) return NULL;
+  if (!IsEqualTokenAt(tokens, index++, kSymLBrace)) return NULL;
   //
-  ASTList *stmt_list = AllocASTList(MAX_NUM_OF_STATEMENTS_IN_BLOCK);
+  ASTList *stmt_list = AllocASTList();
   ASTNode *stmt;
-  while (!IsEqualToken(GetTokenAt(tokens, index), "}")) {
-    stmt = ToASTNode(ParseDecl(tokens, index, &index));
-    if (!stmt) stmt = ParseStmt(tokens, index, &index);
+  PushScope(local_scope);
+  while (!IsEqualTokenAt(tokens, index, kSymRBrace)) {
+    CommitTokens(tokens, index);
+    if (IsDeclSpecTokenAt(tokens, index)) {
+      ASTDecl *decl = ParseDecl(tokens, index, &index);
+      if (decl) DeclareVarsOfDecl(decl, kVarLocal, index);
+      stmt = ToASTNode(decl);
+    } else {
+      stmt = ParseStmt(tokens, index, &index);
+    }
     if (!stmt) break;
     PushASTNodeToList(stmt_list, stmt);
   }
+  PopScope(local_scope);
   ASTCompStmt *comp_stmt = AllocASTCompStmt();
-  comp_stmt->stmt_list = stmt_list;
+  comp_stmt->stmt_list = GetASTHandle(stmt_list);
   //
-  if (!IsEqualToken(GetTokenAt(tokens, index), "}")) {
-    Error("Expected } but got %s", GetTokenAt(tokens, index)->str);
+  if (!IsEqualTokenAt(tokens, index, kSymRBrace)) {
+    Error("Expected } but got %s", GetTokenStr(GetTokenAt(tokens, index)));
   }
   index++;
   //
@@ -263,11 +474,11 @@ ASTIdent *ParseIdent(TokenList *tokens, int index, int *after_index) {
   const Token *token;
   ASTIdent *ident;
   token = GetTokenAt(tokens, index++);
-  if (token->type != kIdentifier) {
+  if (!token || token->type != kIdentifier) {
     return NULL;
   }
   ident = AllocASTIdent();
-  ident->token = token;
+  ident->token = RetainToken(tokens, token);
   *after_index = index;
   return ident;
 }
@@ -282,15 +493,14 @@ ASTList *ParseIdentList(TokenList *tokens, int index, int *after_index) {
 
 ASTParamDecl *ParseParamDecl(TokenList *tokens, int index, int *after_index) {
   // parameter-declaration
-  // TODO: Impl abstract case.
+  // TODO: Impl abstract-declarator case.
   ASTList *decl_specs = ParseDeclSpecs(tokens, index, &index);
   if (!decl_specs) return NULL;
-  ASTDecltor *decltor = ParseDecltor(tokens, index, &index);
-  if (!decltor) return NULL;
+  ASTDecltor *decltor = ParseDecltor(tokens, index, &index);  // optional
 
   ASTParamDecl *param_decl = AllocASTParamDecl();
-  param_decl->decl_specs = decl_specs;
-  param_decl->decltor = ToASTNode(decltor);
+  param_decl->decl_specs = GetASTHandle(decl_specs);
+  param_decl->decltor = GetASTHandle(decltor);
 
   *after_index = index;
   return param_decl;
@@ -315,11 +525,12 @@ ASTList *ParseParamTypeList(TokenList *tokens, int index, int *after_index) {
   const Token *token;
   token = GetTokenAt(tokens, index++);
   PrintToken(token);
-  if (!IsEqualToken(token, ",")) return list;
+  if (!IsEqualToken(token, kSymComma)) return list;
   token = GetTokenAt(tokens, index++);
   PrintToken(token);
-  if (!IsEqualToken(token, "...")) return list;
-  PushASTNodeToList(list, ToASTNode(AllocAndInitASTKeyword(token)));
+  if (!IsEqualToken(token, kSymEllipsis)) return list;
+  PushASTNodeToList(
+      list, ToASTNode(AllocAndInitASTKeyword(RetainToken(tokens, token))));
   *after_index = index;
   return list;
 }
@@ -335,34 +546,56 @@ ASTDirectDecltor *ParseDirectDecltor(TokenList *tokens, int index,
       if (last_direct_decltor) break;
       //
       ASTIdent *ident = AllocASTIdent();
-      ident->token = token;
+      ident->token = RetainToken(tokens, token);
       //
       ASTDirectDecltor *direct_decltor = AllocASTDirectDecltor();
-      direct_decltor->direct_decltor = last_direct_decltor;
-      direct_decltor->data = ToASTNode(ident);
+      direct_decltor->direct_decltor = GetASTHandle(last_direct_decltor);
+      direct_decltor->data = GetASTHandle(ident);
       last_direct_decltor = direct_decltor;
       //
       index++;
       continue;
     } else if (token->type == kPunctuator) {
-      if (IsEqualToken(token, "(")) {
-        index++;
-        //
+      if (IsEqualToken(token, kSymLParen) && last_direct_decltor) {
+        int list_index = index + 1;
+        ASTCheckpoint checkpoint = GetASTCheckpoint();
         ASTList *list;
-        list = ParseParamTypeList(tokens, index, &index);
-        if (!list) list = ParseIdentList(tokens, index, &index);
-        // Identlist can be null
-        token = GetTokenAt(tokens, index);
-        if (IsEqualToken(token, ")")) {
-          if (!last_direct_decltor) break;
-          index++;
+        if (IsDeclSpecTokenAt(tokens, list_index)) {
+          list = ParseParamTypeList(tokens, list_index, &list_index);
+        } else {
+          // Identlist can be empty
+          list = ParseIdentList(tokens, list_index, &list_index);
+        }
+        if (IsEqualTokenAt(tokens, list_index, kSymRParen)) {
+          index = list_index + 1;
+          //
+          ASTDirectDecltor *direct_decltor = AllocASTDirectDecltor();
+          direct_decltor->direct_decltor = GetASTHandle(last_direct_decltor);
+          direct_decltor->data = GetASTHandle(list);
+          last_direct_decltor = direct_decltor;
+          continue;
+        }
+        RollbackAST(checkpoint);
+      } else if (IsEqualToken(token, kSymLBracket) && last_direct_decltor) {
+        // The length of an array is optional; data is NULL without it.
+        // TODO: Impl constant expressions as the length
+        int length_index = index + 1;
+        ASTCheckpoint checkpoint = GetASTCheckpoint();
+        ASTNode *length = NULL;
+        if (GetTokenTypeAt(tokens, length_index) == kInteger) {
+          length = AllocAndInitASTConstant(
+              RetainToken(tokens, GetTokenAt(tokens, length_index++)));
+        }
+        if (IsEqualTokenAt(tokens, length_index, kSymRBracket)) {
+          index = length_index + 1;
           //
           ASTDirectDecltor *direct_decltor = AllocASTDirectDecltor();
-          direct_decltor->direct_decltor = last_direct_decltor;
-          direct_decltor->data = ToASTNode(list);
+          direct_decltor->direct_decltor = GetASTHandle(last_direct_decltor);
+          direct_decltor->data = GetASTHandle(length);
           last_direct_decltor = direct_decltor;
           continue;
         }
+        RollbackAST(checkpoint);
       }
     }
     break;
@@ -373,10 +606,10 @@ ASTDirectDecltor *ParseDirectDecltor(TokenList *tokens, int index,
 
 ASTPointer *ParsePointer(TokenList *tokens, int index, int *after_index) {
   const Token *token = GetTokenAt(tokens, index++);
-  if (!IsEqualToken(token, "*")) return NULL;
+  if (!IsEqualToken(token, kSymStar)) return NULL;
   // TODO: impl type-qual-list(opt)
   ASTPointer *pointer = AllocASTPointer();
-  pointer->pointer = ParsePointer(tokens, index, &index);
+  pointer->pointer = GetASTHandle(ParsePointer(tokens, index, &index));
   *after_index = index;
   return pointer;
 }
@@ -389,8 +622,8 @@ ASTDecltor *ParseDecltor(TokenList *tokens, int index, int *after_index) {
     return NULL;
   }
   ASTDecltor *decltor = AllocASTDecltor();
-  decltor->pointer = pointer;
-  decltor->direct_decltor = direct_decltor;
+  decltor->pointer = GetASTHandle(pointer);
+  decltor->direct_decltor = GetASTHandle(direct_decltor);
   *after_index = index;
   return decltor;
 }
@@ -404,39 +637,78 @@ ASTNode *ParseTypeSpec(TokenList *tokens, int index, int *after_index) {
   // ASTKeyword | ASTSpec
   // TODO: Impl struct cases (ASTSpec)
   const Token *token = GetTokenAt(tokens, index++);
-  if (IsEqualToken(token, "int") || IsEqualToken(token, "char")) {
-    ASTKeyword *kw = AllocASTKeyword();
-    kw->token = token;
+  if (!IsTypeToken(token)) return NULL;
+  ASTKeyword *kw = AllocASTKeyword();
+  kw->token = RetainToken(tokens, token);
 
-    *after_index = index;
-    return ToASTNode(kw);
-  }
-  return NULL;
+  *after_index = index;
+  return ToASTNode(kw);
 }
 
 ASTKeyword *ParseTypeQual(TokenList *tokens, int index, int *after_index) {
   // type-qualifier
   // ASTKeyword
   const Token *token = GetTokenAt(tokens, index++);
-  if (IsEqualToken(token, "const")) {
-    ASTKeyword *kw = AllocASTKeyword();
-    kw->token = token;
+  if (!token) return NULL;
+  switch (token->sym) {
+    case kSymConst: {
+      ASTKeyword *kw = AllocASTKeyword();
+      kw->token = RetainToken(tokens, token);
 
-    *after_index = index;
-    return kw;
+      *after_index = index;
+      return kw;
+    }
+  }
+  return NULL;
+}
+
+ASTKeyword *ParseStorageClassSpec(TokenList *tokens, int index,
+                                  int *after_index) {
+  // storage-class-specifier
+  // ASTKeyword
+  const Token *token = GetTokenAt(tokens, index++);
+  if (!token) return NULL;
+  switch (token->sym) {
+    case kSymStatic:
+    case kSymExtern: {
+      ASTKeyword *kw = AllocASTKeyword();
+      kw->token = RetainToken(tokens, token);
+
+      *after_index = index;
+      return kw;
+    }
+  }
+  return NULL;
+}
+
+ASTKeyword *ParseFuncSpec(TokenList *tokens, int index, int *after_index) {
+  // function-specifier
+  // ASTKeyword
+  const Token *token = GetTokenAt(tokens, index++);
+  if (!token) return NULL;
+  switch (token->sym) {
+    case kSymInline: {
+      ASTKeyword *kw = AllocASTKeyword();
+      kw->token = RetainToken(tokens, token);
+
+      *after_index = index;
+      return kw;
+    }
   }
   return NULL;
 }
 
-#define MAX_NODES_IN_DECL_SPECS 4
 ASTList *ParseDeclSpecs(TokenList *tokens, int index, int *after_index) {
   // declaration-specifiers
   // ASTList<ASTKeyword>
-  ASTList *list = AllocASTList(MAX_NODES_IN_DECL_SPECS);
+  if (!IsDeclSpecTokenAt(tokens, index)) return NULL;
+  ASTList *list = AllocASTList();
   ASTNode *node;
   for (;;) {
-    node = ParseTypeSpec(tokens, index, &index);
+    node = ToASTNode(ParseStorageClassSpec(tokens, index, &index));
+    if (!node) node = ParseTypeSpec(tokens, index, &index);
     if (!node) node = ToASTNode(ParseTypeQual(tokens, index, &index));
+    if (!node) node = ToASTNode(ParseFuncSpec(tokens, index, &index));
     if (!node) break;
     PushASTNodeToList(list, node);
   }
@@ -444,82 +716,321 @@ ASTList *ParseDeclSpecs(TokenList *tokens, int index, int *after_index) {
   return list;
 }
 
-ASTNode *ParseFuncDef(TokenList *tokens, int index, int *after_index) {
-  // function-definition
-  ASTList *decl_specs = ParseDeclSpecs(tokens, index, &index);
-  if (!decl_specs) {
-    return NULL;
+// Deferred function bodies.
+// When every token is available up front, the translation unit is first
+// skimmed: declarations and the heads of function definitions are parsed as
+// usual, but each function body is only brace-matched and queued. Bodies of
+// static and inline functions are lazy: they are parsed (and so lowered and
+// emitted) only if the function is referenced from another parsed body.
+// The queued bodies are then parsed, concurrently with more than one parse
+// job, and linked into their ASTFuncDef nodes; a lazy body that is never
+// referenced leaves its ASTFuncDef without a comp_stmt.
+// A token stream discards tokens as it goes, so it is always parsed
+// sequentially and in full.
+static int num_of_parse_jobs = 1;
+
+void SetNumOfParseJobs(int num) {
+  if (num < 1) Error("The number of parse jobs must be positive");
+  num_of_parse_jobs = num;
+}
+
+typedef struct {
+  ASTFuncDef *func_def;
+  int begin;  // index of {
+  int end;    // index after the matching }
+  int name;   // symbol of the function name
+  int is_lazy;
+} FuncBody;
+
+typedef struct {
+  TokenList *tokens;
+  FuncBody *bodies;
+  int size;
+  int capacity;
+  atomic_int next;  // index of the next body to parse
+} FuncBodyQueue;
+
+static int SkipCompStmt(TokenList *tokens, int index) {
+  // Returns the index after the } matching the { at index.
+  int depth = 0;
+  for (int i = index;; i++) {
+    int sym = GetTokenSymAt(tokens, i);
+    if (sym == kSymLBrace) {
+      depth++;
+    } else if (sym == kSymRBrace) {
+      if (--depth == 0) return i + 1;
+    } else if (!sym && !GetTokenAt(tokens, i)) {
+      Error("Unmatched { (%s)",
+            GetSourceLocationStr(GetTokenAt(tokens, index)->loc));
+    }
   }
+}
 
-  ASTDecltor *decltor = ParseDecltor(tokens, index, &index);
-  if (!decltor) {
-    return NULL;
+static int IsLazyFuncDef(ASTList *decl_specs) {
+  // Static and inline functions need no definition unless they are used.
+  for (int i = 0; i < GetSizeOfASTList(decl_specs); i++) {
+    ASTKeyword *kw = ToASTKeyword(GetASTNodeAt(decl_specs, i));
+    if (IsEqualToken(kw->token, kSymStatic) ||
+        IsEqualToken(kw->token, kSymInline))
+      return 1;
   }
+  return 0;
+}
 
-  ASTCompStmt *comp_stmt = ParseCompStmt(tokens, index, &index);
-  if (!comp_stmt) {
-    return NULL;
+static void QueueFuncBody(FuncBodyQueue *queue, ASTFuncDef *func_def,
+                          int begin, int end, int is_lazy) {
+  if (queue->size >= queue->capacity) {
+    queue->capacity = queue->capacity ? queue->capacity * 2 : 64;
+    queue->bodies = realloc(queue->bodies, sizeof(FuncBody) * queue->capacity);
+    if (!queue->bodies) Error("Failed to grow the function body queue");
+  }
+  FuncBody *body = &queue->bodies[queue->size++];
+  body->func_def = func_def;
+  body->begin = begin;
+  body->end = end;
+  const Token *name = GetFuncNameTokenFromFuncDef(func_def);
+  body->name = name ? name->sym : kSymNone;
+  body->is_lazy = is_lazy && body->name;
+}
+
+static void DropUnreferencedFuncBodies(FuncBodyQueue *queue) {
+  // Keeps the bodies that are not lazy and the lazy bodies that are
+  // referenced, directly or not, from them.
+  // References are found by scanning the identifiers in the bodies, so a
+  // local that shadows a function also counts; that only keeps more.
+  int max_name = 0;
+  for (int i = 0; i < queue->size; i++) {
+    FuncBody *body = &queue->bodies[i];
+    if (body->is_lazy && body->name > max_name) max_name = body->name;
+  }
+  if (!max_name) return;
+  int *lazy_body_of_name = calloc(max_name + 1, sizeof(int));  // index + 1
+  int *worklist = malloc(sizeof(int) * queue->size);
+  if (!lazy_body_of_name || !worklist) Error("Failed to allocate worklist");
+  int num_of_works = 0;
+  for (int i = 0; i < queue->size; i++) {
+    FuncBody *body = &queue->bodies[i];
+    if (body->is_lazy) {
+      lazy_body_of_name[body->name] = i + 1;
+    } else {
+      worklist[num_of_works++] = i;
+    }
+  }
+  while (num_of_works) {
+    FuncBody *body = &queue->bodies[worklist[--num_of_works]];
+    for (int i = body->begin; i < body->end; i++) {
+      int sym = GetTokenSymAt(queue->tokens, i);
+      if (sym > max_name || !lazy_body_of_name[sym]) continue;
+      FuncBody *callee = &queue->bodies[lazy_body_of_name[sym] - 1];
+      if (!callee->is_lazy) continue;  // already referenced
+      callee->is_lazy = 0;
+      worklist[num_of_works++] = lazy_body_of_name[sym] - 1;
+    }
+  }
+  int size = 0;
+  for (int i = 0; i < queue->size; i++) {
+    if (!queue->bodies[i].is_lazy) queue->bodies[size++] = queue->bodies[i];
+  }
+  queue->size = size;
+  free(lazy_body_of_name);
+  free(worklist);
+}
+
+static ASTCompStmt *ParseFuncBody(TokenList *tokens, int index,
+                                  int *after_index, ASTFuncDef *func_def) {
+  // The params are in a scope that encloses the body.
+  if (!local_scope) local_scope = AllocScopeTable();
+  frame_size = 0;
+  PushScope(local_scope);
+  ASTDecltor *decltor = ToASTDecltor(GetASTNode(func_def->decltor));
+  ASTDirectDecltor *direct_decltor =
+      ToASTDirectDecltor(GetASTNode(decltor->direct_decltor));
+  ASTList *params = ToASTList(GetASTNode(direct_decltor->data));
+  for (int i = 0; i < GetSizeOfASTList(params); i++) {
+    // An identifier list or "..." declares no param here.
+    ASTParamDecl *param_decl = ToASTParamDecl(GetASTNodeAt(params, i));
+    if (!param_decl) continue;
+    const Type *type = GetTypeOfParamDecl(param_decl);
+    if (type->kind == kTypeVoid) continue;  // f(void)
+    // Params arrive in registers and are stored to 8-byte slots.
+    func_def->num_of_params++;
+    frame_size += 8;
+    DeclareVarOfDecltor(ToASTDecltor(GetASTNode(param_decl->decltor)), type,
+                        kVarParam, index);
+  }
+  ASTCompStmt *comp_stmt = ParseCompStmt(tokens, index, after_index);
+  PopScope(local_scope);
+  func_def->frame_size = frame_size;
+  return comp_stmt;
+}
+
+static void *ParseQueuedFuncBodies(void *arg) {
+  FuncBodyQueue *queue = arg;
+  for (;;) {
+    int i = atomic_fetch_add(&queue->next, 1);
+    if (i >= queue->size) break;
+    FuncBody *body = &queue->bodies[i];
+    int end;
+    ASTCompStmt *comp_stmt =
+        ParseFuncBody(queue->tokens, body->begin, &end, body->func_def);
+    if (!comp_stmt || end != body->end) {
+      const Token *token = GetTokenAt(queue->tokens, body->begin);
+      Error("Failed to parse function body (%s)",
+            GetSourceLocationStr(token->loc));
+    }
+    body->func_def->comp_stmt = GetASTHandle(comp_stmt);
+  }
+  return NULL;
+}
+
+static void ParseFuncBodies(FuncBodyQueue *queue) {
+  DropUnreferencedFuncBodies(queue);
+  int num_of_threads = num_of_parse_jobs - 1;
+  if (num_of_threads > queue->size - 1) num_of_threads = queue->size - 1;
+  if (num_of_threads < 0) num_of_threads = 0;
+  pthread_t *threads = malloc(sizeof(pthread_t) * (num_of_threads + 1));
+  if (!threads) Error("Failed to allocate parse jobs");
+  for (int i = 0; i < num_of_threads; i++) {
+    if (pthread_create(&threads[i], NULL, ParseQueuedFuncBodies, queue))
+      Error("Failed to start a parse job");
   }
+  // The calling thread is one of the jobs.
+  ParseQueuedFuncBodies(queue);
+  for (int i = 0; i < num_of_threads; i++) pthread_join(threads[i], NULL);
+  free(threads);
+}
 
+static ASTNode *ParseFuncDefBody(TokenList *tokens, int index,
+                                 int *after_index, ASTList *decl_specs,
+                                 ASTDecltor *decltor, FuncBodyQueue *queue) {
+  // function-definition after its declaration-specifiers and declarator
+  // If queue is given, the body is skimmed and queued instead of parsed.
   ASTFuncDef *func_def = AllocASTFuncDef();
-  func_def->decl_specs = decl_specs;
-  func_def->decltor = decltor;
-  func_def->comp_stmt = comp_stmt;
+  func_def->decl_specs = GetASTHandle(decl_specs);
+  func_def->decltor = GetASTHandle(decltor);
+  if (queue) {
+    int end = SkipCompStmt(tokens, index);
+    QueueFuncBody(queue, func_def, index, end, IsLazyFuncDef(decl_specs));
+    index = end;
+  } else {
+    ASTCompStmt *comp_stmt = ParseFuncBody(tokens, index, &index, func_def);
+    if (!comp_stmt) {
+      return NULL;
+    }
+    func_def->comp_stmt = GetASTHandle(comp_stmt);
+  }
   *after_index = index;
   return ToASTNode(func_def);
 }
 
-#define MAX_NODES_IN_INIT_DECLTORS 8
-ASTList *ParseInitDecltors(TokenList *tokens, int index, int *after_index) {
-  // declaration-specifiers
-  // ASTList<ASTKeyword>
-  return ParseCommaSeparatedList(tokens, index, after_index, ParseDecltorNode);
+ASTList *ParseInitDecltors(TokenList *tokens, int index, int *after_index,
+                           ASTDecltor *first) {
+  // init-declarator-list, whose first declarator (if any) is already parsed
+  // ASTList<ASTDecltor>
+  ASTList *list = AllocASTList();
+  if (!first) return list;
+  PushASTNodeToList(list, ToASTNode(first));
+  *after_index = index;
+  while (IsEqualTokenAt(tokens, index, kSymComma)) {
+    ASTDecltor *decltor = ParseDecltor(tokens, index + 1, &index);
+    if (!decltor) break;
+    PushASTNodeToList(list, ToASTNode(decltor));
+    *after_index = index;
+  }
+  return list;
 }
 
-ASTDecl *ParseDecl(TokenList *tokens, int index, int *after_index) {
-  ASTList *decl_specs = ParseDeclSpecs(tokens, index, &index);
-  if (!decl_specs) {
-    return NULL;
-  }
-  ASTList *init_decltors = ParseInitDecltors(tokens, index, &index);
+static ASTDecl *ParseDeclRest(TokenList *tokens, int index, int *after_index,
+                              ASTList *decl_specs, ASTDecltor *first) {
+  // declaration after its declaration-specifiers and first declarator
+  ASTList *init_decltors = ParseInitDecltors(tokens, index, &index, first);
   // init_decltors is optional
-  if (!IsEqualToken(GetTokenAt(tokens, index++), ";")) {
+  if (!IsEqualTokenAt(tokens, index++, kSymSemicolon)) {
     return NULL;
   }
   //
   *after_index = index;
   ASTDecl *decl = AllocASTDecl();
-  decl->decl_specs = decl_specs;
-  decl->init_decltors = init_decltors;
+  decl->decl_specs = GetASTHandle(decl_specs);
+  decl->init_decltors = GetASTHandle(init_decltors);
   return decl;
 }
 
-#define MAX_NODES_IN_TRANSLATION_UNIT 64
+ASTDecl *ParseDecl(TokenList *tokens, int index, int *after_index) {
+  ASTList *decl_specs = ParseDeclSpecs(tokens, index, &index);
+  if (!decl_specs) {
+    return NULL;
+  }
+  ASTDecltor *decltor = ParseDecltor(tokens, index, &index);
+  return ParseDeclRest(tokens, index, after_index, decl_specs, decltor);
+}
+
+static ASTNode *ParseExternalDecl(TokenList *tokens, int index,
+                                  int *after_index, FuncBodyQueue *queue) {
+  // external-declaration:
+  //   function-definition
+  //   declaration
+  // Both begin with declaration-specifiers and a declarator, which are
+  // parsed once; the token after them tells which one this is.
+  int begin = index;
+  ASTList *decl_specs = ParseDeclSpecs(tokens, index, &index);
+  if (!decl_specs) {
+    return NULL;
+  }
+  ASTDecltor *decltor = ParseDecltor(tokens, index, &index);
+  if (decltor && IsEqualTokenAt(tokens, index, kSymLBrace)) {
+    // The function is visible in its own body.
+    DeclareVarOfDecltor(
+        decltor, GetTypeOfDecltor(GetTypeOfDeclSpecs(decl_specs), decltor),
+        kVarGlobal, begin);
+    return ParseFuncDefBody(tokens, index, after_index, decl_specs, decltor,
+                            queue);
+  }
+  ASTDecl *decl =
+      ParseDeclRest(tokens, index, after_index, decl_specs, decltor);
+  if (decl) DeclareVarsOfDecl(decl, kVarGlobal, begin);
+  return ToASTNode(decl);
+}
+
 ASTNode *ParseTranslationUnit(TokenList *tokens, int index, int *after_index) {
   // ASTList<ASTFuncDef | ASTDecl>
-  ASTList *list = AllocASTList(MAX_NODES_IN_TRANSLATION_UNIT);
+  ASTList *list = AllocASTList();
   ASTNode *node;
+  FuncBodyQueue queue = {.tokens = tokens};
+  global_scope = AllocScopeTable();
+  PushScope(global_scope);
+  int is_skimming = !GetTokenWindowCapacity(tokens);
   for (;;) {
-    node = ParseFuncDef(tokens, index, &index);
-    if (!node) node = ToASTNode(ParseDecl(tokens, index, &index));
+    CommitTokens(tokens, index);
+    node = ParseExternalDecl(tokens, index, &index,
+                             is_skimming ? &queue : NULL);
     if (node) {
-      printf("Read in TopLevel: ");
-      PrintASTNode(node, 0);
+      if (!is_skimming) {
+        printf("Read in TopLevel: ");
+        PrintASTNode(node, 0);
+      }
       PushASTNodeToList(list, node);
       continue;
     }
-    if (index != GetSizeOfTokenList(tokens)) {
-      const Token *token = GetTokenAt(tokens, index);
-      Error("Unexpected Token %s (%s:%d)", token->str, token->filename,
-            token->line);
+    const Token *token = GetTokenAt(tokens, index);
+    if (token) {
+      Error("Unexpected Token %s (%s)", GetTokenStr(token),
+            GetSourceLocationStr(token->loc));
     }
     break;
   }
+  if (is_skimming) {
+    ParseFuncBodies(&queue);
+    free(queue.bodies);
+    for (int i = 0; i < GetSizeOfASTList(list); i++) {
+      printf("Read in TopLevel: ");
+      PrintASTNode(GetASTNodeAt(list, i), 0);
+    }
+  }
   *after_index = index;
   return ToASTNode(list);
 }
 
-#define MAX_ROOT_NODES 64
 ASTNode *Parse(TokenList *tokens) {
   int index = 0;
   return ParseTranslationUnit(tokens, index, &index);
@@ -0,0 +1,1337 @@
+#define _DEFAULT_SOURCE
+#include <limits.h>
+
+#include "compilium.h"
+
+// Preprocessor.
+// The lexer keeps directive lines as tokens ('#' ... kSymEndOfDirective), and
+// the preprocessor replays those raw tokens into the output TokenList,
+// executing directives and expanding macros on the way.
+// The main file is lexed lazily, a line at a time, so that streaming
+// TokenLists keep working. Included headers are lexed once per process (or
+// loaded from the on-disk token cache) and their raw tokens are kept; headers
+// protected by #pragma once or by the classic "#ifndef X / #define X / ... /
+// #endif" guard are skipped without being replayed when included again.
+//
+// Macro expansion follows Prosser's algorithm: every token carries a hide-set
+// of the macros it came from, and a macro is not expanded again from a token
+// that has it in the hide-set. Tokens are passed around as pointers with
+// hide-sets (PPToken) instead of copies:
+// - A macro body is stored once, as a slice of the raw tokens of its file.
+// - An object-like macro is expanded by pushing a context that reads its body
+//   slice; a macro with a single-token body needs no context at all.
+// - A function-like macro is expanded into expanded_tokens, which refers to
+//   the body and argument tokens and is reset when all contexts are done.
+// New Token records are made only by # and ##.
+
+typedef struct HEADER_FILE HeaderFile;
+struct HEADER_FILE {
+  const char *path;  // canonical path
+  int path_sym;
+  TokenList *raw_tokens;
+  int guard_sym;  // kSymNone if the file has no include guard
+  int guard_body_begin;
+  int guard_body_end;
+  int pragma_once;
+  int num_of_inclusions;
+  HeaderFile *next;
+};
+
+typedef struct {
+  HeaderFile *file;  // NULL for the main file
+  const char *filename;
+  TokenList *raw_tokens;
+  int pos;
+  int end;
+  // main file only: the rest of the source to be lexed
+  const SourceBuffer *buffer;
+  const char *src;
+} SourceFrame;
+
+typedef struct {
+  int frame_depth;
+  int is_taken;  // a group of this conditional is (or was) taken
+  int has_else;
+} Conditional;
+
+typedef struct {
+  int sym;
+  int is_function_like;
+  int is_variadic;
+  int num_of_params;  // including __VA_ARGS__
+  int *params;
+  // body: tokens[begin, end)
+  TokenList *tokens;
+  int begin;
+  int end;
+  int *param_indexes;  // for each body token, index of its param or -1
+} Macro;
+
+typedef struct {
+  const Token *token;
+  int hide_set;
+} PPToken;
+
+typedef struct {
+  PPToken *tokens;
+  int size;
+  int capacity;
+} PPTokenList;
+
+typedef struct {
+  // tokens[pos, end) with hide_set, or expanded_tokens[pos, end) if tokens is
+  // NULL.
+  TokenList *tokens;
+  int pos;
+  int end;
+  int hide_set;
+} MacroContext;
+
+typedef struct {
+  int parent;  // the hide-set without sym
+  int sym;
+} HideSetNode;
+
+#define MAX_INCLUDE_DEPTH 200
+#define READ_SOURCE -1  // floor to read beyond the contexts
+
+static const char **include_paths;
+static int num_of_include_paths;
+
+static HeaderFile *header_files;
+
+static SourceFrame source_frames[MAX_INCLUDE_DEPTH + 1];
+static int num_of_source_frames;
+
+static Conditional *conditionals;
+static int num_of_conditionals;
+static int conditional_capacity;
+
+static Macro **macros;  // indexed by sym
+static int macro_capacity;
+static TokenList *macro_body_tokens;  // bodies of macros in the main file
+static TokenList *generated_tokens;   // results of # and ##
+
+static MacroContext *contexts;
+static int num_of_contexts;
+static int context_capacity;
+static PPTokenList expanded_tokens;
+
+// Hide-sets are interned: 0 is the empty set, and any other id is a node that
+// adds sym to its parent set.
+static HideSetNode *hide_set_nodes;
+static int num_of_hide_set_nodes;
+static int hide_set_node_capacity;
+static int *hide_set_table;  // open addressing, 0: empty slot
+static int hide_set_table_capacity;
+
+static const Token kZeroToken = {"0", 1, kSymNone, kInteger, 0};
+static const Token kOneToken = {"1", 1, kSymNone, kInteger, 0};
+
+void AddIncludePath(const char *path) {
+  include_paths = realloc(include_paths,
+                          sizeof(const char *) * (num_of_include_paths + 1));
+  if (!include_paths) Error("Failed to add include path");
+  include_paths[num_of_include_paths++] = path;
+}
+
+static void AppendPPToken(PPTokenList *list, const Token *token,
+                          int hide_set) {
+  if (list->size >= list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 64;
+    list->tokens = realloc(list->tokens, sizeof(PPToken) * list->capacity);
+    if (!list->tokens) Error("Failed to grow PPTokenList");
+  }
+  list->tokens[list->size].token = token;
+  list->tokens[list->size].hide_set = hide_set;
+  list->size++;
+}
+
+static int IsLiteralToken(const Token *token) {
+  return token->type == kStringLiteral || token->type == kCharacterLiteral;
+}
+
+//
+// Hide-sets
+//
+
+static unsigned int HashHideSetNode(int parent, int sym) {
+  return (unsigned int)parent * 2654435761u ^ (unsigned int)sym * 40503u;
+}
+
+static void InsertHideSetNode(int id) {
+  int mask = hide_set_table_capacity - 1;
+  int i = HashHideSetNode(hide_set_nodes[id].parent, hide_set_nodes[id].sym) &
+          mask;
+  while (hide_set_table[i]) i = (i + 1) & mask;
+  hide_set_table[i] = id;
+}
+
+static int IsInHideSet(int hide_set, int sym) {
+  for (; hide_set; hide_set = hide_set_nodes[hide_set].parent) {
+    if (hide_set_nodes[hide_set].sym == sym) return 1;
+  }
+  return 0;
+}
+
+static int AddToHideSet(int hide_set, int sym) {
+  if (IsInHideSet(hide_set, sym)) return hide_set;
+  if (hide_set_table_capacity) {
+    int mask = hide_set_table_capacity - 1;
+    for (int i = HashHideSetNode(hide_set, sym) & mask; hide_set_table[i];
+         i = (i + 1) & mask) {
+      HideSetNode *node = &hide_set_nodes[hide_set_table[i]];
+      if (node->parent == hide_set && node->sym == sym)
+        return hide_set_table[i];
+    }
+  }
+  if (num_of_hide_set_nodes == 0) num_of_hide_set_nodes = 1;  // empty set
+  if (num_of_hide_set_nodes >= hide_set_node_capacity) {
+    hide_set_node_capacity =
+        hide_set_node_capacity ? hide_set_node_capacity * 2 : 256;
+    hide_set_nodes = realloc(hide_set_nodes,
+                             sizeof(HideSetNode) * hide_set_node_capacity);
+    if (!hide_set_nodes) Error("Failed to grow hide-sets");
+  }
+  int id = num_of_hide_set_nodes++;
+  hide_set_nodes[id].parent = hide_set;
+  hide_set_nodes[id].sym = sym;
+  // Keep the load factor below 1/2.
+  if (num_of_hide_set_nodes * 2 > hide_set_table_capacity) {
+    free(hide_set_table);
+    hide_set_table_capacity =
+        hide_set_table_capacity ? hide_set_table_capacity * 2 : 512;
+    hide_set_table = calloc(hide_set_table_capacity, sizeof(int));
+    if (!hide_set_table) Error("Failed to grow hide-sets");
+    for (int i = 1; i < num_of_hide_set_nodes; i++) InsertHideSetNode(i);
+  } else {
+    InsertHideSetNode(id);
+  }
+  return id;
+}
+
+static int UnionHideSets(int a, int b) {
+  for (; b; b = hide_set_nodes[b].parent) {
+    a = AddToHideSet(a, hide_set_nodes[b].sym);
+  }
+  return a;
+}
+
+static int IntersectHideSets(int a, int b) {
+  int result = 0;
+  for (; a; a = hide_set_nodes[a].parent) {
+    if (IsInHideSet(b, hide_set_nodes[a].sym))
+      result = AddToHideSet(result, hide_set_nodes[a].sym);
+  }
+  return result;
+}
+
+//
+// Macros
+//
+
+static Macro *FindMacro(int sym) {
+  if (sym <= kSymNone || macro_capacity <= sym) return NULL;
+  return macros[sym];
+}
+
+static void SetMacro(int sym, Macro *macro) {
+  if (sym >= macro_capacity) {
+    int new_capacity = macro_capacity ? macro_capacity : 256;
+    while (new_capacity <= sym) new_capacity *= 2;
+    macros = realloc(macros, sizeof(Macro *) * new_capacity);
+    if (!macros) Error("Failed to grow macro table");
+    memset(&macros[macro_capacity], 0,
+           sizeof(Macro *) * (new_capacity - macro_capacity));
+    macro_capacity = new_capacity;
+  }
+  macros[sym] = macro;
+}
+
+static Macro *GetMacroToExpand(const PPToken *t) {
+  if (t->token->type != kIdentifier) return NULL;
+  Macro *macro = FindMacro(t->token->sym);
+  if (!macro || IsInHideSet(t->hide_set, macro->sym)) return NULL;
+  return macro;
+}
+
+static int FindParam(const Macro *macro, int sym) {
+  for (int i = 0; i < macro->num_of_params; i++) {
+    if (macro->params[i] == sym) return i;
+  }
+  return -1;
+}
+
+//
+// Source frames
+//
+
+static int SkipDirective(TokenList *tokens, int index) {
+  // Returns the index after the kSymEndOfDirective of the directive at index.
+  while (!IsEqualTokenAt(tokens, index++, kSymEndOfDirective)) {
+    if (!GetTokenAt(tokens, index)) Error("Unterminated directive");
+  }
+  return index;
+}
+
+static const Token *PeekSourceToken(SourceFrame *frame) {
+  // Returns the next raw token of the frame, or NULL at the end of the frame.
+  while (frame->pos >= frame->end) {
+    // Lex the next line of the main file.
+    if (!frame->src || !*frame->src) return NULL;
+    frame->src = TokenizeNext(frame->raw_tokens, frame->src, frame->buffer);
+    frame->end = GetSizeOfTokenList(frame->raw_tokens);
+  }
+  return GetTokenAt(frame->raw_tokens, frame->pos);
+}
+
+static void DiscardConsumedRawTokens(SourceFrame *frame) {
+  // Reuses the lexing buffer of the main file.
+  // Call this only when no token in the buffer is referred to.
+  if (frame->file || frame->pos < frame->end) return;
+  SetSizeOfTokenList(frame->raw_tokens, 0);
+  frame->pos = frame->end = 0;
+}
+
+//
+// Macro contexts
+//
+
+static void PushMacroContext(TokenList *tokens, int begin, int end,
+                             int hide_set) {
+  if (num_of_contexts >= context_capacity) {
+    context_capacity = context_capacity ? context_capacity * 2 : 16;
+    contexts = realloc(contexts, sizeof(MacroContext) * context_capacity);
+    if (!contexts) Error("Failed to grow macro contexts");
+  }
+  MacroContext *context = &contexts[num_of_contexts++];
+  context->tokens = tokens;
+  context->pos = begin;
+  context->end = end;
+  context->hide_set = hide_set;
+}
+
+static int PeekToken(PPToken *t, int floor) {
+  // Returns 0 at the end of the contexts above floor. If floor is READ_SOURCE,
+  // reads on from the source frame up to its end or a directive.
+  int min_contexts = floor < 0 ? 0 : floor;
+  while (num_of_contexts > min_contexts) {
+    MacroContext *context = &contexts[num_of_contexts - 1];
+    if (context->pos < context->end) {
+      if (context->tokens) {
+        t->token = GetTokenAt(context->tokens, context->pos);
+        t->hide_set = context->hide_set;
+      } else {
+        *t = expanded_tokens.tokens[context->pos];
+      }
+      return 1;
+    }
+    num_of_contexts--;
+  }
+  if (floor != READ_SOURCE) return 0;
+  const Token *token =
+      PeekSourceToken(&source_frames[num_of_source_frames - 1]);
+  if (!token || token->sym == kSymHash) return 0;
+  t->token = token;
+  t->hide_set = 0;
+  return 1;
+}
+
+static void ConsumeToken(int floor) {
+  // Consumes the token returned by the last PeekToken().
+  if (num_of_contexts > (floor < 0 ? 0 : floor)) {
+    contexts[num_of_contexts - 1].pos++;
+    return;
+  }
+  source_frames[num_of_source_frames - 1].pos++;
+}
+
+static int ReadToken(PPToken *t, int floor) {
+  if (!PeekToken(t, floor)) return 0;
+  ConsumeToken(floor);
+  return 1;
+}
+
+static int ReadExpandedToken(PPToken *t, int floor);
+
+//
+// Function-like macros
+//
+
+static int GetSpelling(const Token *token, char *buf) {
+  // Writes the spelling of token to buf (if not NULL) and returns its length.
+  int quote = 0;
+  if (token->type == kStringLiteral) quote = '"';
+  if (token->type == kCharacterLiteral) quote = '\'';
+  if (buf) {
+    if (quote) *buf++ = quote;
+    memcpy(buf, token->begin, token->length);
+    if (quote) buf[token->length] = quote;
+  }
+  return token->length + (quote ? 2 : 0);
+}
+
+static int HasSpaceBetween(const Token *prev, const Token *next) {
+  return prev->begin + prev->length + IsLiteralToken(prev) !=
+         next->begin - IsLiteralToken(next);
+}
+
+static const Token *Stringify(const PPToken *tokens, int size,
+                              const Token *hash) {
+  // # operator: makes a string literal of the spelling of tokens.
+  int length = 0;
+  for (int i = 0; i < size; i++) {
+    length += GetSpelling(tokens[i].token, NULL) * 2 + 1;
+  }
+  char *spelling = malloc(length + 1);
+  char *s = malloc(length + 1);
+  if (!spelling || !s) Error("Failed to stringify");
+  char *p = s;
+  for (int i = 0; i < size; i++) {
+    const Token *token = tokens[i].token;
+    if (i && HasSpaceBetween(tokens[i - 1].token, token)) *p++ = ' ';
+    int n = GetSpelling(token, spelling);
+    for (int k = 0; k < n; k++) {
+      if (IsLiteralToken(token) && (spelling[k] == '"' || spelling[k] == '\\'))
+        *p++ = '\\';
+      *p++ = spelling[k];
+    }
+  }
+  free(spelling);
+  AppendTokenWithSubstring(generated_tokens, s, p, kStringLiteral, kSymNone,
+                           hash->loc);
+  return GetTokenAt(generated_tokens, GetSizeOfTokenList(generated_tokens) - 1);
+}
+
+static PPToken Paste(const PPToken *lhs, const PPToken *rhs) {
+  // ## operator
+  int lhs_length = GetSpelling(lhs->token, NULL);
+  int length = lhs_length + GetSpelling(rhs->token, NULL);
+  char *s = malloc(length + 1);
+  if (!s) Error("Failed to paste tokens");
+  GetSpelling(lhs->token, s);
+  GetSpelling(rhs->token, s + lhs_length);
+  s[length] = 0;
+  int index = GetSizeOfTokenList(generated_tokens);
+  // The result is located at the lhs.
+  SourceBuffer buffer = {.begin = s, .loc = lhs->token->loc};
+  const char *p = CommonTokenizer(generated_tokens, s, &buffer);
+  if (*p || GetSizeOfTokenList(generated_tokens) != index + 1) {
+    Error("Pasting \"%s\" does not give a valid token (%s)", s,
+          GetSourceLocationStr(lhs->token->loc));
+  }
+  PPToken t;
+  t.token = GetTokenAt(generated_tokens, index);
+  t.hide_set = UnionHideSets(lhs->hide_set, rhs->hide_set);
+  return t;
+}
+
+static void ExpandArgument(PPTokenList *out, int begin, int end) {
+  // Fully macro-expands expanded_tokens[begin, end) on its own.
+  int floor = num_of_contexts;
+  PushMacroContext(NULL, begin, end, 0);
+  PPToken t;
+  while (ReadExpandedToken(&t, floor)) AppendPPToken(out, t.token, t.hide_set);
+}
+
+static void AppendArgument(PPTokenList *out, const PPToken *tokens, int size,
+                           int hide_set) {
+  for (int i = 0; i < size; i++) {
+    AppendPPToken(out, tokens[i].token,
+                  UnionHideSets(tokens[i].hide_set, hide_set));
+  }
+}
+
+static void Substitute(PPTokenList *out, const Macro *macro,
+                       const int *arg_begins, int hide_set) {
+  // Argument i is expanded_tokens[arg_begins[i], arg_begins[i + 1]).
+  PPTokenList *expanded_args =
+      calloc(macro->num_of_params + 1, sizeof(PPTokenList));
+  int *is_expanded = calloc(macro->num_of_params + 1, sizeof(int));
+  if (!expanded_args || !is_expanded) Error("Failed to expand macro");
+  int is_placemarker = 0;  // the last operand was an empty argument
+  for (int i = macro->begin; i < macro->end; i++) {
+    const Token *token = GetTokenAt(macro->tokens, i);
+    int param = macro->param_indexes[i - macro->begin];
+    int next_param =
+        i + 1 < macro->end ? macro->param_indexes[i + 1 - macro->begin] : -1;
+    if (token->sym == kSymHash && next_param >= 0) {
+      // # param
+      int begin = arg_begins[next_param];
+      const Token *str =
+          Stringify(&expanded_tokens.tokens[begin],
+                    arg_begins[next_param + 1] - begin, token);
+      AppendPPToken(out, str, hide_set);
+      is_placemarker = 0;
+      i++;
+      continue;
+    }
+    if (token->sym == kSymHashHash) {
+      // lhs ## rhs
+      if (i == macro->begin || i + 1 >= macro->end) {
+        Error("'##' cannot appear at either end of a macro (%s)",
+              GetSourceLocationStr(token->loc));
+      }
+      PPToken rhs_token = {GetTokenAt(macro->tokens, i + 1), 0};
+      const PPToken *rhs = &rhs_token;
+      int rhs_size = 1;
+      if (next_param >= 0) {
+        rhs = &expanded_tokens.tokens[arg_begins[next_param]];
+        rhs_size = arg_begins[next_param + 1] - arg_begins[next_param];
+      }
+      i++;
+      if (is_placemarker || !rhs_size) {
+        // An empty operand leaves the other operand as is.
+        AppendArgument(out, rhs, rhs_size, hide_set);
+        is_placemarker = is_placemarker && !rhs_size;
+        continue;
+      }
+      PPToken pasted = Paste(&out->tokens[out->size - 1], rhs);
+      out->tokens[out->size - 1].token = pasted.token;
+      out->tokens[out->size - 1].hide_set =
+          UnionHideSets(pasted.hide_set, hide_set);
+      AppendArgument(out, rhs + 1, rhs_size - 1, hide_set);
+      continue;
+    }
+    is_placemarker = 0;
+    if (param < 0) {
+      AppendPPToken(out, token, hide_set);
+      continue;
+    }
+    int begin = arg_begins[param];
+    int size = arg_begins[param + 1] - begin;
+    if (i + 1 < macro->end &&
+        IsEqualTokenAt(macro->tokens, i + 1, kSymHashHash)) {
+      // Operands of ## are not expanded.
+      AppendArgument(out, &expanded_tokens.tokens[begin], size, hide_set);
+      is_placemarker = size == 0;
+      continue;
+    }
+    if (!is_expanded[param]) {
+      ExpandArgument(&expanded_args[param], begin, begin + size);
+      is_expanded[param] = 1;
+    }
+    AppendArgument(out, expanded_args[param].tokens, expanded_args[param].size,
+                   hide_set);
+  }
+  for (int i = 0; i < macro->num_of_params; i++) free(expanded_args[i].tokens);
+  free(expanded_args);
+  free(is_expanded);
+}
+
+static int ExpandFunctionLikeMacro(const Macro *macro, const PPToken *name,
+                                   int floor) {
+  // Returns 0 if name is not followed by '('.
+  PPToken t;
+  if (!PeekToken(&t, floor) || !IsEqualToken(t.token, kSymLParen)) return 0;
+  ConsumeToken(floor);
+  // Collect the arguments into expanded_tokens.
+  int *arg_begins = malloc(sizeof(int) * (macro->num_of_params + 2));
+  if (!arg_begins) Error("Failed to expand macro");
+  int num_of_args = 0;
+  int depth = 0;
+  arg_begins[0] = expanded_tokens.size;
+  for (;;) {
+    if (!ReadToken(&t, floor)) {
+      Error("Unterminated argument list invoking macro %s (%s)",
+            GetSymbolStr(macro->sym), GetSourceLocationStr(name->token->loc));
+    }
+    if (depth == 0 && IsEqualToken(t.token, kSymRParen)) break;
+    if (depth == 0 && IsEqualToken(t.token, kSymComma) &&
+        !(macro->is_variadic && num_of_args + 1 == macro->num_of_params)) {
+      if (++num_of_args >= macro->num_of_params) {
+        Error("Too many arguments for macro %s (%s)",
+              GetSymbolStr(macro->sym), GetSourceLocationStr(name->token->loc));
+      }
+      arg_begins[num_of_args] = expanded_tokens.size;
+      continue;
+    }
+    if (IsEqualToken(t.token, kSymLParen)) depth++;
+    if (IsEqualToken(t.token, kSymRParen)) depth--;
+    AppendPPToken(&expanded_tokens, t.token, t.hide_set);
+  }
+  int rparen_hide_set = t.hide_set;
+  arg_begins[++num_of_args] = expanded_tokens.size;
+  if (num_of_args == 1 && macro->num_of_params == 0 &&
+      arg_begins[0] == arg_begins[1]) {
+    num_of_args = 0;  // F()
+  }
+  if (macro->is_variadic && num_of_args + 1 == macro->num_of_params) {
+    arg_begins[++num_of_args] = expanded_tokens.size;  // empty __VA_ARGS__
+  }
+  if (num_of_args != macro->num_of_params) {
+    Error("Macro %s expects %d arguments, but %d given (%s)",
+          GetSymbolStr(macro->sym), macro->num_of_params, num_of_args,
+          GetSourceLocationStr(name->token->loc));
+  }
+  int hide_set = AddToHideSet(
+      IntersectHideSets(name->hide_set, rparen_hide_set), macro->sym);
+  PPTokenList result = {NULL, 0, 0};
+  Substitute(&result, macro, arg_begins, hide_set);
+  free(arg_begins);
+  int begin = expanded_tokens.size;
+  for (int i = 0; i < result.size; i++) {
+    AppendPPToken(&expanded_tokens, result.tokens[i].token,
+                  result.tokens[i].hide_set);
+  }
+  free(result.tokens);
+  PushMacroContext(NULL, begin, expanded_tokens.size, 0);
+  return 1;
+}
+
+static int ReadExpandedToken(PPToken *t, int floor) {
+  // Reads a token with macros expanded. Returns 0 as PeekToken() does.
+  if (!ReadToken(t, floor)) return 0;
+  for (;;) {
+    Macro *macro = GetMacroToExpand(t);
+    if (!macro) return 1;
+    if (macro->is_function_like) {
+      PPToken name = *t;
+      if (!ExpandFunctionLikeMacro(macro, &name, floor)) return 1;
+    } else if (macro->end - macro->begin == 1) {
+      // Fast path: a single token needs no context.
+      t->token = GetTokenAt(macro->tokens, macro->begin);
+      t->hide_set = AddToHideSet(t->hide_set, macro->sym);
+      continue;
+    } else {
+      PushMacroContext(macro->tokens, macro->begin, macro->end,
+                       AddToHideSet(t->hide_set, macro->sym));
+    }
+    if (!ReadToken(t, floor)) return 0;
+  }
+}
+
+//
+// #if
+//
+
+// Values have the type intmax_t or uintmax_t (6.10.1p4).
+typedef struct {
+  long long value;  // the bits of an unsigned value
+  int is_unsigned;
+} ConstExprValue;
+
+typedef struct {
+  const PPTokenList *tokens;
+  int pos;
+  const Token *directive;
+  int unevaluated;  // in an operand that is not evaluated if nonzero
+} ConstExprParser;
+
+static ConstExprValue EvalConditionalExpr(ConstExprParser *p);
+
+static const Token *PeekConstExprToken(ConstExprParser *p) {
+  if (p->pos >= p->tokens->size) return NULL;
+  return p->tokens->tokens[p->pos].token;
+}
+
+static void ConstExprError(ConstExprParser *p) {
+  Error("Invalid expression in #%s (%s)", GetTokenStr(p->directive),
+        GetSourceLocationStr(p->directive->loc));
+}
+
+static void ExpectConstExprToken(ConstExprParser *p, int sym) {
+  if (!IsEqualToken(PeekConstExprToken(p), sym)) ConstExprError(p);
+  p->pos++;
+}
+
+static ConstExprValue MakeConstExprValue(long long value, int is_unsigned) {
+  ConstExprValue v = {value, is_unsigned};
+  return v;
+}
+
+static ConstExprValue EvalUnaryExpr(ConstExprParser *p) {
+  const Token *token = PeekConstExprToken(p);
+  if (!token) ConstExprError(p);
+  p->pos++;
+  ConstExprValue v;
+  switch (token->sym) {
+    case kSymLParen:
+      v = EvalConditionalExpr(p);
+      ExpectConstExprToken(p, kSymRParen);
+      return v;
+    case kSymPlus:
+      return EvalUnaryExpr(p);
+    case kSymMinus:
+      // Computed in unsigned to wrap around instead of overflowing.
+      v = EvalUnaryExpr(p);
+      v.value = (long long)(0 - (unsigned long long)v.value);
+      return v;
+    case kSymNot:
+      return MakeConstExprValue(!EvalUnaryExpr(p).value, 0);
+    case kSymTilde:
+      v = EvalUnaryExpr(p);
+      v.value = ~v.value;
+      return v;
+  }
+  if (token->type == kInteger) {
+    char *end;
+    unsigned long long value = strtoull(token->begin, &end, 0);
+    // Too large for intmax_t, it is uintmax_t as a hexadecimal or octal
+    // constant would be.
+    int is_unsigned = value > LLONG_MAX;
+    while (end < token->begin + token->length &&
+           (*end == 'u' || *end == 'U' || *end == 'l' || *end == 'L')) {
+      if (*end == 'u' || *end == 'U') is_unsigned = 1;
+      end++;
+    }
+    if (end != token->begin + token->length) ConstExprError(p);
+    return MakeConstExprValue((long long)value, is_unsigned);
+  }
+  if (token->type == kCharacterLiteral) {
+    return MakeConstExprValue(GetCharacterLiteralValue(token), 0);
+  }
+  // Identifiers left after macro expansion are 0.
+  if (token->type == kIdentifier) return MakeConstExprValue(0, 0);
+  ConstExprError(p);
+  return MakeConstExprValue(0, 0);
+}
+
+static int GetBinaryOpPrecedence(const Token *token) {
+  if (!token) return 0;
+  switch (token->sym) {
+    case kSymStar:
+    case kSymSlash:
+    case kSymPercent:
+      return 10;
+    case kSymPlus:
+    case kSymMinus:
+      return 9;
+    case kSymShl:
+    case kSymShr:
+      return 8;
+    case kSymLt:
+    case kSymGt:
+    case kSymLtEq:
+    case kSymGtEq:
+      return 7;
+    case kSymEq:
+    case kSymNotEq:
+      return 6;
+    case kSymAnd:
+      return 5;
+    case kSymXor:
+      return 4;
+    case kSymOr:
+      return 3;
+    case kSymLogicalAnd:
+      return 2;
+    case kSymLogicalOr:
+      return 1;
+  }
+  return 0;
+}
+
+static int EvalShiftCount(ConstExprParser *p, ConstExprValue count) {
+  // Returns the count, or 0 for a count that would be undefined in an
+  // operand that is not evaluated.
+  if (count.is_unsigned ? (unsigned long long)count.value < 64
+                        : count.value >= 0 && count.value < 64) {
+    return (int)count.value;
+  }
+  if (!p->unevaluated) {
+    Error("Invalid shift count in #%s (%s)", GetTokenStr(p->directive),
+          GetSourceLocationStr(p->directive->loc));
+  }
+  return 0;
+}
+
+static long long EvalDivision(ConstExprParser *p, const Token *op,
+                              ConstExprValue lhs, ConstExprValue rhs) {
+  if (!rhs.value) {
+    if (p->unevaluated) return 0;
+    Error("Division by zero in #%s (%s)", GetTokenStr(p->directive),
+          GetSourceLocationStr(p->directive->loc));
+  }
+  if (lhs.is_unsigned || rhs.is_unsigned) {
+    unsigned long long l = lhs.value;
+    unsigned long long r = rhs.value;
+    return op->sym == kSymSlash ? l / r : l % r;
+  }
+  // LLONG_MIN / -1 overflows, so it wraps around as -x does.
+  if (rhs.value == -1) {
+    return op->sym == kSymSlash ? (long long)(0 - (unsigned long long)lhs.value)
+                                : 0;
+  }
+  return op->sym == kSymSlash ? lhs.value / rhs.value : lhs.value % rhs.value;
+}
+
+static int CompareConstExprValues(ConstExprValue lhs, ConstExprValue rhs) {
+  // Returns <0, 0 or >0 as lhs is less than, equal to or greater than rhs
+  // in their common type.
+  if (lhs.is_unsigned || rhs.is_unsigned) {
+    unsigned long long l = lhs.value;
+    unsigned long long r = rhs.value;
+    return (l > r) - (l < r);
+  }
+  return (lhs.value > rhs.value) - (lhs.value < rhs.value);
+}
+
+static ConstExprValue EvalBinaryExpr(ConstExprParser *p, int min_precedence) {
+  ConstExprValue lhs = EvalUnaryExpr(p);
+  for (;;) {
+    const Token *op = PeekConstExprToken(p);
+    int precedence = GetBinaryOpPrecedence(op);
+    if (!precedence || precedence < min_precedence) return lhs;
+    p->pos++;
+    // The right operand of && and || is not evaluated if the left one
+    // decides the result.
+    int is_unevaluated = (op->sym == kSymLogicalAnd && !lhs.value) ||
+                         (op->sym == kSymLogicalOr && lhs.value);
+    p->unevaluated += is_unevaluated;
+    ConstExprValue rhs = EvalBinaryExpr(p, precedence + 1);
+    p->unevaluated -= is_unevaluated;
+    // The usual arithmetic conversions, except for shifts.
+    int is_unsigned = lhs.is_unsigned || rhs.is_unsigned;
+    // Computed in unsigned to wrap around instead of overflowing.
+    unsigned long long l = lhs.value;
+    unsigned long long r = rhs.value;
+    switch (op->sym) {
+      case kSymStar:
+        lhs = MakeConstExprValue((long long)(l * r), is_unsigned);
+        break;
+      case kSymSlash:
+      case kSymPercent:
+        lhs = MakeConstExprValue(EvalDivision(p, op, lhs, rhs), is_unsigned);
+        break;
+      case kSymPlus:
+        lhs = MakeConstExprValue((long long)(l + r), is_unsigned);
+        break;
+      case kSymMinus:
+        lhs = MakeConstExprValue((long long)(l - r), is_unsigned);
+        break;
+      case kSymShl:
+        lhs.value = (long long)(l << EvalShiftCount(p, rhs));
+        break;
+      case kSymShr:
+        if (lhs.is_unsigned) {
+          lhs.value = (long long)(l >> EvalShiftCount(p, rhs));
+        } else {
+          lhs.value >>= EvalShiftCount(p, rhs);
+        }
+        break;
+      case kSymLt:
+        lhs = MakeConstExprValue(CompareConstExprValues(lhs, rhs) < 0, 0);
+        break;
+      case kSymGt:
+        lhs = MakeConstExprValue(CompareConstExprValues(lhs, rhs) > 0, 0);
+        break;
+      case kSymLtEq:
+        lhs = MakeConstExprValue(CompareConstExprValues(lhs, rhs) <= 0, 0);
+        break;
+      case kSymGtEq:
+        lhs = MakeConstExprValue(CompareConstExprValues(lhs, rhs) >= 0, 0);
+        break;
+      case kSymEq:
+        lhs = MakeConstExprValue(lhs.value == rhs.value, 0);
+        break;
+      case kSymNotEq:
+        lhs = MakeConstExprValue(lhs.value != rhs.value, 0);
+        break;
+      case kSymAnd:
+        lhs = MakeConstExprValue(lhs.value & rhs.value, is_unsigned);
+        break;
+      case kSymXor:
+        lhs = MakeConstExprValue(lhs.value ^ rhs.value, is_unsigned);
+        break;
+      case kSymOr:
+        lhs = MakeConstExprValue(lhs.value | rhs.value, is_unsigned);
+        break;
+      case kSymLogicalAnd:
+        lhs = MakeConstExprValue(lhs.value && rhs.value, 0);
+        break;
+      case kSymLogicalOr:
+        lhs = MakeConstExprValue(lhs.value || rhs.value, 0);
+        break;
+    }
+  }
+}
+
+static ConstExprValue EvalConditionalExpr(ConstExprParser *p) {
+  ConstExprValue cond = EvalBinaryExpr(p, 1);
+  if (!IsEqualToken(PeekConstExprToken(p), kSymQuestion)) return cond;
+  p->pos++;
+  // Only the operand that is chosen is evaluated.
+  p->unevaluated += !cond.value;
+  ConstExprValue true_value = EvalConditionalExpr(p);
+  p->unevaluated -= !cond.value;
+  ExpectConstExprToken(p, kSymColon);
+  p->unevaluated += !!cond.value;
+  ConstExprValue false_value = EvalConditionalExpr(p);
+  p->unevaluated -= !!cond.value;
+  // The result has the type both operands are converted to.
+  ConstExprValue value = cond.value ? true_value : false_value;
+  value.is_unsigned = true_value.is_unsigned || false_value.is_unsigned;
+  return value;
+}
+
+static int EvalIfCondition(TokenList *raw_tokens, int begin) {
+  // begin: index of the directive name (if or elif)
+  const Token *directive = GetTokenAt(raw_tokens, begin);
+  int end = SkipDirective(raw_tokens, begin) - 1;
+  PPTokenList tokens = {NULL, 0, 0};
+  int floor = num_of_contexts;
+  PushMacroContext(raw_tokens, begin + 1, end, 0);
+  PPToken t;
+  while (PeekToken(&t, floor)) {
+    if (!IsEqualToken(t.token, kSymDefined)) {
+      if (!ReadExpandedToken(&t, floor)) break;
+      AppendPPToken(&tokens, t.token, t.hide_set);
+      continue;
+    }
+    // defined X, defined(X)
+    ConsumeToken(floor);
+    int has_paren = PeekToken(&t, floor) && IsEqualToken(t.token, kSymLParen);
+    if (has_paren) ConsumeToken(floor);
+    if (!ReadToken(&t, floor) || t.token->type != kIdentifier) {
+      Error("Expected a macro name after defined (%s)",
+            GetSourceLocationStr(directive->loc));
+    }
+    AppendPPToken(&tokens, FindMacro(t.token->sym) ? &kOneToken : &kZeroToken,
+                  0);
+    if (has_paren &&
+        (!ReadToken(&t, floor) || !IsEqualToken(t.token, kSymRParen))) {
+      Error("Expected ) after defined (%s)",
+            GetSourceLocationStr(directive->loc));
+    }
+  }
+  ConstExprParser p = {&tokens, 0, directive, 0};
+  ConstExprValue value = EvalConditionalExpr(&p);
+  if (p.pos != tokens.size) ConstExprError(&p);
+  free(tokens.tokens);
+  return value.value != 0;
+}
+
+//
+// Directives
+//
+
+static void DetectIncludeGuard(HeaderFile *file) {
+  // # ifndef X \n # define X \n ... # endif \n
+  TokenList *tokens = file->raw_tokens;
+  int guard_sym = GetTokenSymAt(tokens, 2);
+  if (!IsEqualTokenAt(tokens, 0, kSymHash) ||
+      !IsEqualTokenAt(tokens, 1, kSymIfndef) ||
+      GetTokenTypeAt(tokens, 2) != kIdentifier ||
+      !IsEqualTokenAt(tokens, 3, kSymEndOfDirective) ||
+      !IsEqualTokenAt(tokens, 4, kSymHash) ||
+      !IsEqualTokenAt(tokens, 5, kSymDefine) ||
+      !IsEqualTokenAt(tokens, 6, guard_sym) ||
+      !IsEqualTokenAt(tokens, 7, kSymEndOfDirective))
+    return;
+  // The #endif matching the #ifndef must be the last thing in the file, and
+  // the #ifndef must have no other group, which a later inclusion would read.
+  int size = GetSizeOfTokenList(tokens);
+  int depth = 0;
+  for (int i = 0; i < size;) {
+    if (!IsEqualTokenAt(tokens, i, kSymHash)) {
+      i++;
+      continue;
+    }
+    int directive_begin = i;
+    switch (GetTokenSymAt(tokens, i + 1)) {
+      case kSymIf:
+      case kSymIfdef:
+      case kSymIfndef:
+        depth++;
+        break;
+      case kSymElif:
+      case kSymElse:
+        if (depth == 1) return;
+        break;
+      case kSymEndif:
+        depth--;
+        break;
+    }
+    i = SkipDirective(tokens, i + 1);
+    if (depth == 0) {
+      if (i != size) return;
+      file->guard_sym = guard_sym;
+      file->guard_body_begin = 8;
+      file->guard_body_end = directive_begin;
+      return;
+    }
+  }
+}
+
+static HeaderFile *LoadHeaderFile(const char *path) {
+  // Returns NULL if path does not exist.
+  char *canonical_path = realpath(path, NULL);
+  if (!canonical_path) return NULL;
+  int path_sym = InternSymbol(canonical_path, strlen(canonical_path));
+  for (HeaderFile *file = header_files; file; file = file->next) {
+    if (file->path_sym == path_sym) {
+      free(canonical_path);
+      return file;
+    }
+  }
+  HeaderFile *file = calloc(1, sizeof(HeaderFile));
+  if (!file) Error("Failed to allocate HeaderFile");
+  file->path = GetSymbolStr(path_sym);
+  file->path_sym = path_sym;
+  file->raw_tokens = AllocateTokenList();
+  int src_size;
+  const char *src = ReadFile(file->path, &src_size);
+  TokenizeWithCache(file->raw_tokens,
+                    AddSourceBuffer(file->path, src, src_size));
+  DetectIncludeGuard(file);
+  file->next = header_files;
+  header_files = file;
+  free(canonical_path);
+  return file;
+}
+
+static HeaderFile *LoadHeaderFileInDir(const char *dir, int dir_len,
+                                       const char *name) {
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%.*s/%s", dir_len, dir, name) >=
+      (int)sizeof(path))
+    return NULL;
+  return LoadHeaderFile(path);
+}
+
+static HeaderFile *FindHeaderFile(const Token *name_token,
+                                  const char *includer) {
+  const char *name = GetTokenStr(name_token);
+  if (name[0] == '/') return LoadHeaderFile(name);
+  HeaderFile *file = NULL;
+  if (name_token->type == kStringLiteral) {
+    // "..." is searched from the directory of the includer first.
+    const char *slash = strrchr(includer, '/');
+    if (slash) {
+      file = LoadHeaderFileInDir(includer, slash - includer, name);
+    } else {
+      file = LoadHeaderFileInDir(".", 1, name);
+    }
+  }
+  for (int i = 0; !file && i < num_of_include_paths; i++) {
+    file = LoadHeaderFileInDir(include_paths[i], strlen(include_paths[i]),
+                               name);
+  }
+  return file;
+}
+
+static void PushSourceFrame(HeaderFile *file, int begin, int end) {
+  if (num_of_source_frames > MAX_INCLUDE_DEPTH) {
+    Error("#include nested too deeply (%s)", file->path);
+  }
+  SourceFrame *frame = &source_frames[num_of_source_frames++];
+  memset(frame, 0, sizeof(SourceFrame));
+  frame->file = file;
+  frame->filename = file->path;
+  frame->raw_tokens = file->raw_tokens;
+  frame->pos = begin;
+  frame->end = end;
+}
+
+static void PopSourceFrame() {
+  if (num_of_conditionals &&
+      conditionals[num_of_conditionals - 1].frame_depth ==
+          num_of_source_frames) {
+    Error("Unterminated conditional directive (%s)",
+          source_frames[num_of_source_frames - 1].filename);
+  }
+  num_of_source_frames--;
+}
+
+static void IncludeHeaderFile(TokenList *raw_tokens, int begin,
+                              const SourceFrame *includer) {
+  const Token *name_token = GetTokenAt(raw_tokens, begin);
+  if (!name_token ||
+      (name_token->type != kStringLiteral &&
+       name_token->type != kHeaderName) ||
+      !IsEqualTokenAt(raw_tokens, begin + 1, kSymEndOfDirective)) {
+    Error("#include expects \"FILENAME\" or <FILENAME> (%s)",
+          GetSourceLocationStr(GetTokenAt(raw_tokens, begin - 1)->loc));
+  }
+  HeaderFile *file = FindHeaderFile(name_token, includer->filename);
+  if (!file) {
+    Error("%s: No such file (%s)", GetTokenStr(name_token),
+          GetSourceLocationStr(name_token->loc));
+  }
+  if (file->pragma_once && file->num_of_inclusions) return;
+  if (file->guard_sym && FindMacro(file->guard_sym)) return;
+  file->num_of_inclusions++;
+  if (file->guard_sym) {
+    // Same as running the "#define X" at the top of the file.
+    Macro *guard = calloc(1, sizeof(Macro));
+    if (!guard) Error("Failed to allocate Macro");
+    guard->sym = file->guard_sym;
+    guard->tokens = file->raw_tokens;
+    SetMacro(guard->sym, guard);
+    PushSourceFrame(file, file->guard_body_begin, file->guard_body_end);
+    return;
+  }
+  PushSourceFrame(file, 0, GetSizeOfTokenList(file->raw_tokens));
+}
+
+static void CheckMacroName(const Token *token) {
+  if (token->type != kIdentifier) {
+    Error("Macro names must be identifiers (%s)",
+          GetSourceLocationStr(token->loc));
+  }
+}
+
+static void DefineMacro(TokenList *raw_tokens, int begin,
+                        const SourceFrame *frame) {
+  // begin: index of the macro name
+  const Token *name = GetTokenAt(raw_tokens, begin);
+  CheckMacroName(name);
+  Macro *macro = calloc(1, sizeof(Macro));
+  if (!macro) Error("Failed to allocate Macro");
+  macro->sym = name->sym;
+  int index = begin + 1;
+  const Token *lparen = GetTokenAt(raw_tokens, index);
+  if (IsEqualToken(lparen, kSymLParen) &&
+      lparen->begin == name->begin + name->length) {
+    // Function-like: '(' follows the name without spaces.
+    macro->is_function_like = 1;
+    index++;
+    if (IsEqualTokenAt(raw_tokens, index, kSymRParen)) {
+      index++;
+    } else {
+      for (;;) {
+        const Token *param = GetTokenAt(raw_tokens, index++);
+        int sym = param->sym;
+        if (IsEqualToken(param, kSymEllipsis)) {
+          macro->is_variadic = 1;
+          sym = kSymVaArgs;
+        } else if (param->type != kIdentifier) {
+          Error("Expected a parameter name (%s)",
+                GetSourceLocationStr(param->loc));
+        }
+        macro->params =
+            realloc(macro->params, sizeof(int) * (macro->num_of_params + 1));
+        if (!macro->params) Error("Failed to allocate Macro");
+        macro->params[macro->num_of_params++] = sym;
+        const Token *delimiter = GetTokenAt(raw_tokens, index++);
+        if (IsEqualToken(delimiter, kSymRParen)) break;
+        if (macro->is_variadic || !IsEqualToken(delimiter, kSymComma)) {
+          Error("Expected , or ) in the parameter list (%s)",
+                GetSourceLocationStr(delimiter->loc));
+        }
+      }
+    }
+  }
+  int end = SkipDirective(raw_tokens, index) - 1;
+  if (frame->file) {
+    // Raw tokens of headers live until the process exits.
+    macro->tokens = raw_tokens;
+    macro->begin = index;
+    macro->end = end;
+  } else {
+    // The lexing buffer of the main file is reused, so copy the body once.
+    if (!macro_body_tokens) macro_body_tokens = AllocateTokenList();
+    macro->tokens = macro_body_tokens;
+    macro->begin = GetSizeOfTokenList(macro_body_tokens);
+    for (int i = index; i < end; i++) {
+      AppendTokenToList(macro_body_tokens, GetTokenAt(raw_tokens, i));
+    }
+    macro->end = GetSizeOfTokenList(macro_body_tokens);
+  }
+  if (macro->is_function_like) {
+    int size = macro->end - macro->begin;
+    macro->param_indexes = malloc(sizeof(int) * (size + 1));
+    if (!macro->param_indexes) Error("Failed to allocate Macro");
+    for (int i = 0; i < size; i++) {
+      const Token *token = GetTokenAt(macro->tokens, macro->begin + i);
+      macro->param_indexes[i] =
+          token->type == kIdentifier ? FindParam(macro, token->sym) : -1;
+    }
+  }
+  SetMacro(macro->sym, macro);
+}
+
+static void PushConditional(int is_taken) {
+  if (num_of_conditionals >= conditional_capacity) {
+    conditional_capacity = conditional_capacity ? conditional_capacity * 2 : 16;
+    conditionals =
+        realloc(conditionals, sizeof(Conditional) * conditional_capacity);
+    if (!conditionals) Error("Failed to grow conditionals");
+  }
+  Conditional *cond = &conditionals[num_of_conditionals++];
+  cond->frame_depth = num_of_source_frames;
+  cond->is_taken = is_taken;
+  cond->has_else = 0;
+}
+
+static Conditional *GetCurrentConditional(const Token *directive) {
+  if (!num_of_conditionals ||
+      conditionals[num_of_conditionals - 1].frame_depth !=
+          num_of_source_frames) {
+    Error("#%s without #if (%s)", GetTokenStr(directive),
+          GetSourceLocationStr(directive->loc));
+  }
+  return &conditionals[num_of_conditionals - 1];
+}
+
+static void SkipConditionalGroup(SourceFrame *frame) {
+  // Skips tokens up to the #elif, #else or #endif that ends the current group,
+  // which is left to be read next.
+  int depth = 0;
+  for (;;) {
+    DiscardConsumedRawTokens(frame);
+    const Token *token = PeekSourceToken(frame);
+    if (!token) {
+      Error("Unterminated conditional directive (%s)", frame->filename);
+    }
+    if (token->sym != kSymHash) {
+      frame->pos++;
+      continue;
+    }
+    switch (GetTokenSymAt(frame->raw_tokens, frame->pos + 1)) {
+      case kSymIf:
+      case kSymIfdef:
+      case kSymIfndef:
+        depth++;
+        break;
+      case kSymElif:
+      case kSymElse:
+        if (depth == 0) return;
+        break;
+      case kSymEndif:
+        if (depth == 0) return;
+        depth--;
+        break;
+    }
+    frame->pos = SkipDirective(frame->raw_tokens, frame->pos + 1);
+  }
+}
+
+static void ExecuteDirective(TokenList *raw_tokens, int begin,
+                             SourceFrame *frame) {
+  // begin: index of the token after '#'
+  // frame->pos is already after the directive.
+  const Token *directive = GetTokenAt(raw_tokens, begin);
+  const Token *operand = GetTokenAt(raw_tokens, begin + 1);
+  switch (directive->sym) {
+    case kSymEndOfDirective:
+      // null directive
+      return;
+    case kSymInclude:
+      IncludeHeaderFile(raw_tokens, begin + 1, frame);
+      return;
+    case kSymDefine:
+      DefineMacro(raw_tokens, begin + 1, frame);
+      return;
+    case kSymUndef:
+      CheckMacroName(operand);
+      SetMacro(operand->sym, NULL);
+      return;
+    case kSymIf:
+    case kSymIfdef:
+    case kSymIfndef: {
+      int is_taken;
+      if (directive->sym == kSymIf) {
+        is_taken = EvalIfCondition(raw_tokens, begin);
+      } else {
+        CheckMacroName(operand);
+        is_taken = (FindMacro(operand->sym) != NULL) ==
+                   (directive->sym == kSymIfdef);
+      }
+      PushConditional(is_taken);
+      if (!is_taken) SkipConditionalGroup(frame);
+      return;
+    }
+    case kSymElif: {
+      Conditional *cond = GetCurrentConditional(directive);
+      if (cond->has_else) {
+        Error("#elif after #else (%s)", GetSourceLocationStr(directive->loc));
+      }
+      if (cond->is_taken || !EvalIfCondition(raw_tokens, begin)) {
+        SkipConditionalGroup(frame);
+        return;
+      }
+      cond->is_taken = 1;
+      return;
+    }
+    case kSymElse: {
+      Conditional *cond = GetCurrentConditional(directive);
+      if (cond->has_else) {
+        Error("#else after #else (%s)", GetSourceLocationStr(directive->loc));
+      }
+      cond->has_else = 1;
+      if (cond->is_taken) {
+        SkipConditionalGroup(frame);
+        return;
+      }
+      cond->is_taken = 1;
+      return;
+    }
+    case kSymEndif:
+      GetCurrentConditional(directive);
+      num_of_conditionals--;
+      return;
+    case kSymError: {
+      int end = SkipDirective(raw_tokens, begin) - 1;
+      const Token *last = GetTokenAt(raw_tokens, end - 1);
+      const char *message = operand->begin - IsLiteralToken(operand);
+      int length = 0;
+      if (last != directive) {
+        length = last->begin + last->length + IsLiteralToken(last) - message;
+      }
+      Error("#error %.*s (%s)", length, message,
+            GetSourceLocationStr(directive->loc));
+      return;
+    }
+    case kSymLine:
+      // Line numbers are not remapped.
+      return;
+    case kSymPragma:
+      if (IsEqualToken(operand, kSymOnce) && frame->file) {
+        frame->file->pragma_once = 1;
+      }
+      // Other pragmas are ignored.
+      return;
+  }
+  Error("Unknown preprocessor directive '%s' (%s)", GetTokenStr(directive),
+        GetSourceLocationStr(directive->loc));
+}
+
+void BeginPreprocess(const SourceBuffer *buffer) {
+  SourceFrame *frame = &source_frames[0];
+  memset(frame, 0, sizeof(SourceFrame));
+  frame->filename = buffer->filename;
+  frame->raw_tokens = AllocateTokenList();
+  frame->buffer = buffer;
+  frame->src = buffer->begin;
+  num_of_source_frames = 1;
+  num_of_conditionals = 0;
+  num_of_contexts = 0;
+  expanded_tokens.size = 0;
+  if (!generated_tokens) generated_tokens = AllocateTokenList();
+}
+
+int PreprocessNext(TokenList *tokens) {
+  // Appends the next tokens to tokens. Returns 0 at the end of input.
+  while (num_of_source_frames) {
+    SourceFrame *frame = &source_frames[num_of_source_frames - 1];
+    if (!num_of_contexts) {
+      // Nothing refers to expanded_tokens or consumed raw tokens here.
+      expanded_tokens.size = 0;
+      DiscardConsumedRawTokens(frame);
+      const Token *token = PeekSourceToken(frame);
+      if (!token) {
+        PopSourceFrame();
+        continue;
+      }
+      if (token->sym == kSymHash) {
+        int index = frame->pos;
+        frame->pos = SkipDirective(frame->raw_tokens, index + 1);
+        ExecuteDirective(frame->raw_tokens, index + 1, frame);
+        return 1;
+      }
+    }
+    PPToken t;
+    if (!ReadExpandedToken(&t, READ_SOURCE)) continue;
+    AppendTokenToList(tokens, t.token);
+    return 1;
+  }
+  return 0;
+}
+
+void Preprocess(TokenList *tokens, const SourceBuffer *buffer) {
+  BeginPreprocess(buffer);
+  while (PreprocessNext(tokens)) {
+  }
+}
@@ -0,0 +1,193 @@
+#include "compilium.h"
+
+// Linear scan register allocation (Poletto and Sarkar).
+// The live intervals are visited in the order of their starts. An interval
+// gets a register that is free over all of it, or its own stack slot if
+// none is. When registers run out, the interval that ends last, among the
+// current one and those holding a register it could use, goes to a stack
+// slot, so the spilled values are the ones that would block registers the
+// longest. A spilled value lives in its slot from its def to its last use,
+// so it is stored once per def, and slots are shared by intervals that do
+// not overlap. Every register is clobbered by a call, so values that live
+// across one only get the callee-saved registers, which are saved on entry.
+// Intervals are not split: a spilled value stays in its slot over its whole
+// interval, and is read from there at every use, even in the parts where
+// registers are free. A value that lives across a call while the
+// callee-saved registers are taken is spilled as a whole, not just around
+// the call.
+
+static const RealReg caller_saved_regs[] = {
+    kRealRegRdi, kRealRegRsi, kRealRegRdx, kRealRegRcx,
+    kRealRegR8,  kRealRegR9,  kRealRegR10, kRealRegR11};
+static const RealReg callee_saved_regs[] = {
+    kRealRegRbx, kRealRegR12, kRealRegR13, kRealRegR14, kRealRegR15};
+
+#define NUM_OF_CALLER_SAVED_REGS \
+  (int)(sizeof(caller_saved_regs) / sizeof(caller_saved_regs[0]))
+#define NUM_OF_CALLEE_SAVED_REGS \
+  (int)(sizeof(callee_saved_regs) / sizeof(callee_saved_regs[0]))
+
+typedef struct {
+  int reg;
+  int start;
+  int end;
+  int crosses_call;
+} ScanInterval;
+
+typedef struct {
+  RegAllocation *allocation;
+  const ScanInterval **owners;  // of the real registers, NULL: free
+  int *slot_ends;  // the last position used by the intervals in each slot
+  int num_of_slots;
+  int slot_base;  // offset of the slots from rbp, exclusive
+} LinearScan;
+
+static int CompareIntervalStarts(const void *a, const void *b) {
+  const ScanInterval *l = a;
+  const ScanInterval *r = b;
+  if (l->start != r->start) return l->start < r->start ? -1 : 1;
+  return l->reg - r->reg;
+}
+
+static void AssignSlot(LinearScan *scan, const ScanInterval *interval) {
+  // A slot is reused once every interval in it has ended.
+  int slot = 0;
+  while (slot < scan->num_of_slots &&
+         scan->slot_ends[slot] >= interval->start) {
+    slot++;
+  }
+  if (slot == scan->num_of_slots) scan->num_of_slots++;
+  scan->slot_ends[slot] = interval->end;
+  RegLocation *location = &scan->allocation->locations[interval->reg];
+  location->real_reg = kRealRegNone;
+  location->offset = scan->slot_base + 8 * (slot + 1);
+}
+
+static RealReg FindFreeReg(const LinearScan *scan,
+                           const ScanInterval *interval) {
+  if (!interval->crosses_call) {
+    for (int i = 0; i < NUM_OF_CALLER_SAVED_REGS; i++) {
+      if (!scan->owners[caller_saved_regs[i]]) return caller_saved_regs[i];
+    }
+  }
+  for (int i = 0; i < NUM_OF_CALLEE_SAVED_REGS; i++) {
+    if (!scan->owners[callee_saved_regs[i]]) return callee_saved_regs[i];
+  }
+  return kRealRegNone;
+}
+
+static RealReg FindRegToSteal(const LinearScan *scan,
+                              const ScanInterval *interval) {
+  // Returns the register of the interval that ends last, if it ends after
+  // interval.
+  RealReg victim = kRealRegNone;
+  int end = interval->end;
+  for (int r = kRealRegRdi; r < kNumOfRealRegs; r++) {
+    const ScanInterval *owner = scan->owners[r];
+    if (interval->crosses_call && r < kRealRegRbx) continue;
+    if (owner->end > end) {
+      victim = r;
+      end = owner->end;
+    }
+  }
+  return victim;
+}
+
+static void ScanIntervals(LinearScan *scan, const ScanInterval *intervals,
+                          int num_of_intervals) {
+  for (int i = 0; i < num_of_intervals; i++) {
+    const ScanInterval *interval = &intervals[i];
+    // An interval that ends where this one starts still holds its register
+    // there, so the result of an instruction never shares a register with
+    // its operands.
+    for (int r = kRealRegRdi; r < kNumOfRealRegs; r++) {
+      if (scan->owners[r] && scan->owners[r]->end < interval->start) {
+        scan->owners[r] = NULL;
+      }
+    }
+    RealReg real_reg = FindFreeReg(scan, interval);
+    if (!real_reg) {
+      real_reg = FindRegToSteal(scan, interval);
+      if (!real_reg) {
+        AssignSlot(scan, interval);
+        continue;
+      }
+      AssignSlot(scan, scan->owners[real_reg]);
+    }
+    scan->owners[real_reg] = interval;
+    scan->allocation->locations[interval->reg].real_reg = real_reg;
+    if (real_reg >= kRealRegRbx) {
+      scan->allocation->saved_offsets[real_reg] = 1;  // numbered later
+    }
+  }
+}
+
+static ScanInterval *CollectIntervals(const ILFunc *func,
+                                      const ILLiveness *liveness,
+                                      int *num_of_intervals) {
+  // calls_before[p]: the number of calls at positions before p
+  int num_of_positions = liveness->block_begin[func->num_of_blocks];
+  int *calls_before = calloc(num_of_positions + 1, sizeof(int));
+  ScanInterval *intervals = malloc(sizeof(ScanInterval) * func->num_of_regs);
+  if (!calls_before || !intervals) Error("Failed to allocate intervals");
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    const ILBlock *block = &func->blocks[i];
+    for (int k = 0; k < block->num_of_instrs; k++) {
+      int position = liveness->block_begin[i] + k;
+      calls_before[position + 1] =
+          calls_before[position] + (block->instrs[k].op == kILOpCall);
+    }
+  }
+  *num_of_intervals = 0;
+  for (int reg = 1; reg < func->num_of_regs; reg++) {
+    const ILInterval *live = &liveness->intervals[reg];
+    if (live->start < 0) continue;
+    ScanInterval *interval = &intervals[(*num_of_intervals)++];
+    interval->reg = reg;
+    interval->start = live->start;
+    interval->end = live->end;
+    // A call defines its result after the others are clobbered, and the
+    // args are used before that.
+    interval->crosses_call =
+        calls_before[live->end] - calls_before[live->start + 1] > 0;
+  }
+  free(calls_before);
+  qsort(intervals, *num_of_intervals, sizeof(ScanInterval),
+        CompareIntervalStarts);
+  return intervals;
+}
+
+RegAllocation *AllocateRegisters(const ILFunc *func,
+                                 const ILLiveness *liveness) {
+  RegAllocation *allocation = calloc(1, sizeof(RegAllocation));
+  if (!allocation) Error("Failed to allocate RegAllocation");
+  allocation->locations = calloc(func->num_of_regs, sizeof(RegLocation));
+  if (!allocation->locations) Error("Failed to allocate RegAllocation");
+  int num_of_intervals;
+  ScanInterval *intervals =
+      CollectIntervals(func, liveness, &num_of_intervals);
+  const ScanInterval *owners[kNumOfRealRegs] = {NULL};
+  LinearScan scan = {
+      .allocation = allocation,
+      .owners = owners,
+      .slot_ends = malloc(sizeof(int) * (num_of_intervals + 1)),
+      .slot_base = (func->func_def->frame_size + 7) & ~7,
+  };
+  if (!scan.slot_ends) Error("Failed to allocate stack slots");
+  ScanIntervals(&scan, intervals, num_of_intervals);
+  int offset = scan.slot_base + 8 * scan.num_of_slots;
+  for (int r = kRealRegRbx; r < kNumOfRealRegs; r++) {
+    if (!allocation->saved_offsets[r]) continue;
+    offset += 8;
+    allocation->saved_offsets[r] = offset;
+  }
+  allocation->frame_size = offset;
+  free(scan.slot_ends);
+  free(intervals);
+  return allocation;
+}
+
+void FreeRegAllocation(RegAllocation *allocation) {
+  free(allocation->locations);
+  free(allocation);
+}
@@ -0,0 +1,221 @@
+#include "compilium.h"
+
+// Character-class scanners used by the tokenizer.
+// Each scanner returns a pointer to the first char that is not in its class.
+// The input must be NUL-terminated; NUL is never in any class.
+//
+// The SIMD versions only issue aligned loads, so they never touch a page that
+// does not contain a byte of the input, and mask off bytes before p.
+// An aligned load can still read past the end of a heap buffer, within its
+// page, which AddressSanitizer reports; the bytes read there never reach
+// the result, since the NUL ends every class before them, so the SIMD
+// versions are not instrumented.
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SCAN_USE_SIMD 1
+#include <immintrin.h>
+#include <stdint.h>
+#endif
+
+#define IS_IDENT_CHAR(c) \
+  ((c) == '_' || ('a' <= (c) && (c) <= 'z') || ('A' <= (c) && (c) <= 'Z') || \
+   ('0' <= (c) && (c) <= '9'))
+#define IS_DIGIT_CHAR(c) ('0' <= (c) && (c) <= '9')
+
+static const char *SkipIdentCharsScalar(const char *p) {
+  while (IS_IDENT_CHAR(*p)) p++;
+  return p;
+}
+
+static const char *SkipDigitsScalar(const char *p) {
+  while (IS_DIGIT_CHAR(*p)) p++;
+  return p;
+}
+
+static const char *SkipQuotedCharsScalar(const char *p, char quote) {
+  while (*p && *p != quote && *p != '\\') p++;
+  return p;
+}
+
+static const char *SkipSpacesScalar(const char *p) {
+  while (*p == ' ' || *p == '\n') p++;
+  return p;
+}
+
+static const char *SkipToNewlineScalar(const char *p) {
+  while (*p && *p != '\n') p++;
+  return p;
+}
+
+#ifdef SCAN_USE_SIMD
+
+#define NO_ASAN __attribute__((no_sanitize_address))
+
+// Range checks below use signed compares, which is fine since every class
+// consists of ASCII chars and bytes >= 0x80 compare as negative.
+
+static inline __m128i InRange16(__m128i v, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+static inline unsigned int IdentMask16(__m128i v) {
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i m = _mm_or_si128(InRange16(lower, 'a', 'z'), InRange16(v, '0', '9'));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+  return _mm_movemask_epi8(m);
+}
+
+static inline unsigned int DigitMask16(__m128i v) {
+  return _mm_movemask_epi8(InRange16(v, '0', '9'));
+}
+
+static inline unsigned int QuotedMask16(__m128i v, char quote) {
+  // chars inside of a quoted literal: not NUL, quote nor backslash
+  __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+                           _mm_cmpeq_epi8(v, _mm_set1_epi8(quote)));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+  return ~_mm_movemask_epi8(m) & 0xFFFF;
+}
+
+static inline unsigned int SpaceMask16(__m128i v) {
+  __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                           _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+  return _mm_movemask_epi8(m);
+}
+
+static inline unsigned int NotNewlineMask16(__m128i v) {
+  __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+                           _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+  return ~_mm_movemask_epi8(m) & 0xFFFF;
+}
+
+#define GEN_SKIP_SSE2(name, params, mask_expr) \
+  static NO_ASAN const char *name params { \
+    unsigned int offset = (uintptr_t)p & 15; \
+    const __m128i *q = (const __m128i *)(p - offset); \
+    __m128i v = _mm_load_si128(q); \
+    unsigned int stop = ~(mask_expr) & (0xFFFF << offset) & 0xFFFF; \
+    while (!stop) { \
+      v = _mm_load_si128(++q); \
+      stop = ~(mask_expr) & 0xFFFF; \
+    } \
+    return (const char *)q + __builtin_ctz(stop); \
+  }
+
+GEN_SKIP_SSE2(SkipIdentCharsSSE2, (const char *p), IdentMask16(v))
+GEN_SKIP_SSE2(SkipDigitsSSE2, (const char *p), DigitMask16(v))
+GEN_SKIP_SSE2(SkipQuotedCharsSSE2, (const char *p, char quote),
+              QuotedMask16(v, quote))
+GEN_SKIP_SSE2(SkipSpacesSSE2, (const char *p), SpaceMask16(v))
+GEN_SKIP_SSE2(SkipToNewlineSSE2, (const char *p), NotNewlineMask16(v))
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i InRange32(__m256i v, char lo, char hi) {
+  return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                          _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+static inline AVX2 unsigned int IdentMask32(__m256i v) {
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i m =
+      _mm256_or_si256(InRange32(lower, 'a', 'z'), InRange32(v, '0', '9'));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+  return _mm256_movemask_epi8(m);
+}
+
+static inline AVX2 unsigned int DigitMask32(__m256i v) {
+  return _mm256_movemask_epi8(InRange32(v, '0', '9'));
+}
+
+static inline AVX2 unsigned int QuotedMask32(__m256i v, char quote) {
+  __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()),
+                              _mm256_cmpeq_epi8(v, _mm256_set1_epi8(quote)));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+  return ~_mm256_movemask_epi8(m);
+}
+
+static inline AVX2 unsigned int SpaceMask32(__m256i v) {
+  __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                              _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+  return _mm256_movemask_epi8(m);
+}
+
+static inline AVX2 unsigned int NotNewlineMask32(__m256i v) {
+  __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()),
+                              _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+  return ~_mm256_movemask_epi8(m);
+}
+
+#define GEN_SKIP_AVX2(name, params, mask_expr) \
+  static AVX2 NO_ASAN const char *name params { \
+    unsigned int offset = (uintptr_t)p & 31; \
+    const __m256i *q = (const __m256i *)(p - offset); \
+    __m256i v = _mm256_load_si256(q); \
+    unsigned int stop = ~(mask_expr) & (0xFFFFFFFFu << offset); \
+    while (!stop) { \
+      v = _mm256_load_si256(++q); \
+      stop = ~(mask_expr); \
+    } \
+    return (const char *)q + __builtin_ctz(stop); \
+  }
+
+GEN_SKIP_AVX2(SkipIdentCharsAVX2, (const char *p), IdentMask32(v))
+GEN_SKIP_AVX2(SkipDigitsAVX2, (const char *p), DigitMask32(v))
+GEN_SKIP_AVX2(SkipQuotedCharsAVX2, (const char *p, char quote),
+              QuotedMask32(v, quote))
+GEN_SKIP_AVX2(SkipSpacesAVX2, (const char *p), SpaceMask32(v))
+GEN_SKIP_AVX2(SkipToNewlineAVX2, (const char *p), NotNewlineMask32(v))
+
+#endif  // SCAN_USE_SIMD
+
+static const char *(*skip_ident_chars)(const char *p) = SkipIdentCharsScalar;
+static const char *(*skip_digits)(const char *p) = SkipDigitsScalar;
+static const char *(*skip_quoted_chars)(const char *p,
+                                        char quote) = SkipQuotedCharsScalar;
+static const char *(*skip_spaces)(const char *p) = SkipSpacesScalar;
+static const char *(*skip_to_newline)(const char *p) = SkipToNewlineScalar;
+
+void InitScanner() {
+  // COMPILIUM_SCAN=scalar|sse2|avx2 overrides the CPU detection.
+  const char *mode = getenv("COMPILIUM_SCAN");
+  if (mode && strcmp(mode, "scalar") == 0) return;
+#ifdef SCAN_USE_SIMD
+  __builtin_cpu_init();
+  int use_avx2 = __builtin_cpu_supports("avx2");
+  if (mode && strcmp(mode, "sse2") == 0) use_avx2 = 0;
+  if (use_avx2) {
+    skip_ident_chars = SkipIdentCharsAVX2;
+    skip_digits = SkipDigitsAVX2;
+    skip_quoted_chars = SkipQuotedCharsAVX2;
+    skip_spaces = SkipSpacesAVX2;
+    skip_to_newline = SkipToNewlineAVX2;
+  } else {
+    skip_ident_chars = SkipIdentCharsSSE2;
+    skip_digits = SkipDigitsSSE2;
+    skip_quoted_chars = SkipQuotedCharsSSE2;
+    skip_spaces = SkipSpacesSSE2;
+    skip_to_newline = SkipToNewlineSSE2;
+  }
+#endif
+}
+
+const char *SkipIdentChars(const char *p) { return skip_ident_chars(p); }
+
+const char *SkipDigits(const char *p) { return skip_digits(p); }
+
+const char *SkipQuotedChars(const char *p, char quote) {
+  // Stops at the quote, a backslash or the end of input.
+  return skip_quoted_chars(p, quote);
+}
+
+const char *SkipSpaces(const char *p) {
+  // Skips ' ' and '\n'.
+  return skip_spaces(p);
+}
+
+const char *SkipToNewline(const char *p) {
+  // Stops at '\n' or the end of input.
+  return skip_to_newline(p);
+}
@@ -0,0 +1,131 @@
+#include "compilium.h"
+
+// Scoped symbol table.
+// Names are interned symbols, so a name is found by hashing an int into an
+// open-addressing table. A slot, once taken by a name, keeps it; the slot
+// points at the innermost binding of the name, and each binding links to the
+// one it shadows. PopScope() unlinks the bindings of the innermost scope in
+// reverse order, so entering and leaving a scope costs only its own
+// declarations.
+
+typedef struct {
+  int name;
+  const Var *var;
+  int slot;
+  int shadowed;  // index of the shadowed binding + 1, 0: none
+} ScopeBinding;
+
+typedef struct {
+  int name;     // kSymNone: empty slot
+  int binding;  // index of the innermost binding + 1, 0: unbound
+} ScopeSlot;
+
+struct SCOPE_TABLE {
+  ScopeSlot *slots;
+  int num_of_slots;  // always a power of 2
+  int num_of_used_slots;
+  ScopeBinding *bindings;  // in declaration order
+  int num_of_bindings;
+  int bindings_capacity;
+  int *scope_begins;  // num_of_bindings when each scope was pushed
+  int num_of_scopes;
+  int scopes_capacity;
+};
+
+static unsigned int HashName(int name) {
+  // Fibonacci hashing; interned names are small consecutive integers.
+  return (unsigned int)name * 2654435769u;
+}
+
+static int FindScopeSlot(const ScopeTable *table, int name) {
+  // Returns the slot of name, or the empty slot where it would go.
+  int mask = table->num_of_slots - 1;
+  int i = HashName(name) & mask;
+  while (table->slots[i].name && table->slots[i].name != name) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+static void GrowScopeSlots(ScopeTable *table) {
+  ScopeSlot *old_slots = table->slots;
+  int old_num_of_slots = table->num_of_slots;
+  table->num_of_slots = old_num_of_slots ? old_num_of_slots * 2 : 64;
+  table->slots = calloc(table->num_of_slots, sizeof(ScopeSlot));
+  if (!table->slots) Error("Failed to allocate scope table");
+  for (int i = 0; i < old_num_of_slots; i++) {
+    if (!old_slots[i].name) continue;
+    table->slots[FindScopeSlot(table, old_slots[i].name)] = old_slots[i];
+  }
+  // Shadowed bindings also refer to their slot.
+  for (int i = 0; i < table->num_of_bindings; i++) {
+    ScopeBinding *binding = &table->bindings[i];
+    binding->slot = FindScopeSlot(table, binding->name);
+  }
+  free(old_slots);
+}
+
+ScopeTable *AllocScopeTable() {
+  ScopeTable *table = calloc(1, sizeof(ScopeTable));
+  if (!table) Error("Failed to allocate scope table");
+  GrowScopeSlots(table);
+  return table;
+}
+
+void PushScope(ScopeTable *table) {
+  if (table->num_of_scopes >= table->scopes_capacity) {
+    table->scopes_capacity =
+        table->scopes_capacity ? table->scopes_capacity * 2 : 16;
+    table->scope_begins =
+        realloc(table->scope_begins, sizeof(int) * table->scopes_capacity);
+    if (!table->scope_begins) Error("Failed to allocate scope table");
+  }
+  table->scope_begins[table->num_of_scopes++] = table->num_of_bindings;
+}
+
+void PopScope(ScopeTable *table) {
+  if (!table->num_of_scopes) Error("PopScope: no scope to pop");
+  int begin = table->scope_begins[--table->num_of_scopes];
+  while (table->num_of_bindings > begin) {
+    ScopeBinding *binding = &table->bindings[--table->num_of_bindings];
+    table->slots[binding->slot].binding = binding->shadowed;
+  }
+}
+
+int DeclareVar(ScopeTable *table, int name, const Var *var) {
+  // Returns 0 (and keeps the first binding) if name is already declared in
+  // the innermost scope.
+  if (!table->num_of_scopes) Error("DeclareVar: no scope");
+  if ((table->num_of_used_slots + 1) * 2 > table->num_of_slots) {
+    GrowScopeSlots(table);
+  }
+  int slot = FindScopeSlot(table, name);
+  int shadowed = table->slots[slot].binding;
+  int scope_begin = table->scope_begins[table->num_of_scopes - 1];
+  if (shadowed > scope_begin) return 0;
+  if (table->num_of_bindings >= table->bindings_capacity) {
+    table->bindings_capacity =
+        table->bindings_capacity ? table->bindings_capacity * 2 : 64;
+    table->bindings = realloc(
+        table->bindings, sizeof(ScopeBinding) * table->bindings_capacity);
+    if (!table->bindings) Error("Failed to allocate scope table");
+  }
+  if (!table->slots[slot].name) {
+    table->slots[slot].name = name;
+    table->num_of_used_slots++;
+  }
+  ScopeBinding *binding = &table->bindings[table->num_of_bindings++];
+  binding->name = name;
+  binding->var = var;
+  binding->slot = slot;
+  binding->shadowed = shadowed;
+  table->slots[slot].binding = table->num_of_bindings;
+  return 1;
+}
+
+const Var *LookupVar(const ScopeTable *table, int name) {
+  // Returns the innermost binding of name, or NULL.
+  const ScopeSlot *slot = &table->slots[FindScopeSlot(table, name)];
+  if (!slot->binding) return NULL;
+  return table->bindings[slot->binding - 1].var;
+}
@@ -0,0 +1,105 @@
+#include "compilium.h"
+
+// Source locations.
+// Every loaded buffer gets a range of a single 32-bit location space, so a
+// token records where it came from in one SourceLocation. Location 0 means
+// unknown. Line and column numbers are computed only when they are needed,
+// from a table of line beginnings built on the first lookup in each buffer.
+
+static SourceBuffer **source_buffers;  // ordered by loc
+static int num_of_source_buffers;
+static SourceLocation next_source_location = 1;
+
+const SourceBuffer *AddSourceBuffer(const char *filename, const char *src,
+                                    int size) {
+  // src must be NUL-terminated. The location of src[size] is also valid.
+  if (size < 0 || (SourceLocation)size >= ~next_source_location) {
+    Error("Too much source to address (%s)", filename);
+  }
+  SourceBuffer *buffer = calloc(1, sizeof(SourceBuffer));
+  if (!buffer) Error("Failed to allocate SourceBuffer");
+  buffer->filename = filename;
+  buffer->begin = src;
+  buffer->size = size;
+  buffer->loc = next_source_location;
+  next_source_location += size + 1;
+  source_buffers = realloc(
+      source_buffers, sizeof(SourceBuffer *) * (num_of_source_buffers + 1));
+  if (!source_buffers) Error("Failed to allocate SourceBuffer");
+  source_buffers[num_of_source_buffers++] = buffer;
+  return buffer;
+}
+
+static SourceBuffer *FindSourceBuffer(SourceLocation loc) {
+  int lo = 0;
+  int hi = num_of_source_buffers;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    SourceBuffer *buffer = source_buffers[mid];
+    if (loc < buffer->loc) {
+      hi = mid;
+    } else if (loc > buffer->loc + buffer->size) {
+      lo = mid + 1;
+    } else {
+      return buffer;
+    }
+  }
+  return NULL;
+}
+
+static void BuildLineTable(SourceBuffer *buffer) {
+  int capacity = 64;
+  int *line_begins = malloc(sizeof(int) * capacity);
+  if (!line_begins) Error("Failed to allocate line table");
+  int num_of_lines = 0;
+  line_begins[num_of_lines++] = 0;
+  const char *end = buffer->begin + buffer->size;
+  for (const char *p = buffer->begin;;) {
+    p = SkipToNewline(p);
+    if (p >= end) break;
+    if (num_of_lines >= capacity) {
+      capacity *= 2;
+      line_begins = realloc(line_begins, sizeof(int) * capacity);
+      if (!line_begins) Error("Failed to allocate line table");
+    }
+    line_begins[num_of_lines++] = ++p - buffer->begin;
+  }
+  buffer->line_begins = line_begins;
+  buffer->num_of_lines = num_of_lines;
+}
+
+int GetSourcePosition(SourceLocation loc, const char **filename, int *line,
+                      int *column) {
+  // Returns 0 if loc is unknown.
+  SourceBuffer *buffer = FindSourceBuffer(loc);
+  if (!buffer) return 0;
+  if (!buffer->line_begins) BuildLineTable(buffer);
+  int offset = loc - buffer->loc;
+  int lo = 0;
+  int hi = buffer->num_of_lines;
+  while (hi - lo > 1) {
+    int mid = (lo + hi) / 2;
+    if (buffer->line_begins[mid] <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  *filename = buffer->filename;
+  *line = lo + 1;
+  *column = offset - buffer->line_begins[lo] + 1;
+  return 1;
+}
+
+const char *GetSourceLocationStr(SourceLocation loc) {
+  // Returns "file:line:column". Use this only on cold paths.
+  const char *filename;
+  int line;
+  int column;
+  if (!GetSourcePosition(loc, &filename, &line, &column)) return "(unknown)";
+  int size = snprintf(NULL, 0, "%s:%d:%d", filename, line, column) + 1;
+  char *s = malloc(size);
+  if (!s) Error("Failed to allocate location string");
+  snprintf(s, size, "%s:%d:%d", filename, line, column);
+  return s;
+}
@@ -0,0 +1,541 @@
+#include "compilium.h"
+
+// SSA form.
+// Params and locals that are not arrays are promoted from frame slots to
+// virtual registers: a store defines a new value, and a load becomes a copy
+// of the value that reaches it. Where definitions meet at a join, phis are
+// placed on the iterated dominance frontiers of the stores (Cytron et al.),
+// using the dominators of Cooper, Harvey and Kennedy. Copies are then
+// propagated into their uses, and instructions whose results are never used
+// are removed. Before code generation, each phi is replaced by copies at the
+// end of its preds.
+
+typedef struct {
+  int *data;
+  int size;
+  int capacity;
+} IntList;
+
+static void PushInt(IntList *list, int value) {
+  if (list->size >= list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 4;
+    list->data = realloc(list->data, sizeof(int) * list->capacity);
+    if (!list->data) Error("Failed to allocate IntList");
+  }
+  list->data[list->size++] = value;
+}
+
+static void FreeIntLists(IntList *lists, int num_of_lists) {
+  for (int i = 0; i < num_of_lists; i++) free(lists[i].data);
+  free(lists);
+}
+
+static void RemoveUnreachableBlocks(ILFunc *func) {
+  // Unreachable blocks have no preds, and no edges come out of them.
+  int *new_index = malloc(sizeof(int) * func->num_of_blocks);
+  if (!new_index) Error("Failed to allocate block indices");
+  int num_of_blocks = 0;
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    ILBlock *block = &func->blocks[i];
+    if (i && !block->num_of_preds) {
+      new_index[i] = -1;
+      continue;
+    }
+    new_index[i] = num_of_blocks;
+    func->blocks[num_of_blocks++] = *block;
+  }
+  func->num_of_blocks = num_of_blocks;
+  for (int i = 0; i < num_of_blocks; i++) {
+    ILBlock *block = &func->blocks[i];
+    for (int k = 0; k < block->num_of_succs; k++) {
+      block->succs[k] = new_index[block->succs[k]];
+    }
+    for (int k = 0; k < block->num_of_preds; k++) {
+      block->preds[k] = new_index[block->preds[k]];
+    }
+  }
+  free(new_index);
+}
+
+static int *ComputeReversePostorder(const ILFunc *func) {
+  // Every block is reachable here, so the order covers all of them.
+  int n = func->num_of_blocks;
+  int *order = malloc(sizeof(int) * n);
+  int *stack = malloc(sizeof(int) * n);
+  int *next_succ = calloc(n, sizeof(int));  // -1: not visited yet
+  if (!order || !stack || !next_succ) Error("Failed to allocate RPO");
+  for (int i = 0; i < n; i++) next_succ[i] = -1;
+  int num_of_done = 0;
+  int depth = 0;
+  stack[depth++] = 0;
+  next_succ[0] = 0;
+  while (depth) {
+    int b = stack[depth - 1];
+    const ILBlock *block = &func->blocks[b];
+    if (next_succ[b] < block->num_of_succs) {
+      int succ = block->succs[next_succ[b]++];
+      if (next_succ[succ] < 0) {
+        next_succ[succ] = 0;
+        stack[depth++] = succ;
+      }
+      continue;
+    }
+    order[n - 1 - num_of_done++] = b;
+    depth--;
+  }
+  free(stack);
+  free(next_succ);
+  return order;
+}
+
+static void ComputeDominators(ILFunc *func) {
+  // "A Simple, Fast Dominance Algorithm" (Cooper, Harvey and Kennedy).
+  int n = func->num_of_blocks;
+  int *order = ComputeReversePostorder(func);
+  int *rpo_index = malloc(sizeof(int) * n);
+  if (!rpo_index) Error("Failed to allocate RPO indices");
+  for (int i = 0; i < n; i++) rpo_index[order[i]] = i;
+  for (int i = 0; i < n; i++) func->blocks[i].idom = -1;
+  func->blocks[0].idom = 0;
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (int i = 1; i < n; i++) {
+      ILBlock *block = &func->blocks[order[i]];
+      int new_idom = -1;
+      for (int k = 0; k < block->num_of_preds; k++) {
+        int pred = block->preds[k];
+        if (func->blocks[pred].idom < 0) continue;  // not processed yet
+        if (new_idom < 0) {
+          new_idom = pred;
+          continue;
+        }
+        int a = pred;
+        int b = new_idom;
+        while (a != b) {
+          while (rpo_index[a] > rpo_index[b]) a = func->blocks[a].idom;
+          while (rpo_index[b] > rpo_index[a]) b = func->blocks[b].idom;
+        }
+        new_idom = a;
+      }
+      if (block->idom != new_idom) {
+        block->idom = new_idom;
+        changed = 1;
+      }
+    }
+  }
+  func->blocks[0].idom = -1;
+  free(rpo_index);
+  free(order);
+}
+
+static IntList *ComputeDominanceFrontiers(const ILFunc *func) {
+  IntList *frontiers = calloc(func->num_of_blocks, sizeof(IntList));
+  if (!frontiers) Error("Failed to allocate dominance frontiers");
+  for (int b = 0; b < func->num_of_blocks; b++) {
+    const ILBlock *block = &func->blocks[b];
+    if (block->num_of_preds < 2) continue;
+    for (int k = 0; k < block->num_of_preds; k++) {
+      for (int runner = block->preds[k]; runner != block->idom;
+           runner = func->blocks[runner].idom) {
+        IntList *frontier = &frontiers[runner];
+        if (frontier->size && frontier->data[frontier->size - 1] == b) break;
+        PushInt(frontier, b);
+      }
+    }
+  }
+  return frontiers;
+}
+
+static int IsPromotable(const ILOperand *operand) {
+  return operand->kind == kILOperandVar &&
+         operand->var->type->kind != kTypeArray;
+}
+
+static ILOperand RegOperand(int reg) {
+  ILOperand operand = {.kind = kILOperandReg, .reg = reg};
+  return operand;
+}
+
+typedef struct {
+  ILFunc *func;
+  const Var **vars;   // promoted vars
+  int num_of_vars;
+  int *var_index;     // by frame offset, -1: not promoted
+  IntList *children;  // in the dominator tree
+  IntList *stacks;    // of values, by var index
+  int *entry_defs;    // the loads of the values on entry, by var index
+} SSABuilder;
+
+static int GetVarIndex(const SSABuilder *b, const ILOperand *operand) {
+  if (!IsPromotable(operand)) return -1;
+  return b->var_index[operand->var->offset];
+}
+
+static void RenameVars(SSABuilder *b, int block_index) {
+  ILFunc *func = b->func;
+  IntList pushed = {0};  // var indices, to pop on the way out
+  ILBlock *block = &func->blocks[block_index];
+  for (int i = 0; i < block->num_of_instrs; i++) {
+    ILInstr *instr = &block->instrs[i];
+    int v;
+    if (instr->op == kILOpPhi) {
+      v = GetVarIndex(b, &instr->right);
+      PushInt(&b->stacks[v], instr->dst);
+      PushInt(&pushed, v);
+    } else if (instr->op == kILOpLoadVar &&
+               (v = GetVarIndex(b, &instr->left)) >= 0 &&
+               instr->dst != b->entry_defs[v]) {
+      IntList *stack = &b->stacks[v];
+      instr->op = kILOpCopy;
+      instr->left = RegOperand(stack->data[stack->size - 1]);
+    } else if (instr->op == kILOpStoreVar &&
+               (v = GetVarIndex(b, &instr->left)) >= 0) {
+      // The stored value is what a load would read back.
+      const Type *type = instr->left.var->type;
+      instr->dst = func->num_of_regs++;
+      instr->left = instr->right;
+      instr->op = kILOpCopy;
+      instr->right.kind = kILOperandNone;
+      if (type->size < 8) {
+        instr->op = kILOpCast;
+        instr->right.kind = kILOperandType;
+        instr->right.type = type;
+      }
+      PushInt(&b->stacks[v], instr->dst);
+      PushInt(&pushed, v);
+    }
+  }
+  for (int k = 0; k < block->num_of_succs; k++) {
+    ILBlock *succ = &func->blocks[block->succs[k]];
+    int pred_index = 0;
+    while (succ->preds[pred_index] != block_index) pred_index++;
+    for (int i = 0; i < succ->num_of_instrs; i++) {
+      ILInstr *phi = &succ->instrs[i];
+      if (phi->op != kILOpPhi) break;
+      IntList *stack = &b->stacks[GetVarIndex(b, &phi->right)];
+      func->operands[phi->left.list.begin + pred_index] =
+          RegOperand(stack->data[stack->size - 1]);
+    }
+  }
+  IntList *children = &b->children[block_index];
+  for (int k = 0; k < children->size; k++) {
+    RenameVars(b, children->data[k]);
+  }
+  for (int k = 0; k < pushed.size; k++) b->stacks[pushed.data[k]].size--;
+  free(pushed.data);
+}
+
+static void CollectPromotedVars(SSABuilder *b) {
+  ILFunc *func = b->func;
+  int max_offset = func->func_def->frame_size;
+  b->var_index = malloc(sizeof(int) * (max_offset + 1));
+  b->vars = malloc(sizeof(const Var *) * (max_offset + 1));
+  if (!b->var_index || !b->vars) Error("Failed to allocate SSA vars");
+  for (int i = 0; i <= max_offset; i++) b->var_index[i] = -1;
+  b->num_of_vars = 0;
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    const ILBlock *block = &func->blocks[i];
+    for (int k = 0; k < block->num_of_instrs; k++) {
+      const ILInstr *instr = &block->instrs[k];
+      if ((instr->op != kILOpLoadVar && instr->op != kILOpStoreVar) ||
+          !IsPromotable(&instr->left)) {
+        continue;
+      }
+      const Var *var = instr->left.var;
+      if (b->var_index[var->offset] >= 0) continue;
+      b->var_index[var->offset] = b->num_of_vars;
+      b->vars[b->num_of_vars++] = var;
+    }
+  }
+}
+
+static void PlacePhis(SSABuilder *b, IntList *frontiers) {
+  ILFunc *func = b->func;
+  int n = func->num_of_blocks;
+  int *has_phi = malloc(sizeof(int) * n);    // var index + 1
+  int *is_queued = malloc(sizeof(int) * n);  // var index + 1
+  int *worklist = malloc(sizeof(int) * n);
+  if (!has_phi || !is_queued || !worklist) Error("Failed to allocate phis");
+  for (int i = 0; i < n; i++) has_phi[i] = is_queued[i] = 0;
+  // The blocks that store to each var, in one pass over the function
+  IntList *def_blocks = calloc(b->num_of_vars + 1, sizeof(IntList));
+  if (!def_blocks) Error("Failed to allocate def blocks");
+  for (int i = 0; i < n; i++) {
+    const ILBlock *block = &func->blocks[i];
+    for (int k = 0; k < block->num_of_instrs; k++) {
+      const ILInstr *instr = &block->instrs[k];
+      int v;
+      if (instr->op != kILOpStoreVar ||
+          (v = GetVarIndex(b, &instr->left)) < 0) {
+        continue;
+      }
+      IntList *defs = &def_blocks[v];
+      if (defs->size && defs->data[defs->size - 1] == i) continue;
+      PushInt(defs, i);
+    }
+  }
+  for (int v = 0; v < b->num_of_vars; v++) {
+    int num_of_work = 0;
+    for (int k = 0; k < def_blocks[v].size; k++) {
+      int i = def_blocks[v].data[k];
+      is_queued[i] = v + 1;
+      worklist[num_of_work++] = i;
+    }
+    while (num_of_work) {
+      IntList *frontier = &frontiers[worklist[--num_of_work]];
+      for (int k = 0; k < frontier->size; k++) {
+        int join = frontier->data[k];
+        if (has_phi[join] == v + 1) continue;
+        has_phi[join] = v + 1;
+        ILOperand *incoming =
+            calloc(func->blocks[join].num_of_preds, sizeof(ILOperand));
+        if (!incoming) Error("Failed to allocate phi operands");
+        ILOperand list = AddILOperandList(func, incoming,
+                                          func->blocks[join].num_of_preds);
+        free(incoming);
+        ILInstr *phi =
+            InsertILInstr(func, join, 0, kILOpPhi, func->num_of_regs++);
+        phi->left = list;
+        phi->right.kind = kILOperandVar;
+        phi->right.var = b->vars[v];
+        if (is_queued[join] != v + 1) {
+          is_queued[join] = v + 1;
+          worklist[num_of_work++] = join;
+        }
+      }
+    }
+  }
+  FreeIntLists(def_blocks, b->num_of_vars + 1);
+  free(has_phi);
+  free(is_queued);
+  free(worklist);
+}
+
+void ConvertToSSA(ILFunc *func) {
+  RemoveUnreachableBlocks(func);
+  ComputeDominators(func);
+  SSABuilder b = {.func = func};
+  CollectPromotedVars(&b);
+  IntList *frontiers = ComputeDominanceFrontiers(func);
+  PlacePhis(&b, frontiers);
+  FreeIntLists(frontiers, func->num_of_blocks);
+  // A promoted var holds the value of its slot on entry until it is stored
+  // to: the value of a param, or an indeterminate one.
+  b.entry_defs = malloc(sizeof(int) * (b.num_of_vars + 1));
+  b.stacks = calloc(b.num_of_vars + 1, sizeof(IntList));
+  b.children = calloc(func->num_of_blocks, sizeof(IntList));
+  if (!b.entry_defs || !b.stacks || !b.children) {
+    Error("Failed to allocate SSABuilder");
+  }
+  for (int v = 0; v < b.num_of_vars; v++) {
+    ILInstr *load =
+        InsertILInstr(func, 0, v, kILOpLoadVar, func->num_of_regs++);
+    load->left.kind = kILOperandVar;
+    load->left.var = b.vars[v];
+    b.entry_defs[v] = load->dst;
+    PushInt(&b.stacks[v], load->dst);
+  }
+  for (int i = 1; i < func->num_of_blocks; i++) {
+    PushInt(&b.children[func->blocks[i].idom], i);
+  }
+  RenameVars(&b, 0);
+  FreeIntLists(b.children, func->num_of_blocks);
+  FreeIntLists(b.stacks, b.num_of_vars + 1);
+  free(b.entry_defs);
+  free(b.var_index);
+  free(b.vars);
+}
+
+static ILOperand *GetListElements(ILFunc *func, const ILOperand *list) {
+  return &func->operands[list->list.begin];
+}
+
+static int ResolveCopy(int *source, int reg) {
+  // Follows copies to the original value, compressing the path.
+  int root = reg;
+  while (source[root] != root) root = source[root];
+  while (source[reg] != root) {
+    int next = source[reg];
+    source[reg] = root;
+    reg = next;
+  }
+  return root;
+}
+
+static void ReplaceUses(ILFunc *func, ILOperand *operand, int *source) {
+  if (operand->kind == kILOperandReg) {
+    operand->reg = ResolveCopy(source, operand->reg);
+  } else if (operand->kind == kILOperandList) {
+    ILOperand *elements = GetListElements(func, operand);
+    for (int i = 0; i < operand->list.count; i++) {
+      ReplaceUses(func, &elements[i], source);
+    }
+  }
+}
+
+void PropagateCopies(ILFunc *func) {
+  // Replaces uses of copies, and of phis that merge a single value, with
+  // the values they copy. The copies are left to EliminateDeadCode().
+  int *source = malloc(sizeof(int) * func->num_of_regs);
+  if (!source) Error("Failed to allocate copy sources");
+  for (int i = 0; i < func->num_of_regs; i++) source[i] = i;
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    ILBlock *block = &func->blocks[i];
+    for (int k = 0; k < block->num_of_instrs; k++) {
+      ILInstr *instr = &block->instrs[k];
+      if (instr->op == kILOpCopy && instr->left.kind == kILOperandReg) {
+        source[instr->dst] = instr->left.reg;
+      }
+    }
+  }
+  // Removing a phi may leave another one with a single value.
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (int i = 0; i < func->num_of_blocks; i++) {
+      ILBlock *block = &func->blocks[i];
+      for (int k = 0; k < block->num_of_instrs; k++) {
+        ILInstr *phi = &block->instrs[k];
+        if (phi->op != kILOpPhi) break;
+        if (ResolveCopy(source, phi->dst) != phi->dst) continue;
+        ILOperand *elements = GetListElements(func, &phi->left);
+        int value = -1;
+        for (int e = 0; e < phi->left.list.count; e++) {
+          int incoming = ResolveCopy(source, elements[e].reg);
+          if (incoming == phi->dst || incoming == value) continue;
+          value = value == -1 ? incoming : -2;  // -2: merges several values
+          if (value == -2) break;
+        }
+        if (value < 0) continue;
+        source[phi->dst] = value;
+        changed = 1;
+      }
+    }
+  }
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    ILBlock *block = &func->blocks[i];
+    for (int k = 0; k < block->num_of_instrs; k++) {
+      ILInstr *instr = &block->instrs[k];
+      if (instr->op == kILOpPhi && source[instr->dst] != instr->dst) {
+        // Left for EliminateDeadCode() as a copy.
+        instr->op = kILOpCopy;
+        instr->left = RegOperand(ResolveCopy(source, instr->dst));
+        instr->right.kind = kILOperandNone;
+        continue;
+      }
+      ReplaceUses(func, &instr->left, source);
+      ReplaceUses(func, &instr->right, source);
+    }
+  }
+  free(source);
+}
+
+static int HasSideEffects(const ILInstr *instr) {
+  switch (instr->op) {
+    case kILOpStoreVar:
+    case kILOpCall:
+    case kILOpJump:
+    case kILOpBranch:
+    case kILOpReturn:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static void MarkUses(ILFunc *func, const ILOperand *operand, char *is_live,
+                     IntList *worklist) {
+  if (operand->kind == kILOperandReg) {
+    if (!is_live[operand->reg]) {
+      is_live[operand->reg] = 1;
+      PushInt(worklist, operand->reg);
+    }
+  } else if (operand->kind == kILOperandList) {
+    const ILOperand *elements = GetListElements(func, operand);
+    for (int i = 0; i < operand->list.count; i++) {
+      MarkUses(func, &elements[i], is_live, worklist);
+    }
+  }
+}
+
+void EliminateDeadCode(ILFunc *func) {
+  // Mark and sweep: values are dead unless an instruction with side effects
+  // uses them, directly or through other live values. Dead cycles of phis
+  // are removed as well.
+  char *is_live = calloc(func->num_of_regs, 1);
+  const ILInstr **defs = calloc(func->num_of_regs, sizeof(ILInstr *));
+  if (!is_live || !defs) Error("Failed to allocate DCE marks");
+  IntList worklist = {0};
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    ILBlock *block = &func->blocks[i];
+    for (int k = 0; k < block->num_of_instrs; k++) {
+      const ILInstr *instr = &block->instrs[k];
+      if (instr->dst) defs[instr->dst] = instr;
+      if (!HasSideEffects(instr)) continue;
+      if (instr->dst) is_live[instr->dst] = 1;
+      MarkUses(func, &instr->left, is_live, &worklist);
+      MarkUses(func, &instr->right, is_live, &worklist);
+    }
+  }
+  while (worklist.size) {
+    const ILInstr *def = defs[worklist.data[--worklist.size]];
+    if (!def) continue;
+    MarkUses(func, &def->left, is_live, &worklist);
+    MarkUses(func, &def->right, is_live, &worklist);
+  }
+  for (int i = 0; i < func->num_of_blocks; i++) {
+    ILBlock *block = &func->blocks[i];
+    int num_of_instrs = 0;
+    for (int k = 0; k < block->num_of_instrs; k++) {
+      const ILInstr *instr = &block->instrs[k];
+      if (!HasSideEffects(instr) && !is_live[instr->dst]) continue;
+      block->instrs[num_of_instrs++] = *instr;
+    }
+    block->num_of_instrs = num_of_instrs;
+  }
+  free(worklist.data);
+  free(defs);
+  free(is_live);
+}
+
+void ConvertFromSSA(ILFunc *func) {
+  // Replaces phis with copies at the end of their preds. A pred with two
+  // succs gets a block of its own on the edge, so the copies run only on
+  // the way to the phis. The copies of a block's phis happen at once, so
+  // they go through temporaries when there are several.
+  int num_of_blocks = func->num_of_blocks;
+  for (int i = 0; i < num_of_blocks; i++) {
+    int num_of_phis = 0;
+    while (num_of_phis < func->blocks[i].num_of_instrs &&
+           func->blocks[i].instrs[num_of_phis].op == kILOpPhi) {
+      num_of_phis++;
+    }
+    if (!num_of_phis) continue;
+    for (int p = 0; p < func->blocks[i].num_of_preds; p++) {
+      int pred = func->blocks[i].preds[p];
+      if (func->blocks[pred].num_of_succs > 1) {
+        int succ_index = func->blocks[pred].succs[0] == i ? 0 : 1;
+        pred = SplitILEdge(func, pred, succ_index);
+      }
+      int first_temp = func->num_of_regs;
+      if (num_of_phis > 1) func->num_of_regs += num_of_phis;
+      for (int pass = num_of_phis > 1 ? 0 : 1; pass < 2; pass++) {
+        for (int k = 0; k < num_of_phis; k++) {
+          const ILInstr *phi = &func->blocks[i].instrs[k];
+          ILOperand value = GetListElements(func, &phi->left)[p];
+          int dst = phi->dst;
+          if (num_of_phis > 1 && pass == 0) dst = first_temp + k;
+          if (num_of_phis > 1 && pass == 1) value.reg = first_temp + k;
+          ILBlock *pred_block = &func->blocks[pred];
+          ILInstr *copy = InsertILInstr(func, pred,
+                                        pred_block->num_of_instrs - 1,
+                                        kILOpCopy, dst);
+          copy->left = value;
+        }
+      }
+    }
+    ILBlock *block = &func->blocks[i];
+    block->num_of_instrs -= num_of_phis;
+    memmove(block->instrs, &block->instrs[num_of_phis],
+            sizeof(ILInstr) * block->num_of_instrs);
+  }
+}
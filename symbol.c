@@ -0,0 +1,215 @@
+#include "compilium.h"
+
+// Interned symbol table.
+// Each distinct spelling of an identifier, keyword or punctuator gets a stable
+// integer id, so that comparing tokens is an integer comparison.
+// Ids below kNumOfPredefinedSymbols are fixed and registered by InitSymbols().
+
+typedef struct {
+  unsigned int hash;
+  int sym;  // kSymNone: empty slot
+} SymbolHashEntry;
+
+static SymbolHashEntry *hash_table;
+static int hash_table_capacity;  // always a power of 2
+
+static const char **symbol_strs;
+static int *symbol_lens;
+static int num_of_symbols;
+static int symbol_capacity;
+
+static unsigned int HashBytes(const char *s, int len) {
+  // FNV-1a
+  unsigned int hash = 2166136261u;
+  for (int i = 0; i < len; i++) {
+    hash ^= (unsigned char)s[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static void InsertToHashTable(unsigned int hash, int sym) {
+  int mask = hash_table_capacity - 1;
+  int i = hash & mask;
+  while (hash_table[i].sym) i = (i + 1) & mask;
+  hash_table[i].hash = hash;
+  hash_table[i].sym = sym;
+}
+
+static void GrowHashTable() {
+  SymbolHashEntry *old_table = hash_table;
+  int old_capacity = hash_table_capacity;
+  hash_table_capacity = old_capacity ? old_capacity * 2 : 256;
+  hash_table = calloc(hash_table_capacity, sizeof(SymbolHashEntry));
+  if (!hash_table) Error("Failed to allocate symbol hash table");
+  for (int i = 0; i < old_capacity; i++) {
+    if (!old_table[i].sym) continue;
+    InsertToHashTable(old_table[i].hash, old_table[i].sym);
+  }
+  free(old_table);
+}
+
+static int AppendSymbol(const char *s, int len) {
+  if (num_of_symbols >= symbol_capacity) {
+    symbol_capacity = symbol_capacity ? symbol_capacity * 2 : 256;
+    symbol_strs = realloc(symbol_strs, sizeof(const char *) * symbol_capacity);
+    symbol_lens = realloc(symbol_lens, sizeof(int) * symbol_capacity);
+    if (!symbol_strs || !symbol_lens) Error("Failed to allocate symbols");
+  }
+  char *str = malloc(len + 1);
+  memcpy(str, s, len);
+  str[len] = 0;
+  symbol_strs[num_of_symbols] = str;
+  symbol_lens[num_of_symbols] = len;
+  return num_of_symbols++;
+}
+
+int InternSymbol(const char *s, int len) {
+  if (!hash_table) Error("InternSymbol: InitSymbols() is not called");
+  unsigned int hash = HashBytes(s, len);
+  int mask = hash_table_capacity - 1;
+  for (int i = hash & mask; hash_table[i].sym; i = (i + 1) & mask) {
+    int sym = hash_table[i].sym;
+    if (hash_table[i].hash == hash && symbol_lens[sym] == len &&
+        memcmp(symbol_strs[sym], s, len) == 0)
+      return sym;
+  }
+  // Keep the load factor below 1/2.
+  if ((num_of_symbols + 1) * 2 > hash_table_capacity) GrowHashTable();
+  int sym = AppendSymbol(s, len);
+  InsertToHashTable(hash, sym);
+  return sym;
+}
+
+const char *GetSymbolStr(int sym) {
+  if (sym <= kSymNone || num_of_symbols <= sym) return "(null)";
+  return symbol_strs[sym];
+}
+
+int GetSymbolLen(int sym) {
+  if (sym <= kSymNone || num_of_symbols <= sym) return 0;
+  return symbol_lens[sym];
+}
+
+static void RegisterPredefinedSymbol(int sym, const char *s) {
+  if (InternSymbol(s, strlen(s)) != sym) {
+    Error("Predefined symbol %s is registered out of order", s);
+  }
+}
+
+void InitSymbols() {
+  GrowHashTable();
+  AppendSymbol("", 0);  // kSymNone
+  // keywords
+  RegisterPredefinedSymbol(kSymAuto, "auto");
+  RegisterPredefinedSymbol(kSymBreak, "break");
+  RegisterPredefinedSymbol(kSymCase, "case");
+  RegisterPredefinedSymbol(kSymChar, "char");
+  RegisterPredefinedSymbol(kSymConst, "const");
+  RegisterPredefinedSymbol(kSymContinue, "continue");
+  RegisterPredefinedSymbol(kSymDefault, "default");
+  RegisterPredefinedSymbol(kSymDo, "do");
+  RegisterPredefinedSymbol(kSymDouble, "double");
+  RegisterPredefinedSymbol(kSymElse, "else");
+  RegisterPredefinedSymbol(kSymEnum, "enum");
+  RegisterPredefinedSymbol(kSymExtern, "extern");
+  RegisterPredefinedSymbol(kSymFloat, "float");
+  RegisterPredefinedSymbol(kSymFor, "for");
+  RegisterPredefinedSymbol(kSymGoto, "goto");
+  RegisterPredefinedSymbol(kSymIf, "if");
+  RegisterPredefinedSymbol(kSymInline, "inline");
+  RegisterPredefinedSymbol(kSymInt, "int");
+  RegisterPredefinedSymbol(kSymLong, "long");
+  RegisterPredefinedSymbol(kSymRegister, "register");
+  RegisterPredefinedSymbol(kSymRestrict, "restrict");
+  RegisterPredefinedSymbol(kSymReturn, "return");
+  RegisterPredefinedSymbol(kSymShort, "short");
+  RegisterPredefinedSymbol(kSymSigned, "signed");
+  RegisterPredefinedSymbol(kSymSizeof, "sizeof");
+  RegisterPredefinedSymbol(kSymStatic, "static");
+  RegisterPredefinedSymbol(kSymStruct, "struct");
+  RegisterPredefinedSymbol(kSymSwitch, "switch");
+  RegisterPredefinedSymbol(kSymTypedef, "typedef");
+  RegisterPredefinedSymbol(kSymUnion, "union");
+  RegisterPredefinedSymbol(kSymUnsigned, "unsigned");
+  RegisterPredefinedSymbol(kSymVoid, "void");
+  RegisterPredefinedSymbol(kSymVolatile, "volatile");
+  RegisterPredefinedSymbol(kSymWhile, "while");
+  RegisterPredefinedSymbol(kSymBool, "_Bool");
+  RegisterPredefinedSymbol(kSymComplex, "_Complex");
+  RegisterPredefinedSymbol(kSymImaginary, "_Imaginary");
+  // punctuators
+  RegisterPredefinedSymbol(kSymLBracket, "[");
+  RegisterPredefinedSymbol(kSymRBracket, "]");
+  RegisterPredefinedSymbol(kSymLParen, "(");
+  RegisterPredefinedSymbol(kSymRParen, ")");
+  RegisterPredefinedSymbol(kSymLBrace, "{");
+  RegisterPredefinedSymbol(kSymRBrace, "}");
+  RegisterPredefinedSymbol(kSymTilde, "~");
+  RegisterPredefinedSymbol(kSymQuestion, "?");
+  RegisterPredefinedSymbol(kSymColon, ":");
+  RegisterPredefinedSymbol(kSymSemicolon, ";");
+  RegisterPredefinedSymbol(kSymComma, ",");
+  RegisterPredefinedSymbol(kSymPercent, "%");
+  RegisterPredefinedSymbol(kSymModAssign, "%=");
+  RegisterPredefinedSymbol(kSymBackslash, "\\");
+  RegisterPredefinedSymbol(kSymOr, "|");
+  RegisterPredefinedSymbol(kSymLogicalOr, "||");
+  RegisterPredefinedSymbol(kSymOrAssign, "|=");
+  RegisterPredefinedSymbol(kSymAnd, "&");
+  RegisterPredefinedSymbol(kSymLogicalAnd, "&&");
+  RegisterPredefinedSymbol(kSymAndAssign, "&=");
+  RegisterPredefinedSymbol(kSymPlus, "+");
+  RegisterPredefinedSymbol(kSymInc, "++");
+  RegisterPredefinedSymbol(kSymAddAssign, "+=");
+  RegisterPredefinedSymbol(kSymSlash, "/");
+  RegisterPredefinedSymbol(kSymDoubleSlash, "//");
+  RegisterPredefinedSymbol(kSymDivAssign, "/=");
+  RegisterPredefinedSymbol(kSymMinus, "-");
+  RegisterPredefinedSymbol(kSymDec, "--");
+  RegisterPredefinedSymbol(kSymSubAssign, "-=");
+  RegisterPredefinedSymbol(kSymArrow, "->");
+  RegisterPredefinedSymbol(kSymAssign, "=");
+  RegisterPredefinedSymbol(kSymEq, "==");
+  RegisterPredefinedSymbol(kSymNot, "!");
+  RegisterPredefinedSymbol(kSymNotEq, "!=");
+  RegisterPredefinedSymbol(kSymStar, "*");
+  RegisterPredefinedSymbol(kSymMulAssign, "*=");
+  RegisterPredefinedSymbol(kSymLt, "<");
+  RegisterPredefinedSymbol(kSymShl, "<<");
+  RegisterPredefinedSymbol(kSymLtEq, "<=");
+  RegisterPredefinedSymbol(kSymShlAssign, "<<=");
+  RegisterPredefinedSymbol(kSymGt, ">");
+  RegisterPredefinedSymbol(kSymShr, ">>");
+  RegisterPredefinedSymbol(kSymGtEq, ">=");
+  RegisterPredefinedSymbol(kSymShrAssign, ">>=");
+  RegisterPredefinedSymbol(kSymXor, "^");
+  RegisterPredefinedSymbol(kSymXorAssign, "^=");
+  RegisterPredefinedSymbol(kSymDot, ".");
+  RegisterPredefinedSymbol(kSymEllipsis, "...");
+  RegisterPredefinedSymbol(kSymHash, "#");
+  RegisterPredefinedSymbol(kSymHashHash, "##");
+  RegisterPredefinedSymbol(kSymEndOfDirective, "\n");
+  // preprocessor directives
+  RegisterPredefinedSymbol(kSymInclude, "include");
+  RegisterPredefinedSymbol(kSymDefine, "define");
+  RegisterPredefinedSymbol(kSymUndef, "undef");
+  RegisterPredefinedSymbol(kSymIfdef, "ifdef");
+  RegisterPredefinedSymbol(kSymIfndef, "ifndef");
+  RegisterPredefinedSymbol(kSymElif, "elif");
+  RegisterPredefinedSymbol(kSymEndif, "endif");
+  RegisterPredefinedSymbol(kSymError, "error");
+  RegisterPredefinedSymbol(kSymLine, "line");
+  RegisterPredefinedSymbol(kSymPragma, "pragma");
+  RegisterPredefinedSymbol(kSymOnce, "once");
+  RegisterPredefinedSymbol(kSymDefined, "defined");
+  RegisterPredefinedSymbol(kSymVaArgs, "__VA_ARGS__");
+  // The perfect hash of token.c must be made again for a new keyword.
+  for (int sym = kSymAuto; sym < kSymLBracket; sym++) {
+    if (LookupKeyword(GetSymbolStr(sym), GetSymbolLen(sym)) != sym) {
+      Error("Keyword %s is not in the keyword hash table; "
+            "regenerate it with gen_keyword_hash.py",
+            GetSymbolStr(sym));
+    }
+  }
+}
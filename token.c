@@ -1,95 +1,339 @@
 #include "compilium.h"
 
-void InternalCopyTokenStr(Token *token, const char *s, size_t len) {
-  if (len >= MAX_TOKEN_LEN) {
-    Error("Too long token");
-  }
-  strncpy(token->str, s, len);
-  token->str[len] = 0;
+// Perfect hash of keywords.
+// Generated by gen_keyword_hash.py, which searches for a multiplier M such that
+//   ((s[0] << 24 | s[1] << 16 | s[len - 1] << 8 | len) * M) >> 26
+// maps every keyword to a distinct slot of a 64-entry table.
+// InitSymbols() checks that every keyword is found here.
+#define KEYWORD_HASH_MULTIPLIER 0x94baf921u
+#define KEYWORD_HASH_SHIFT 26
+#define KEYWORD_MIN_LEN 2
+#define KEYWORD_MAX_LEN 10
+static const int keyword_hash_table[1 << (32 - KEYWORD_HASH_SHIFT)] = {
+    kSymEnum,     kSymNone,      kSymNone,     kSymInt,
+    kSymSwitch,   kSymNone,      kSymNone,     kSymNone,
+    kSymNone,     kSymDo,        kSymDouble,   kSymFor,
+    kSymContinue, kSymElse,      kSymWhile,    kSymCase,
+    kSymBool,     kSymTypedef,   kSymNone,     kSymNone,
+    kSymNone,     kSymNone,      kSymRestrict, kSymUnion,
+    kSymNone,     kSymNone,      kSymConst,    kSymNone,
+    kSymNone,     kSymIf,        kSymImaginary, kSymLong,
+    kSymStatic,   kSymSigned,    kSymNone,     kSymChar,
+    kSymNone,     kSymVoid,      kSymNone,     kSymExtern,
+    kSymBreak,    kSymVolatile,  kSymShort,    kSymNone,
+    kSymGoto,     kSymNone,      kSymNone,     kSymComplex,
+    kSymAuto,     kSymNone,      kSymNone,     kSymReturn,
+    kSymUnsigned, kSymInline,    kSymNone,     kSymNone,
+    kSymFloat,    kSymRegister,  kSymStruct,   kSymNone,
+    kSymNone,     kSymNone,      kSymDefault,  kSymSizeof,
+};
+
+int LookupKeyword(const char *s, int len) {
+  // Returns the symbol of the keyword s, or kSymNone if s is not a keyword.
+  if (len < KEYWORD_MIN_LEN || KEYWORD_MAX_LEN < len) return kSymNone;
+  unsigned int key = (unsigned int)(unsigned char)s[0] << 24 |
+                     (unsigned int)(unsigned char)s[1] << 16 |
+                     (unsigned int)(unsigned char)s[len - 1] << 8 | len;
+  int sym =
+      keyword_hash_table[(key * KEYWORD_HASH_MULTIPLIER) >> KEYWORD_HASH_SHIFT];
+  if (!sym || GetSymbolLen(sym) != len ||
+      memcmp(GetSymbolStr(sym), s, len) != 0)
+    return kSymNone;
+  return sym;
+}
+
+static int GetSymbolForToken(const char *begin, int len, TokenType type) {
+  if (type != kIdentifier && type != kPunctuator) return kSymNone;
+  int sym = LookupKeyword(begin, len);
+  return sym ? sym : InternSymbol(begin, len);
 }
 
 Token *AllocateToken(const char *s, TokenType type) {
   if (!s) {
     Error("Trying to allocate a token with a null string");
   }
-  Token *token = malloc(sizeof(Token));
-  InternalCopyTokenStr(token, s, strlen(s));
+  Token *token = AllocFromArena(&token_arena, sizeof(Token));
+  token->begin = s;
+  token->length = strlen(s);
+  token->sym = GetSymbolForToken(s, token->length, type);
   token->type = type;
+  token->loc = 0;
   return token;
 }
 
-Token *AllocateTokenWithSubstring(const char *begin, const char *end,
-                                  TokenType type, const char *filename,
-                                  int line) {
-  Token *token = malloc(sizeof(Token));
-  InternalCopyTokenStr(token, begin, end - begin);
-  token->type = type;
-  token->filename = filename;
-  token->line = line;
-  return token;
+const char *GetTokenStr(const Token *token) {
+  // Returns a NUL-terminated string of the token.
+  // Literals are views into the source buffer, so they are copied here;
+  // use this only on cold paths.
+  if (token->sym) return GetSymbolStr(token->sym);
+  char *s = malloc(token->length + 1);
+  memcpy(s, token->begin, token->length);
+  s[token->length] = 0;
+  return s;
 }
 
-int IsEqualToken(const Token *token, const char *s) {
-  if (!token) return 0;
-  return strcmp(token->str, s) == 0;
+int GetCharacterLiteralValue(const Token *token) {
+  int c = (unsigned char)token->begin[0];
+  if (token->length == 2 && c == '\\') {
+    switch (token->begin[1]) {
+      case 'n':
+        return '\n';
+      case 't':
+        return '\t';
+      case '0':
+        return 0;
+      default:
+        return (unsigned char)token->begin[1];
+    }
+  }
+  if (token->length != 1) {
+    Error("'%.*s' is not supported as a character constant.", token->length,
+          token->begin);
+  }
+  return c;
 }
 
-static const char *keyword_list[] = {
-    "auto",       "break",    "case",     "char",   "const",   "continue",
-    "default",    "do",       "double",   "else",   "enum",    "extern",
-    "float",      "for",      "goto",     "if",     "inline",  "int",
-    "long",       "register", "restrict", "return", "short",   "signed",
-    "sizeof",     "static",   "struct",   "switch", "typedef", "union",
-    "unsigned",   "void",     "volatile", "while",  "_Bool",   "_Complex",
-    "_Imaginary", NULL};
+int IsEqualToken(const Token *token, int sym) {
+  return token && token->sym == sym;
+}
 
 int IsKeyword(const Token *token) {
-  for (int i = 0; keyword_list[i]; i++) {
-    if (IsEqualToken(token, keyword_list[i])) return 1;
-  }
-  return 0;
+  return token && kSymAuto <= token->sym && token->sym <= kSymImaginary;
 }
 
 int IsTypeToken(const Token *token) {
-  return IsEqualToken(token, "int") || IsEqualToken(token, "char");
+  if (!token) return 0;
+  // type-specifier keywords
+  switch (token->sym) {
+    case kSymVoid:
+    case kSymChar:
+    case kSymShort:
+    case kSymInt:
+    case kSymLong:
+    case kSymSigned:
+    case kSymUnsigned:
+      return 1;
+  }
+  return 0;
 }
 
+// TokenList grows without limit.
+// The fields the parser tests on every step (symbol and type) are kept in
+// dense parallel arrays. The full records, which AST nodes point to, live in
+// fixed-size chunks so that pointers from GetTokenAt stay valid while the
+// list grows.
+//
+// A TokenList made by AllocateTokenStream lexes lazily instead: tokens are
+// pulled from the preprocessor when the parser asks for them, and kept in a
+// ring buffer (window) that holds only the tokens after the last
+// CommitTokens().
+// The window doubles when the parser looks further ahead than it can hold.
+// Pointers from GetTokenAt into a window are only valid until the parser
+// lexes further, so tokens kept in AST nodes must go through RetainToken().
+//
+// A TokenList given records by UseTokenRecords refers to the arrays of its
+// caller, such as tokens mapped from a token cache, and cannot grow.
+#define TOKEN_CHUNK_SHIFT 12
+#define TOKEN_CHUNK_SIZE (1 << TOKEN_CHUNK_SHIFT)
+#define TOKEN_CHUNK_MASK (TOKEN_CHUNK_SIZE - 1)
+#define TOKEN_WINDOW_INITIAL_CAPACITY 64
+
 struct TOKEN_LIST {
   int capacity;
   int size;
-  const Token *tokens[];
+  int *syms;
+  unsigned char *types;
+  Token **chunks;
+  int num_of_chunks;
+  // stream mode
+  Token *window;  // capacity entries, indexed by (index & (capacity - 1))
+  int base;       // tokens before base are discarded
+  int is_pulling;
+  TokenList *retained;
+  int is_fixed;  // the arrays belong to the caller of UseTokenRecords
 };
 
-TokenList *AllocateTokenList(int capacity) {
-  TokenList *list =
-      malloc(sizeof(TokenList) + sizeof(const Token *) * capacity);
-  list->capacity = capacity;
-  list->size = 0;
+TokenList *AllocateTokenList() {
+  TokenList *list = calloc(1, sizeof(TokenList));
+  if (!list) Error("Failed to allocate TokenList");
   return list;
 }
 
-int IsTokenListFull(TokenList *list) { return (list->size >= list->capacity); }
+TokenList *AllocateTokenStream(const SourceBuffer *buffer) {
+  TokenList *list = AllocateTokenList();
+  list->capacity = TOKEN_WINDOW_INITIAL_CAPACITY;
+  list->syms = malloc(sizeof(int) * list->capacity);
+  list->types = malloc(list->capacity);
+  list->window = malloc(sizeof(Token) * list->capacity);
+  if (!list->syms || !list->types || !list->window)
+    Error("Failed to allocate token window");
+  BeginPreprocess(buffer);
+  list->retained = AllocateTokenList();
+  return list;
+}
+
+static void GrowTokenList(TokenList *list) {
+  list->capacity = list->capacity ? list->capacity * 2 : TOKEN_CHUNK_SIZE;
+  list->syms = realloc(list->syms, sizeof(int) * list->capacity);
+  list->types = realloc(list->types, list->capacity);
+  if (!list->syms || !list->types) Error("Failed to grow TokenList");
+}
+
+static void GrowTokenWindow(TokenList *list) {
+  int old_mask = list->capacity - 1;
+  int new_capacity = list->capacity * 2;
+  int new_mask = new_capacity - 1;
+  int *syms = malloc(sizeof(int) * new_capacity);
+  unsigned char *types = malloc(new_capacity);
+  Token *window = malloc(sizeof(Token) * new_capacity);
+  if (!syms || !types || !window) Error("Failed to grow token window");
+  for (int i = list->base; i < list->size; i++) {
+    syms[i & new_mask] = list->syms[i & old_mask];
+    types[i & new_mask] = list->types[i & old_mask];
+    window[i & new_mask] = list->window[i & old_mask];
+  }
+  free(list->syms);
+  free(list->types);
+  free(list->window);
+  list->syms = syms;
+  list->types = types;
+  list->window = window;
+  list->capacity = new_capacity;
+}
+
+static int GetSlotOfIndex(const TokenList *list, int index) {
+  return list->window ? index & (list->capacity - 1) : index;
+}
+
+static Token *GetTokenRecord(const TokenList *list, int index) {
+  if (list->window) return &list->window[index & (list->capacity - 1)];
+  return &list->chunks[index >> TOKEN_CHUNK_SHIFT][index & TOKEN_CHUNK_MASK];
+}
+
+static Token *AppendTokenSlot(TokenList *list) {
+  // Returns the record for a new token at list->size.
+  // The caller fills it and updates syms, types and size.
+  if (list->window) {
+    if (list->size - list->base >= list->capacity) GrowTokenWindow(list);
+    return GetTokenRecord(list, list->size);
+  }
+  if (list->is_fixed) Error("Appending to a fixed TokenList");
+  if (list->size >= list->capacity) GrowTokenList(list);
+  if ((list->size >> TOKEN_CHUNK_SHIFT) >= list->num_of_chunks) {
+    list->chunks =
+        realloc(list->chunks, sizeof(Token *) * (list->num_of_chunks + 1));
+    if (!list->chunks) Error("Failed to grow TokenList");
+    Token *chunk =
+        AllocFromArena(&token_arena, sizeof(Token) * TOKEN_CHUNK_SIZE);
+    list->chunks[list->num_of_chunks++] = chunk;
+  }
+  return GetTokenRecord(list, list->size);
+}
 
 void AppendTokenToList(TokenList *list, const Token *token) {
-  if (IsTokenListFull(list)) {
-    Error("No more space in TokenList");
+  *AppendTokenSlot(list) = *token;
+  int slot = GetSlotOfIndex(list, list->size);
+  list->syms[slot] = token->sym;
+  list->types[slot] = token->type;
+  list->size++;
+}
+
+void AppendTokenWithSubstring(TokenList *list, const char *begin,
+                              const char *end, TokenType type, int sym,
+                              SourceLocation loc) {
+  Token *token = AppendTokenSlot(list);
+  token->begin = begin;
+  token->length = end - begin;
+  token->sym = sym;
+  token->type = type;
+  token->loc = loc;
+  int slot = GetSlotOfIndex(list, list->size);
+  list->syms[slot] = sym;
+  list->types[slot] = type;
+  list->size++;
+}
+
+void UseTokenRecords(TokenList *list, Token *records, int *syms,
+                     unsigned char *types, int size) {
+  // Makes an empty list hold the size tokens in the arrays, which must live
+  // as long as the list.
+  if (list->size || list->window) Error("UseTokenRecords: list in use");
+  list->num_of_chunks = (size + TOKEN_CHUNK_SIZE - 1) >> TOKEN_CHUNK_SHIFT;
+  list->chunks = malloc(sizeof(Token *) * (list->num_of_chunks + 1));
+  if (!list->chunks) Error("Failed to allocate TokenList");
+  for (int i = 0; i < list->num_of_chunks; i++) {
+    list->chunks[i] = &records[i << TOKEN_CHUNK_SHIFT];
+  }
+  list->syms = syms;
+  list->types = types;
+  list->capacity = size;
+  list->size = size;
+  list->is_fixed = 1;
+}
+
+static int HasTokenAt(TokenList *list, int index) {
+  if (!list || index < 0) return 0;
+  if (list->window && !list->is_pulling) {
+    if (index < list->base) {
+      Error("Token %d is already discarded (window: %d-%d)", index,
+            list->base, list->size);
+    }
+    // Preprocess until the requested token is available.
+    // Pulling is not reentrant.
+    list->is_pulling = 1;
+    while (list->size <= index && PreprocessNext(list)) {
+    }
+    list->is_pulling = 0;
   }
-  list->tokens[list->size++] = token;
+  return index < list->size;
 }
 
 const Token *GetTokenAt(TokenList *list, int index) {
-  if (!list || index < 0 || list->size <= index) return NULL;
-  return list->tokens[index];
+  if (!HasTokenAt(list, index)) return NULL;
+  return GetTokenRecord(list, index);
+}
+
+int GetTokenSymAt(TokenList *list, int index) {
+  if (!HasTokenAt(list, index)) return kSymNone;
+  return list->syms[GetSlotOfIndex(list, index)];
+}
+
+int GetTokenTypeAt(TokenList *list, int index) {
+  if (!HasTokenAt(list, index)) return -1;
+  return list->types[GetSlotOfIndex(list, index)];
+}
+
+int IsEqualTokenAt(TokenList *list, int index, int sym) {
+  return GetTokenSymAt(list, index) == sym;
+}
+
+void CommitTokens(TokenList *list, int index) {
+  // The parser will not look at tokens before index anymore.
+  if (!list->window || index <= list->base) return;
+  list->base = index < list->size ? index : list->size;
+}
+
+const Token *RetainToken(TokenList *list, const Token *token) {
+  // Returns a copy of token that lives as long as the AST.
+  if (!token || !list->window) return token;
+  AppendTokenToList(list->retained, token);
+  return GetTokenAt(list->retained, GetSizeOfTokenList(list->retained) - 1);
+}
+
+int GetTokenWindowCapacity(const TokenList *list) {
+  return list->window ? list->capacity : 0;
 }
 
 int GetSizeOfTokenList(const TokenList *list) { return list->size; }
 void SetSizeOfTokenList(TokenList *list, int size) { list->size = size; }
 
-void PrintToken(const Token *token) { printf("%s ", token->str); }
+void PrintToken(const Token *token) {
+  printf("%.*s ", token->length, token->begin);
+}
 
-void PrintTokenList(const TokenList *list) {
-  for (int i = 0; i < list->size; i++) {
-    if (i) putchar(' ');
-    PrintToken(list->tokens[i]);
+void PrintTokenList(TokenList *list) {
+  for (int i = list->base; i < list->size; i++) {
+    if (i != list->base) putchar(' ');
+    PrintToken(GetTokenAt(list, i));
   }
 }
@@ -0,0 +1,300 @@
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compilium.h"
+
+// On-disk cache of lexed header files (like precompiled headers).
+// A cache file holds the raw tokens of one file, named by a hash of its path
+// and valid while the file has the same size, mtime, inode and device. Raw
+// tokens keep directives unexpanded, so they do not depend on the macro
+// state at the point of inclusion and one entry serves every includer.
+//
+// Layout (native endian, each part aligned to 8 bytes):
+//   TokenCacheHeader
+//   char path[path_length]
+//   uint32_t first_token[num_of_symbols]: spelling of each symbol
+//   Token records[num_of_tokens]
+//   int syms[num_of_tokens]
+//   unsigned char types[num_of_tokens]
+// The records and the arrays are the ones a TokenList keeps, except that
+// begin and loc are offsets into the file. Predefined symbols are stored as
+// is and other symbols as kNumOfPredefinedSymbols + (index in the cache).
+// A cache is mapped copy-on-write and relocated in place: only the distinct
+// spellings are interned, and nothing is copied token by token.
+
+#define TOKEN_CACHE_MAGIC "CMTK"
+#define TOKEN_CACHE_VERSION 3
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t num_of_predefined_symbols;
+  // of the cached file
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t ino;
+  uint64_t dev;
+  uint32_t path_length;
+  uint32_t num_of_tokens;
+  uint32_t num_of_symbols;
+  uint32_t padding;
+} TokenCacheHeader;
+
+typedef struct {
+  size_t path;
+  size_t first_token;
+  size_t records;
+  size_t syms;
+  size_t types;
+  size_t end;
+} TokenCacheLayout;
+
+static const char *token_cache_dir;
+
+void SetTokenCacheDir(const char *dir) { token_cache_dir = dir; }
+
+static uint64_t HashPath(const char *s) {
+  // FNV-1a (64-bit)
+  uint64_t hash = 14695981039346656037ull;
+  for (; *s; s++) {
+    hash ^= (unsigned char)*s;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static void GetCachePath(char *path, size_t size, const char *filename) {
+  snprintf(path, size, "%s/%016llx.tok", token_cache_dir,
+           (unsigned long long)HashPath(filename));
+}
+
+static size_t AlignTo8(size_t size) { return (size + 7) & ~(size_t)7; }
+
+static TokenCacheLayout GetTokenCacheLayout(const TokenCacheHeader *header) {
+  TokenCacheLayout layout;
+  layout.path = sizeof(TokenCacheHeader);
+  layout.first_token = AlignTo8(layout.path + header->path_length);
+  layout.records = AlignTo8(layout.first_token +
+                            sizeof(uint32_t) * header->num_of_symbols);
+  layout.syms = layout.records + sizeof(Token) * header->num_of_tokens;
+  layout.types = layout.syms + sizeof(int) * header->num_of_tokens;
+  layout.end = layout.types + header->num_of_tokens;
+  return layout;
+}
+
+static int GetFileIdentity(TokenCacheHeader *header, const char *filename) {
+  // Returns 0 if filename cannot be stat'ed.
+  struct stat st;
+  if (stat(filename, &st) != 0) return 0;
+  header->size = st.st_size;
+  header->mtime_sec = st.st_mtim.tv_sec;
+  header->mtime_nsec = st.st_mtim.tv_nsec;
+  header->ino = st.st_ino;
+  header->dev = st.st_dev;
+  return 1;
+}
+
+static int IsValidTokenCache(const TokenCacheHeader *header,
+                             size_t cache_size, const SourceBuffer *buffer) {
+  TokenCacheHeader identity;
+  size_t path_length = strlen(buffer->filename);
+  if (memcmp(header->magic, TOKEN_CACHE_MAGIC, 4) != 0 ||
+      header->version != TOKEN_CACHE_VERSION ||
+      header->record_size != sizeof(Token) ||
+      header->num_of_predefined_symbols != kNumOfPredefinedSymbols ||
+      header->path_length != path_length ||
+      GetTokenCacheLayout(header).end != cache_size ||
+      memcmp((const char *)header + sizeof(TokenCacheHeader),
+             buffer->filename, path_length) != 0 ||
+      !GetFileIdentity(&identity, buffer->filename)) {
+    return 0;
+  }
+  return header->size == identity.size && header->size == buffer->size &&
+         header->mtime_sec == identity.mtime_sec &&
+         header->mtime_nsec == identity.mtime_nsec &&
+         header->ino == identity.ino && header->dev == identity.dev;
+}
+
+static int RelocateCachedTokens(char *cache, const SourceBuffer *buffer) {
+  // Returns 0 if a token is out of the buffer.
+  const TokenCacheHeader *header = (const TokenCacheHeader *)cache;
+  TokenCacheLayout layout = GetTokenCacheLayout(header);
+  const uint32_t *first_token = (const uint32_t *)(cache + layout.first_token);
+  Token *records = (Token *)(cache + layout.records);
+  int *syms = (int *)(cache + layout.syms);
+  uint32_t num_of_tokens = header->num_of_tokens;
+  uint32_t num_of_symbols = header->num_of_symbols;
+  size_t src_size = buffer->size;
+  int *local_syms = malloc(sizeof(int) * (num_of_symbols + 1));
+  if (!local_syms) Error("Failed to allocate token cache symbols");
+  int is_valid = 1;
+  for (uint32_t i = 0; i < num_of_symbols && is_valid; i++) {
+    const Token *t = first_token[i] < num_of_tokens
+                         ? &records[first_token[i]]
+                         : NULL;
+    uintptr_t offset = t ? (uintptr_t)t->begin : 0;
+    if (!t || src_size < offset || src_size - offset < (size_t)t->length) {
+      is_valid = 0;
+      break;
+    }
+    local_syms[i] = InternSymbol(buffer->begin + offset, t->length);
+  }
+  for (uint32_t i = 0; i < num_of_tokens && is_valid; i++) {
+    Token *t = &records[i];
+    uintptr_t offset = (uintptr_t)t->begin;
+    if (src_size < offset || t->length < 0 ||
+        src_size - offset < (size_t)t->length || src_size < t->loc ||
+        t->sym < 0 || t->sym >= kNumOfPredefinedSymbols + (int)num_of_symbols) {
+      is_valid = 0;
+      break;
+    }
+    t->begin = buffer->begin + offset;
+    t->loc += buffer->loc;
+    if (t->sym >= kNumOfPredefinedSymbols) {
+      t->sym = local_syms[t->sym - kNumOfPredefinedSymbols];
+    }
+    syms[i] = t->sym;
+  }
+  free(local_syms);
+  return is_valid;
+}
+
+static int LoadCachedTokens(TokenList *tokens, const SourceBuffer *buffer) {
+  // Returns 0 if there is no valid cache for buffer. The tokens refer to
+  // the mapped cache, which is kept until the process exits.
+  char path[4096];
+  GetCachePath(path, sizeof(path), buffer->filename);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return 0;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(TokenCacheHeader)) {
+    close(fd);
+    return 0;
+  }
+  size_t cache_size = st.st_size;
+  char *cache = mmap(NULL, cache_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     fd, 0);
+  close(fd);
+  if (cache == MAP_FAILED) return 0;
+  const TokenCacheHeader *header = (const TokenCacheHeader *)cache;
+  if (!IsValidTokenCache(header, cache_size, buffer) ||
+      !RelocateCachedTokens(cache, buffer)) {
+    munmap(cache, cache_size);
+    return 0;
+  }
+  TokenCacheLayout layout = GetTokenCacheLayout(header);
+  UseTokenRecords(tokens, (Token *)(cache + layout.records),
+                  (int *)(cache + layout.syms),
+                  (unsigned char *)(cache + layout.types),
+                  header->num_of_tokens);
+  return 1;
+}
+
+static int WritePadded(FILE *fp, const void *data, size_t size) {
+  static const char zeros[8];
+  return fwrite(data, 1, size, fp) == size &&
+         fwrite(zeros, 1, AlignTo8(size) - size, fp) == AlignTo8(size) - size;
+}
+
+static void SaveCachedTokens(TokenList *tokens, const SourceBuffer *buffer) {
+  // Failures are ignored: the cache is only an optimization.
+  TokenCacheHeader header = {
+      .version = TOKEN_CACHE_VERSION,
+      .record_size = sizeof(Token),
+      .num_of_predefined_symbols = kNumOfPredefinedSymbols,
+      .path_length = strlen(buffer->filename),
+  };
+  memcpy(header.magic, TOKEN_CACHE_MAGIC, 4);
+  if (!GetFileIdentity(&header, buffer->filename) ||
+      header.size != (uint64_t)buffer->size) {
+    return;
+  }
+  const char *src = buffer->begin;
+  size_t src_size = buffer->size;
+  int num_of_tokens = GetSizeOfTokenList(tokens);
+  int max_sym = 0;
+  for (int i = 0; i < num_of_tokens; i++) {
+    int sym = GetTokenSymAt(tokens, i);
+    if (sym > max_sym) max_sym = sym;
+  }
+  // local_syms[sym]: 1 + index in the cache of a non-predefined symbol
+  int *local_syms = calloc(max_sym + 1, sizeof(int));
+  uint32_t *first_token = malloc(sizeof(uint32_t) * (num_of_tokens + 1));
+  Token *records = calloc(num_of_tokens + 1, sizeof(Token));
+  int *syms = malloc(sizeof(int) * (num_of_tokens + 1));
+  unsigned char *types = malloc(num_of_tokens + 1);
+  if (!local_syms || !first_token || !records || !syms || !types)
+    Error("Failed to allocate token cache");
+  int num_of_symbols = 0;
+  int is_cachable = 1;
+  for (int i = 0; i < num_of_tokens; i++) {
+    const Token *token = GetTokenAt(tokens, i);
+    Token *t = &records[i];
+    if (token->begin < src || src + src_size < token->begin + token->length ||
+        token->loc < buffer->loc || buffer->loc + src_size < token->loc) {
+      is_cachable = 0;
+      break;
+    }
+    t->begin = (const char *)(uintptr_t)(token->begin - src);
+    t->length = token->length;
+    t->sym = token->sym;
+    if (token->sym >= kNumOfPredefinedSymbols) {
+      if (!local_syms[token->sym]) {
+        first_token[num_of_symbols] = i;
+        local_syms[token->sym] = ++num_of_symbols;
+      }
+      t->sym = kNumOfPredefinedSymbols + local_syms[token->sym] - 1;
+    }
+    t->type = token->type;
+    t->loc = token->loc - buffer->loc;
+    syms[i] = t->sym;
+    types[i] = token->type;
+  }
+  if (is_cachable) {
+    header.num_of_tokens = num_of_tokens;
+    header.num_of_symbols = num_of_symbols;
+    // Write to a temporary file and rename it, so that concurrent compilers
+    // never see a partially written cache.
+    char path[4096];
+    char tmp_path[4096 + 32];
+    GetCachePath(path, sizeof(path), buffer->filename);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+    FILE *fp = fopen(tmp_path, "wb");
+    if (fp) {
+      int ok =
+          WritePadded(fp, &header, sizeof(header)) &&
+          WritePadded(fp, buffer->filename, header.path_length) &&
+          WritePadded(fp, first_token, sizeof(uint32_t) * num_of_symbols) &&
+          fwrite(records, sizeof(Token), num_of_tokens, fp) ==
+              (size_t)num_of_tokens &&
+          fwrite(syms, sizeof(int), num_of_tokens, fp) ==
+              (size_t)num_of_tokens &&
+          fwrite(types, 1, num_of_tokens, fp) == (size_t)num_of_tokens;
+      if (fclose(fp) != 0) ok = 0;
+      if (!ok || rename(tmp_path, path) != 0) unlink(tmp_path);
+    }
+  }
+  free(local_syms);
+  free(first_token);
+  free(records);
+  free(syms);
+  free(types);
+}
+
+void TokenizeWithCache(TokenList *tokens, const SourceBuffer *buffer) {
+  // Same as Tokenize() on an empty list, but reuses the tokens cached by a
+  // previous run if SetTokenCacheDir() is called.
+  if (!token_cache_dir) {
+    Tokenize(tokens, buffer);
+    return;
+  }
+  if (LoadCachedTokens(tokens, buffer)) return;
+  Tokenize(tokens, buffer);
+  SaveCachedTokens(tokens, buffer);
+}
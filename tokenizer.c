@@ -1,172 +1,296 @@
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "compilium.h"
 
-const char *Preprocess(TokenList *tokens, const char *p);
+static char *MapFile(int fd, size_t size) {
+  // Reserve one more byte than the file so the buffer is always followed by
+  // zero-filled memory (the tokenizer expects a NUL-terminated input), then
+  // map the file over the head of the reservation.
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t reserve_size = (size + 1 + page_size - 1) / page_size * page_size;
+  char *buf = mmap(NULL, reserve_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1, 0);
+  if (buf == MAP_FAILED) return NULL;
+  if (size && mmap(buf, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+                  MAP_FAILED) {
+    munmap(buf, reserve_size);
+    return NULL;
+  }
+  return buf;
+}
+
+static char *ReadAll(int fd, size_t *size) {
+  // Fallback for pipes and other unmappable inputs.
+  size_t capacity = 4096;
+  size_t used = 0;
+  char *buf = malloc(capacity);
+  for (;;) {
+    if (used + 1 >= capacity) {
+      capacity *= 2;
+      buf = realloc(buf, capacity);
+      if (!buf) Error("Failed to allocate input buffer");
+    }
+    ssize_t n = read(fd, buf + used, capacity - used - 1);
+    if (n < 0) Error("Failed to read input");
+    if (n == 0) break;
+    used += n;
+  }
+  buf[used] = 0;
+  *size = used;
+  return buf;
+}
 
-char *ReadFile(const char *file_name) {
-  // file_buf is allocated here.
-  FILE *fp = fopen(file_name, "rb");
-  if (!fp) {
+const char *ReadFile(const char *file_name, int *size) {
+  // The returned buffer is NUL-terminated and lives until the process exits,
+  // since tokens refer to it directly. *size excludes the NUL.
+  int fd = open(file_name, O_RDONLY);
+  if (fd < 0) {
     Error("Failed to open: %s", file_name);
   }
-  char *file_buf = malloc(MAX_INPUT_SIZE);
-  int file_buf_size = fread(file_buf, 1, MAX_INPUT_SIZE, fp);
-  if (file_buf_size >= MAX_INPUT_SIZE) {
-    Error("Too large input");
+  char *file_buf = NULL;
+  size_t file_buf_size = 0;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    file_buf_size = st.st_size;
+    file_buf = MapFile(fd, file_buf_size);
   }
-  file_buf[file_buf_size] = 0;
-  printf("Input(path: %s, size: %d)\n", file_name, file_buf_size);
-  fclose(fp);
+  if (!file_buf) file_buf = ReadAll(fd, &file_buf_size);
+  close(fd);
+  if (file_buf_size > INT_MAX) Error("Too large file: %s", file_name);
+  printf("Input(path: %s, size: %zu)\n", file_name, file_buf_size);
+  *size = file_buf_size;
   return file_buf;
 }
 
 #define IS_IDENT_NODIGIT(c) \
   ((c) == '_' || ('a' <= (c) && (c) <= 'z') || ('A' <= (c) && (c) <= 'Z'))
 #define IS_IDENT_DIGIT(c) (('0' <= (c) && (c) <= '9'))
+
+// Symbols of punctuators, indexed by their first char.
+// Columns: c, cc, c=, cc=
+static const int punctuator_syms[128][4] = {
+    ['['] = {kSymLBracket},
+    [']'] = {kSymRBracket},
+    ['('] = {kSymLParen},
+    [')'] = {kSymRParen},
+    ['{'] = {kSymLBrace},
+    ['}'] = {kSymRBrace},
+    ['~'] = {kSymTilde},
+    ['?'] = {kSymQuestion},
+    [':'] = {kSymColon},
+    [';'] = {kSymSemicolon},
+    [','] = {kSymComma},
+    ['%'] = {kSymPercent, kSymNone, kSymModAssign},
+    ['\\'] = {kSymBackslash},
+    ['|'] = {kSymOr, kSymLogicalOr, kSymOrAssign},
+    ['&'] = {kSymAnd, kSymLogicalAnd, kSymAndAssign},
+    ['+'] = {kSymPlus, kSymInc, kSymAddAssign},
+    ['/'] = {kSymSlash, kSymDoubleSlash, kSymDivAssign},
+    ['-'] = {kSymMinus, kSymDec, kSymSubAssign},
+    ['='] = {kSymAssign, kSymNone, kSymEq},
+    ['!'] = {kSymNot, kSymNone, kSymNotEq},
+    ['*'] = {kSymStar, kSymNone, kSymMulAssign},
+    ['<'] = {kSymLt, kSymShl, kSymLtEq, kSymShlAssign},
+    ['>'] = {kSymGt, kSymShr, kSymGtEq, kSymShrAssign},
+    ['^'] = {kSymXor, kSymNone, kSymXorAssign},
+};
+#define PUNCTUATOR_SYM(c, variant) \
+  punctuator_syms[(unsigned char)(c) & 0x7F][variant]
+#define IS_SINGLE_CHAR_PUNCTUATOR(c) \
+  (!((c) & 0x80) && PUNCTUATOR_SYM(c, 0) && !PUNCTUATOR_SYM(c, 1) && \
+   !PUNCTUATOR_SYM(c, 2))
+
+static inline SourceLocation LocationOf(const SourceBuffer *buffer,
+                                        const char *p) {
+  return buffer->loc + (SourceLocation)(p - buffer->begin);
+}
+
 const char *CommonTokenizer(TokenList *tokens, const char *p,
-                            const char *filename, int line) {
-  static const char *single_char_punctuators = "[](){}~?:;,%\\";
+                            const SourceBuffer *buffer) {
   const char *begin = NULL;
+  int sym = kSymNone;
+  SourceLocation loc = LocationOf(buffer, p);
   if (IS_IDENT_NODIGIT(*p)) {
-    begin = p++;
-    while (IS_IDENT_NODIGIT(*p) || IS_IDENT_DIGIT(*p)) {
-      p++;
-    }
-    AppendTokenToList(tokens, AllocateTokenWithSubstring(begin, p, kIdentifier,
-                                                         filename, line));
+    begin = p;
+    p = SkipIdentChars(p + 1);
+    sym = LookupKeyword(begin, p - begin);
+    if (!sym) sym = InternSymbol(begin, p - begin);
+    AppendTokenWithSubstring(tokens, begin, p, kIdentifier, sym, loc);
   } else if (IS_IDENT_DIGIT(*p)) {
-    begin = p++;
-    while (IS_IDENT_DIGIT(*p)) {
-      p++;
-    }
-    AppendTokenToList(
-        tokens, AllocateTokenWithSubstring(begin, p, kInteger, filename, line));
+    begin = p;
+    // Hex digits and suffixes are a part of the number (6.4.8).
+    p = SkipIdentChars(SkipDigits(p + 1));
+    AppendTokenWithSubstring(tokens, begin, p, kInteger, kSymNone, loc);
   } else if (*p == '"' || *p == '\'') {
     begin = p++;
-    while (*p && *p != *begin) {
-      if (*p == '\\') p++;
-      p++;
+    for (;;) {
+      p = SkipQuotedChars(p, *begin);
+      if (*p != '\\' || !p[1]) break;
+      p += 2;  // skip an escape sequence
     }
     if (*(p++) != *begin) {
-      Error("Expected %c but got char 0x%02X", *begin, *p);
+      Error("Expected %c but got char 0x%02X (%s)", *begin, *p,
+          GetSourceLocationStr(LocationOf(buffer, p - 1)));
     }
     TokenType type = (*begin == '"' ? kStringLiteral : kCharacterLiteral);
-    AppendTokenToList(tokens, AllocateTokenWithSubstring(begin + 1, p - 1, type,
-                                                         filename, line));
-  } else if (strchr(single_char_punctuators, *p)) {
+    AppendTokenWithSubstring(tokens, begin + 1, p - 1, type, kSymNone, loc);
+  } else if (IS_SINGLE_CHAR_PUNCTUATOR(*p)) {
     // single character punctuator
     begin = p++;
-    AppendTokenToList(tokens, AllocateTokenWithSubstring(begin, p, kPunctuator,
-                                                         filename, line));
+    sym = PUNCTUATOR_SYM(*begin, 0);
+    AppendTokenWithSubstring(tokens, begin, p, kPunctuator, sym, loc);
   } else if (*p == '#') {
-    p++;
-    p = Preprocess(tokens, p);
+    // # ##
+    // (only inside of directive lines)
+    begin = p++;
+    sym = kSymHash;
+    if (*p == '#') {
+      p++;
+      sym = kSymHashHash;
+    }
+    AppendTokenWithSubstring(tokens, begin, p, kPunctuator, sym, loc);
   } else if (*p == '|' || *p == '&' || *p == '+' || *p == '/') {
     // | || |=
     // & && &=
     // + ++ +=
     // / // /=
     begin = p++;
-    if (*p == *begin || *p == '=') {
+    if (*p == *begin) {
       p++;
+      sym = PUNCTUATOR_SYM(*begin, 1);
+    } else if (*p == '=') {
+      p++;
+      sym = PUNCTUATOR_SYM(*begin, 2);
+    } else {
+      sym = PUNCTUATOR_SYM(*begin, 0);
     }
-    AppendTokenToList(tokens, AllocateTokenWithSubstring(begin, p, kPunctuator,
-                                                         filename, line));
+    AppendTokenWithSubstring(tokens, begin, p, kPunctuator, sym, loc);
   } else if (*p == '-') {
     // - -- -= ->
     begin = p++;
-    if (*p == *begin || *p == '-' || *p == '>') {
+    if (*p == '-') {
       p++;
+      sym = kSymDec;
+    } else if (*p == '=') {
+      p++;
+      sym = kSymSubAssign;
+    } else if (*p == '>') {
+      p++;
+      sym = kSymArrow;
+    } else {
+      sym = kSymMinus;
     }
-    AppendTokenToList(tokens, AllocateTokenWithSubstring(begin, p, kPunctuator,
-                                                         filename, line));
-  } else if (*p == '=' || *p == '!' || *p == '*') {
+    AppendTokenWithSubstring(tokens, begin, p, kPunctuator, sym, loc);
+  } else if (*p == '=' || *p == '!' || *p == '*' || *p == '%' ||
+             *p == '^') {
     // = ==
     // ! !=
     // * *=
+    // % %=
+    // ^ ^=
     begin = p++;
     if (*p == '=') {
       p++;
+      sym = PUNCTUATOR_SYM(*begin, 2);
+    } else {
+      sym = PUNCTUATOR_SYM(*begin, 0);
     }
-    AppendTokenToList(tokens, AllocateTokenWithSubstring(begin, p, kPunctuator,
-                                                         filename, line));
+    AppendTokenWithSubstring(tokens, begin, p, kPunctuator, sym, loc);
   } else if (*p == '<' || *p == '>') {
     // < << <= <<=
     // > >> >= >>=
     begin = p++;
     if (*p == *begin) {
       p++;
+      sym = PUNCTUATOR_SYM(*begin, 1);
       if (*p == '=') {
         p++;
+        sym = PUNCTUATOR_SYM(*begin, 3);
       }
     } else if (*p == '=') {
       p++;
+      sym = PUNCTUATOR_SYM(*begin, 2);
+    } else {
+      sym = PUNCTUATOR_SYM(*begin, 0);
     }
-    AppendTokenToList(tokens, AllocateTokenWithSubstring(begin, p, kPunctuator,
-                                                         filename, line));
+    AppendTokenWithSubstring(tokens, begin, p, kPunctuator, sym, loc);
   } else if (*p == '.') {
     // .
     // ...
     begin = p++;
+    sym = kSymDot;
     if (p[0] == '.' && p[1] == '.') {
       p += 2;
+      sym = kSymEllipsis;
     }
-    AppendTokenToList(tokens, AllocateTokenWithSubstring(begin, p, kPunctuator,
-                                                         filename, line));
+    AppendTokenWithSubstring(tokens, begin, p, kPunctuator, sym, loc);
   } else {
-    Error("Unexpected char '%c'\n", *p);
+    Error("Unexpected char '%c' (%s)", *p, GetSourceLocationStr(loc));
   }
   return p;
 }
 
-const char *Preprocess(TokenList *tokens, const char *p) {
-  int org_num_of_token = GetSizeOfTokenList(tokens);
-  do {
+static const char *TokenizeHeaderName(TokenList *tokens, const char *p,
+                                      const SourceBuffer *buffer) {
+  // <h-char-sequence>
+  const char *begin = p++;
+  while (*p && *p != '>' && *p != '\n') p++;
+  if (*p != '>') {
+    Error("Expected > but got char 0x%02X (%s)", *p,
+          GetSourceLocationStr(LocationOf(buffer, p)));
+  }
+  AppendTokenWithSubstring(tokens, begin + 1, p, kHeaderName, kSymNone,
+                           LocationOf(buffer, begin));
+  return p + 1;
+}
+
+static const char *TokenizeDirective(TokenList *tokens, const char *p,
+                                     const SourceBuffer *buffer) {
+  // A directive line is kept as tokens for the preprocessor: a '#' token,
+  // the tokens on the line and an empty kSymEndOfDirective token.
+  AppendTokenWithSubstring(tokens, p, p + 1, kPunctuator, kSymHash,
+                           LocationOf(buffer, p));
+  p++;
+  int directive_index = GetSizeOfTokenList(tokens);
+  for (;;) {
     if (*p == ' ') {
       p++;
-    } else if (*p == '\n') {
-      p++;
+    } else if (*p == '\\' && p[1] == '\n') {
+      // "\\\n" continues the directive beyond the line.
+      p += 2;
+    } else if (*p == '\n' || !*p) {
       break;
-    } else if (*p == '\\') {
-      // if "\\\n", continue parsing beyond the lines.
-      // otherwise, raise Error.
-      p++;
-      if (*p != '\n') {
-        Error("Unexpected char '%c'\n", *p);
-      }
-      p++;
+    } else if (*p == '<' && GetSizeOfTokenList(tokens) == directive_index + 1 &&
+               IsEqualTokenAt(tokens, directive_index, kSymInclude)) {
+      p = TokenizeHeaderName(tokens, p, buffer);
     } else {
-      p = CommonTokenizer(tokens, p, "(preprocess)", 1);
-    }
-  } while (*p);
-  const Token *directive = GetTokenAt(tokens, org_num_of_token);
-  if (IsEqualToken(directive, "include")) {
-    Error("#include not implemented");
-    /*
-    const Token *file_name = GetTokenAt(tokens, org_num_of_token + 1);
-    if (!file_name || file_name->type != kStringLiteral) {
-      Error("Expected string literal but got %s",
-            file_name ? file_name->str : "(null)");
+      p = CommonTokenizer(tokens, p, buffer);
     }
-    SetSizeOfTokenList(tokens, org_num_of_token);
-    Tokenize(tokens, file_name->str);
-    */
-  } else {
-    Error("Unknown preprocessor directive '%s'",
-          directive ? directive->str : "(null)");
   }
+  AppendTokenWithSubstring(tokens, p, p, kPunctuator, kSymEndOfDirective,
+                           LocationOf(buffer, p));
+  if (*p == '\n') p++;
   return p;
 }
 
-void Tokenize(TokenList *tokens, const char *p, const char *filename) {
-  int line = 1;
-  do {
-    if (*p == ' ') {
-      p++;
-    } else if (*p == '\n') {
-      p++;
-      line++;
-    } else {
-      p = CommonTokenizer(tokens, p, filename, line);
-    }
-  } while (*p);
+const char *TokenizeNext(TokenList *tokens, const char *p,
+                         const SourceBuffer *buffer) {
+  // Lexes the next token (or directive line) from p and returns where to
+  // resume.
+  p = SkipSpaces(p);
+  if (!*p) return p;
+  if (*p == '#') return TokenizeDirective(tokens, p, buffer);
+  return CommonTokenizer(tokens, p, buffer);
+}
+
+void Tokenize(TokenList *tokens, const SourceBuffer *buffer) {
+  const char *p = buffer->begin;
+  while (*p) {
+    p = TokenizeNext(tokens, p, buffer);
+  }
 }
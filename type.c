@@ -0,0 +1,332 @@
+#include <pthread.h>
+#include <stdint.h>
+
+#include "compilium.h"
+
+// Hash-consed types.
+// A type is looked up by its parts (kind, qualifiers, and the canonical
+// pointers of its base and params) before it is made, so each distinct type
+// exists once and derived types are shared. The table is locked because
+// function bodies may be parsed concurrently.
+
+static const Type **type_table;
+static int type_table_capacity;  // always a power of 2
+static int num_of_types;
+static pthread_mutex_t type_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int HashType(const Type *type) {
+  // FNV-1a over the parts that identify the type
+  unsigned int hash = 2166136261u;
+#define HASH_TYPE_PART(v) hash = (hash ^ (unsigned int)(v)) * 16777619u
+  HASH_TYPE_PART(type->kind);
+  HASH_TYPE_PART(type->is_unsigned);
+  HASH_TYPE_PART(type->is_const);
+  HASH_TYPE_PART((uintptr_t)type->base);
+  HASH_TYPE_PART((uintptr_t)type->base >> 32);
+  HASH_TYPE_PART(type->length);
+  HASH_TYPE_PART(type->is_variadic);
+  for (int i = 0; i < type->num_of_params; i++) {
+    HASH_TYPE_PART((uintptr_t)type->params[i]);
+    HASH_TYPE_PART((uintptr_t)type->params[i] >> 32);
+  }
+#undef HASH_TYPE_PART
+  return hash;
+}
+
+static int IsSameTypeParts(const Type *a, const Type *b) {
+  if (a->hash != b->hash || a->kind != b->kind ||
+      a->is_unsigned != b->is_unsigned || a->is_const != b->is_const ||
+      a->base != b->base || a->length != b->length ||
+      a->num_of_params != b->num_of_params ||
+      a->is_variadic != b->is_variadic)
+    return 0;
+  for (int i = 0; i < a->num_of_params; i++) {
+    if (a->params[i] != b->params[i]) return 0;
+  }
+  return 1;
+}
+
+static void InsertToTypeTable(const Type *type) {
+  int mask = type_table_capacity - 1;
+  int i = type->hash & mask;
+  while (type_table[i]) i = (i + 1) & mask;
+  type_table[i] = type;
+}
+
+static void GrowTypeTable() {
+  const Type **old_table = type_table;
+  int old_capacity = type_table_capacity;
+  type_table_capacity = old_capacity ? old_capacity * 2 : 256;
+  type_table = calloc(type_table_capacity, sizeof(const Type *));
+  if (!type_table) Error("Failed to allocate type table");
+  for (int i = 0; i < old_capacity; i++) {
+    if (old_table[i]) InsertToTypeTable(old_table[i]);
+  }
+  free(old_table);
+}
+
+static const Type *InternType(Type *key) {
+  // Returns the canonical type that has the parts of key.
+  // size and align follow from the parts and are not compared.
+  key->hash = HashType(key);
+  pthread_mutex_lock(&type_table_lock);
+  if ((num_of_types + 1) * 2 > type_table_capacity) GrowTypeTable();
+  int mask = type_table_capacity - 1;
+  int i = key->hash & mask;
+  for (; type_table[i]; i = (i + 1) & mask) {
+    if (IsSameTypeParts(type_table[i], key)) {
+      const Type *type = type_table[i];
+      pthread_mutex_unlock(&type_table_lock);
+      return type;
+    }
+  }
+  Type *type = malloc(sizeof(Type));
+  if (!type) Error("Failed to allocate a type");
+  *type = *key;
+  if (key->num_of_params) {
+    type->params = malloc(sizeof(const Type *) * key->num_of_params);
+    if (!type->params) Error("Failed to allocate a type");
+    memcpy(type->params, key->params,
+           sizeof(const Type *) * key->num_of_params);
+  }
+  type_table[i] = type;
+  num_of_types++;
+  pthread_mutex_unlock(&type_table_lock);
+  return type;
+}
+
+const Type *GetVoidType() {
+  Type key = {.kind = kTypeVoid, .align = 1};
+  return InternType(&key);
+}
+
+const Type *GetIntegerType(TypeKind kind, int is_unsigned) {
+  // x86_64 System V (LP64)
+  Type key = {.kind = kind, .is_unsigned = is_unsigned};
+  switch (kind) {
+    case kTypeChar:
+      key.size = 1;
+      break;
+    case kTypeShort:
+      key.size = 2;
+      break;
+    case kTypeInt:
+      key.size = 4;
+      break;
+    case kTypeLong:
+    case kTypeLongLong:
+      key.size = 8;
+      break;
+    default:
+      Error("GetIntegerType: %d is not an integer type", kind);
+  }
+  key.align = key.size;
+  return InternType(&key);
+}
+
+const Type *GetPointerType(const Type *base) {
+  Type key = {.kind = kTypePointer, .size = 8, .align = 8, .base = base};
+  return InternType(&key);
+}
+
+const Type *GetArrayType(const Type *base, int length) {
+  // length is -1 if it is unknown.
+  if (!base->size) Error("Array of incomplete type %s", GetTypeStr(base));
+  Type key = {.kind = kTypeArray,
+              .size = length < 0 ? 0 : base->size * length,
+              .align = base->align,
+              .base = base,
+              .length = length};
+  return InternType(&key);
+}
+
+const Type *GetFuncType(const Type *return_type, const Type **params,
+                        int num_of_params, int is_variadic) {
+  Type key = {.kind = kTypeFunc,
+              .align = 1,
+              .base = return_type,
+              .params = params,
+              .num_of_params = num_of_params,
+              .is_variadic = is_variadic};
+  return InternType(&key);
+}
+
+const Type *GetConstType(const Type *type) {
+  if (type->is_const) return type;
+  Type key = *type;
+  key.is_const = 1;
+  return InternType(&key);
+}
+
+const Type *GetTypeOfDeclSpecs(ASTList *decl_specs) {
+  // Combines the type specifiers and qualifiers (6.7.2).
+  int num_of_void = 0, num_of_char = 0, num_of_short = 0, num_of_int = 0;
+  int num_of_long = 0, num_of_signed = 0, num_of_unsigned = 0;
+  int is_const = 0;
+  const Token *first = NULL;
+  for (int i = 0; i < GetSizeOfASTList(decl_specs); i++) {
+    ASTKeyword *kw = ToASTKeyword(GetASTNodeAt(decl_specs, i));
+    if (!kw) continue;
+    if (!first) first = kw->token;
+    switch (kw->token->sym) {
+      case kSymVoid:
+        num_of_void++;
+        break;
+      case kSymChar:
+        num_of_char++;
+        break;
+      case kSymShort:
+        num_of_short++;
+        break;
+      case kSymInt:
+        num_of_int++;
+        break;
+      case kSymLong:
+        num_of_long++;
+        break;
+      case kSymSigned:
+        num_of_signed++;
+        break;
+      case kSymUnsigned:
+        num_of_unsigned++;
+        break;
+      case kSymConst:
+        is_const = 1;
+        break;
+    }
+  }
+  int num_of_sizes =
+      num_of_void + num_of_char + num_of_short + (num_of_long > 0);
+  if (num_of_sizes > 1 || num_of_int > 1 || num_of_long > 2 ||
+      num_of_signed + num_of_unsigned > 1 ||
+      (num_of_int && (num_of_void || num_of_char)) ||
+      (num_of_void && num_of_signed + num_of_unsigned)) {
+    Error("Invalid combination of type specifiers (%s)",
+          first ? GetSourceLocationStr(first->loc) : "?");
+  }
+  const Type *type;
+  if (num_of_void) {
+    type = GetVoidType();
+  } else {
+    TypeKind kind = kTypeInt;
+    if (num_of_char) kind = kTypeChar;
+    if (num_of_short) kind = kTypeShort;
+    if (num_of_long == 1) kind = kTypeLong;
+    if (num_of_long == 2) kind = kTypeLongLong;
+    type = GetIntegerType(kind, num_of_unsigned);
+  }
+  return is_const ? GetConstType(type) : type;
+}
+
+static const Type *GetTypeOfDirectDecltor(const Type *type,
+                                          ASTDirectDecltor *direct_decltor) {
+  // The outermost derivation applies to the declared type first:
+  // in a[2][3], a is an array of 2 arrays of 3.
+  for (; direct_decltor; direct_decltor = ToASTDirectDecltor(GetASTNode(
+                             direct_decltor->direct_decltor))) {
+    if (!direct_decltor->direct_decltor) break;  // identifier
+    ASTNode *data = GetASTNode(direct_decltor->data);
+    ASTList *params = ToASTList(data);
+    if (params) {
+      // A parameter type list, or an identifier list (no prototype).
+      int num_of_params = 0;
+      int is_variadic = 0;
+      const Type **param_types =
+          malloc(sizeof(const Type *) * (GetSizeOfASTList(params) + 1));
+      if (!param_types) Error("Failed to allocate param types");
+      for (int i = 0; i < GetSizeOfASTList(params); i++) {
+        ASTNode *param = GetASTNodeAt(params, i);
+        if (param->type == kASTParamDecl) {
+          const Type *param_type = GetTypeOfParamDecl(ToASTParamDecl(param));
+          if (param_type->kind == kTypeVoid) continue;  // (void)
+          param_types[num_of_params++] = param_type;
+        } else if (param->type == kASTKeyword) {
+          is_variadic = 1;  // ...
+        }
+      }
+      type = GetFuncType(type, param_types, num_of_params, is_variadic);
+      free(param_types);
+      continue;
+    }
+    ASTConstant *length = ToASTConstant(data);
+    type = GetArrayType(type, length ? (int)length->value : -1);
+  }
+  return type;
+}
+
+const Type *GetTypeOfDecltor(const Type *base, ASTDecltor *decltor) {
+  // Returns the type declarator declares, for the type of its
+  // declaration-specifiers.
+  if (!decltor) return base;
+  const Type *type = base;
+  for (ASTPointer *pointer = ToASTPointer(GetASTNode(decltor->pointer));
+       pointer; pointer = ToASTPointer(GetASTNode(pointer->pointer))) {
+    type = GetPointerType(type);
+  }
+  return GetTypeOfDirectDecltor(
+      type, ToASTDirectDecltor(GetASTNode(decltor->direct_decltor)));
+}
+
+const Type *GetTypeOfParamDecl(ASTParamDecl *param_decl) {
+  // Arrays and functions are passed as pointers (6.7.6.3).
+  const Type *type = GetTypeOfDecltor(
+      GetTypeOfDeclSpecs(ToASTList(GetASTNode(param_decl->decl_specs))),
+      ToASTDecltor(GetASTNode(param_decl->decltor)));
+  if (type->kind == kTypeArray) return GetPointerType(type->base);
+  if (type->kind == kTypeFunc) return GetPointerType(type);
+  return type;
+}
+
+static void AppendTypeStr(char **s, int *size, const char *str) {
+  int len = strlen(str);
+  *s = realloc(*s, *size + len + 1);
+  if (!*s) Error("Failed to allocate type string");
+  memcpy(*s + *size, str, len + 1);
+  *size += len;
+}
+
+static void BuildTypeStr(char **s, int *size, const Type *type) {
+  static const char *integer_names[] = {
+      [kTypeChar] = "char", [kTypeShort] = "short", [kTypeInt] = "int",
+      [kTypeLong] = "long", [kTypeLongLong] = "long long"};
+  if (type->is_const) AppendTypeStr(s, size, "const ");
+  switch (type->kind) {
+    case kTypeVoid:
+      AppendTypeStr(s, size, "void");
+      break;
+    case kTypePointer:
+      AppendTypeStr(s, size, "pointer to ");
+      BuildTypeStr(s, size, type->base);
+      break;
+    case kTypeArray: {
+      char length[16];
+      snprintf(length, sizeof(length), "%d", type->length);
+      AppendTypeStr(s, size, "array[");
+      AppendTypeStr(s, size, type->length < 0 ? "" : length);
+      AppendTypeStr(s, size, "] of ");
+      BuildTypeStr(s, size, type->base);
+    } break;
+    case kTypeFunc:
+      AppendTypeStr(s, size, "function(");
+      for (int i = 0; i < type->num_of_params; i++) {
+        if (i) AppendTypeStr(s, size, ", ");
+        BuildTypeStr(s, size, type->params[i]);
+      }
+      if (type->is_variadic) AppendTypeStr(s, size, ", ...");
+      AppendTypeStr(s, size, ") returning ");
+      BuildTypeStr(s, size, type->base);
+      break;
+    default:
+      if (type->is_unsigned) AppendTypeStr(s, size, "unsigned ");
+      AppendTypeStr(s, size, integer_names[type->kind]);
+  }
+}
+
+const char *GetTypeStr(const Type *type) {
+  // Returns a description of type. Use this only on cold paths.
+  char *s = NULL;
+  int size = 0;
+  AppendTypeStr(&s, &size, "");
+  BuildTypeStr(&s, &size, type);
+  return s;
+}